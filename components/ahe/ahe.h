@@ -0,0 +1,34 @@
+#pragma once
+#include <span>
+#include <vector>
+
+#include <cryptoTools/Common/Defines.h>
+#include <cryptoTools/Common/block.h>
+
+#include "config.h"
+
+enum class AheKind { Paillier, EcElGamal };
+
+// an additively homomorphic scheme as the zero-test protocols use it. a
+// ciphertext is serialized as a run of cipherBlocks() blocks, the form it
+// takes in okvs encodings and messages, and a vector of them is stored flat
+class AheScheme {
+public:
+  virtual ~AheScheme() = default;
+
+  virtual AheKind kind() const = 0;
+  virtual u64 cipherBlocks() const = 0;
+
+  // encryptions of plains into out
+  virtual void encrypt(std::span<const u64> plains, std::span<block> out,
+                       u64 numThreads) const = 0;
+
+  // sums[i] is the sum of ciphertext i of every addend. the addends are
+  // vectors of sums' length, one after the other in addends
+  virtual void add(std::span<const block> addends, std::span<block> sums,
+                   u64 numThreads) const = 0;
+
+  // whether each of the ciphertexts decrypts to zero, needs the secret key
+  virtual std::vector<u8> isZero(std::span<const block> ciphers,
+                                 u64 numThreads) const = 0;
+};
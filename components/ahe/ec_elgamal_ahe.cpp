@@ -0,0 +1,178 @@
+#include "ec_elgamal_ahe.h"
+
+#include <stdexcept>
+
+#include <cryptoTools/Crypto/PRNG.h>
+
+#include "rb_okvs/rb_okvs.h"
+#include "utils/util.h"
+
+namespace {
+
+const u64 kPointBlocks = POINT_LENGTH_IN_BYTE / sizeof(block);
+
+Rist25519_point loadPoint(const block *in) {
+  Rist25519_point p;
+  p.fromBytes(reinterpret_cast<const u8 *>(in));
+  return p;
+}
+
+void storePoint(const Rist25519_point &p, block *out) {
+  p.toBytes(reinterpret_cast<u8 *>(out));
+}
+
+// m as a scalar, built from 16 bit chunks as the scalar takes an int
+Rist25519_number scalarOf(u64 m) {
+  const Rist25519_number chunk(1 << 16);
+  Rist25519_number s(0);
+  for (int shift = 48; shift >= 0; shift -= 16) {
+    s = s * chunk + Rist25519_number(int((m >> shift) & 0xffff));
+  }
+  return s;
+}
+
+// RBOKVS_rist does not copy, so it is initialized in place
+void initZeroOkvs(RBOKVS_rist &okvs, u64 numKeys) {
+  okvs.init(numKeys, OKVS_EPSILON, OKVS_LAMBDA, OKVS_SEED);
+}
+
+} // namespace
+
+EcElGamalAhe::EcElGamalAhe() {
+  PRNG prng(oc::sysRandomSeed());
+  mSk = Rist25519_number(prng);
+  mPk = Rist25519_point::mulGenerator(*mSk);
+}
+
+void EcElGamalAhe::encrypt(std::span<const u64> plains, std::span<block> out,
+                           u64 numThreads) const {
+  if (out.size() != plains.size() * EC_CIPHER_SIZE_IN_BLOCK) {
+    throw std::runtime_error("ec elgamal: size mismatch");
+  }
+  parallel_for(plains.size(), numThreads, [&](u64 start, u64 end) {
+    PRNG prng(oc::sysRandomSeed());
+    for (u64 i = start; i < end; ++i) {
+      Rist25519_number r(prng);
+      Rist25519_point c2 = r * mPk;
+      if (plains[i] != 0) {
+        c2 += Rist25519_point::mulGenerator(scalarOf(plains[i]));
+      }
+      block *cipher = out.data() + i * EC_CIPHER_SIZE_IN_BLOCK;
+      storePoint(Rist25519_point::mulGenerator(r), cipher);
+      storePoint(c2, cipher + kPointBlocks);
+    }
+  });
+}
+
+void EcElGamalAhe::add(std::span<const block> addends, std::span<block> sums,
+                       u64 numThreads) const {
+  if (sums.empty() || addends.size() % sums.size() != 0) {
+    throw std::runtime_error("ec elgamal: size mismatch");
+  }
+  const u64 count = sums.size() / EC_CIPHER_SIZE_IN_BLOCK;
+  const u64 numAddends = addends.size() / sums.size();
+  parallel_for(count, numThreads, [&](u64 start, u64 end) {
+    for (u64 i = start; i < end; ++i) {
+      // both points of a ciphertext add the same way
+      for (u64 k = 0; k < EC_CIPHER_SIZE_IN_NUMBER; ++k) {
+        const u64 at = i * EC_CIPHER_SIZE_IN_BLOCK + k * kPointBlocks;
+        Rist25519_point sum = loadPoint(addends.data() + at);
+        for (u64 a = 1; a < numAddends; ++a) {
+          sum += loadPoint(addends.data() + a * sums.size() + at);
+        }
+        storePoint(sum, sums.data() + at);
+      }
+    }
+  });
+}
+
+std::vector<u8> EcElGamalAhe::isZero(std::span<const block> ciphers,
+                                     u64 numThreads) const {
+  if (!mSk) {
+    throw std::runtime_error("ec elgamal: zero test needs the secret key");
+  }
+  std::vector<u8> zero(ciphers.size() / EC_CIPHER_SIZE_IN_BLOCK);
+  parallel_for(zero.size(), numThreads, [&](u64 start, u64 end) {
+    for (u64 i = start; i < end; ++i) {
+      const block *cipher = ciphers.data() + i * EC_CIPHER_SIZE_IN_BLOCK;
+      zero[i] = loadPoint(cipher + kPointBlocks) ==
+                *mSk * loadPoint(cipher);
+    }
+  });
+  return zero;
+}
+
+u64 EcElGamalAhe::zeroEncodingBlocks(u64 numKeys) {
+  RBOKVS_rist okvs;
+  initZeroOkvs(okvs, numKeys);
+  return okvs.num_columns * EC_CIPHER_SIZE_IN_BLOCK;
+}
+
+void EcElGamalAhe::encodeZeros(std::span<const block> keys,
+                               std::span<block> encoding,
+                               u64 numThreads) const {
+  RBOKVS_rist okvs;
+  initZeroOkvs(okvs, keys.size());
+  if (encoding.size() != okvs.num_columns * EC_CIPHER_SIZE_IN_BLOCK) {
+    throw std::runtime_error("ec elgamal: size mismatch");
+  }
+  // the free columns must not follow from the public okvs seed
+  okvs.okvs_prng.SetSeed(oc::sysRandomSeed());
+
+  std::vector<std::vector<Rist25519_number>> vals(keys.size());
+  PRNG prng(oc::sysRandomSeed());
+  for (auto &val : vals) {
+    Rist25519_number r(prng);
+    val = {r, r};
+  }
+  std::vector<Rist25519_number> solution(okvs.num_columns *
+                                         EC_CIPHER_SIZE_IN_NUMBER);
+  if (okvs.solve(std::vector<block>(keys.begin(), keys.end()), vals,
+                 EC_CIPHER_SIZE_IN_NUMBER, solution.data(),
+                 numThreads) != SUCCESS) {
+    throw std::runtime_error("ec elgamal: encoding failed");
+  }
+
+  parallel_for(okvs.num_columns, numThreads, [&](u64 start, u64 end) {
+    for (u64 i = start; i < end; ++i) {
+      const Rist25519_number *s =
+          solution.data() + i * EC_CIPHER_SIZE_IN_NUMBER;
+      block *cipher = encoding.data() + i * EC_CIPHER_SIZE_IN_BLOCK;
+      storePoint(Rist25519_point::mulGenerator(s[0]), cipher);
+      storePoint(s[1] * mPk, cipher + kPointBlocks);
+    }
+  });
+}
+
+void EcElGamalAhe::decodeZeros(std::span<const block> encoding, u64 numKeys,
+                               std::span<const block> keys,
+                               std::span<block> out, u64 numThreads) {
+  RBOKVS_rist okvs;
+  initZeroOkvs(okvs, numKeys);
+  if (encoding.size() != okvs.num_columns * EC_CIPHER_SIZE_IN_BLOCK ||
+      out.size() != keys.size() * EC_CIPHER_SIZE_IN_BLOCK) {
+    throw std::runtime_error("ec elgamal: size mismatch");
+  }
+
+  std::vector<std::vector<Rist25519_point>> codeWords(
+      okvs.num_columns,
+      std::vector<Rist25519_point>(EC_CIPHER_SIZE_IN_NUMBER));
+  parallel_for(okvs.num_columns, numThreads, [&](u64 start, u64 end) {
+    for (u64 i = start; i < end; ++i) {
+      for (u64 k = 0; k < EC_CIPHER_SIZE_IN_NUMBER; ++k) {
+        codeWords[i][k] = loadPoint(encoding.data() +
+                                    i * EC_CIPHER_SIZE_IN_BLOCK +
+                                    k * kPointBlocks);
+      }
+    }
+  });
+
+  std::vector<Rist25519_point> points;
+  okvs.decode(codeWords, std::vector<block>(keys.begin(), keys.end()),
+              EC_CIPHER_SIZE_IN_NUMBER, points, numThreads);
+  parallel_for(points.size(), numThreads, [&](u64 start, u64 end) {
+    for (u64 i = start; i < end; ++i) {
+      storePoint(points[i], out.data() + i * kPointBlocks);
+    }
+  });
+}
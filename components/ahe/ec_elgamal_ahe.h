@@ -0,0 +1,45 @@
+#pragma once
+#include <optional>
+
+#include "ahe.h"
+
+// exponential elgamal over ristretto255: m encrypts to (r * G, m * G + r * pk)
+// with sk * G = pk. sums of plaintexts are not recoverable, but a ciphertext
+// of zero is c2 == sk * c1, which is all the zero-test protocols ask for. a
+// ciphertext is its two points, EC_CIPHER_SIZE_IN_BLOCK blocks
+class EcElGamalAhe : public AheScheme {
+public:
+  // a fresh key pair
+  EcElGamalAhe();
+  // the public key only, it encrypts, adds and encodes but cannot test
+  explicit EcElGamalAhe(const Rist25519_point &pk) : mPk(pk) {}
+
+  const Rist25519_point &publicKey() const { return mPk; }
+
+  AheKind kind() const override { return AheKind::EcElGamal; }
+  u64 cipherBlocks() const override { return EC_CIPHER_SIZE_IN_BLOCK; }
+
+  void encrypt(std::span<const u64> plains, std::span<block> out,
+               u64 numThreads) const override;
+  void add(std::span<const block> addends, std::span<block> sums,
+           u64 numThreads) const override;
+  std::vector<u8> isZero(std::span<const block> ciphers,
+                         u64 numThreads) const override;
+
+  // blocks of an okvs encoding of numKeys keys
+  static u64 zeroEncodingBlocks(u64 numKeys);
+  // an okvs over the scalars of the encryptions of zero under keys, solved
+  // for (r, r) per key and published as (s1 * G, s2 * pk) per column. a key
+  // that was not encoded decodes to (s1 * G, s2 * pk) with unrelated s1 and
+  // s2, a ciphertext of a random value, and every decoding is a valid point
+  void encodeZeros(std::span<const block> keys, std::span<block> encoding,
+                   u64 numThreads) const;
+  // the ciphertexts of keys in an encoding of numKeys keys
+  static void decodeZeros(std::span<const block> encoding, u64 numKeys,
+                          std::span<const block> keys, std::span<block> out,
+                          u64 numThreads);
+
+private:
+  Rist25519_point mPk;
+  std::optional<Rist25519_number> mSk;
+};
@@ -0,0 +1,50 @@
+#include "paillier_ahe.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <ipcl/ciphertext.hpp>
+
+#include "paillier/engine.h"
+#include "paillier/rand_pool.h"
+#include "utils/util.h"
+
+void PaillierAhe::encrypt(std::span<const u64> plains, std::span<block> out,
+                          u64 numThreads) const {
+  PaillierRandPool pool(mPk);
+  pool.fill(plains.size(), numThreads);
+  pool.encrypt(plains, out, numThreads);
+}
+
+void PaillierAhe::add(std::span<const block> addends, std::span<block> sums,
+                      u64 numThreads) const {
+  if (sums.empty() || addends.size() % sums.size() != 0) {
+    throw std::runtime_error("paillier: size mismatch");
+  }
+  const u64 count = sums.size() / PAILLIER_CIPHER_SIZE_IN_BLOCK;
+  vector<vector<BigNumber>> addend_bns(addends.size() / sums.size());
+  for (u64 a = 0; a < addend_bns.size(); ++a) {
+    addend_bns[a].resize(count);
+    blocks_to_bignumers(addends.subspan(a * sums.size(), sums.size()),
+                        addend_bns[a], numThreads);
+  }
+  auto sum = PaillierEngine(mPk, numThreads).add(addend_bns);
+  bignumers_to_blocks(sum.getTexts(), sums, numThreads);
+}
+
+std::vector<u8> PaillierAhe::isZero(std::span<const block> ciphers,
+                                    u64 numThreads) const {
+  const u64 count = ciphers.size() / PAILLIER_CIPHER_SIZE_IN_BLOCK;
+  vector<BigNumber> bns(count);
+  blocks_to_bignumers(ciphers, bns, numThreads);
+  auto dec = PaillierEngine(mPk, numThreads).decrypt(mSk, bns);
+
+  // every word of the plaintext, not just the low one
+  std::vector<u8> zero(count);
+  for (u64 i = 0; i < count; ++i) {
+    auto words = dec.getElementVec(i);
+    zero[i] = std::all_of(words.begin(), words.end(),
+                          [](u32 w) { return w == 0; });
+  }
+  return zero;
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <ipcl/pri_key.hpp>
+#include <ipcl/pub_key.hpp>
+
+#include "ahe.h"
+
+// ipcl paillier, PAILLIER_CIPHER_SIZE_IN_BLOCK blocks a ciphertext
+class PaillierAhe : public AheScheme {
+public:
+  PaillierAhe(const ipcl::PublicKey &pk, const ipcl::PrivateKey &sk)
+      : mPk(pk), mSk(sk) {}
+
+  AheKind kind() const override { return AheKind::Paillier; }
+  u64 cipherBlocks() const override { return PAILLIER_CIPHER_SIZE_IN_BLOCK; }
+
+  void encrypt(std::span<const u64> plains, std::span<block> out,
+               u64 numThreads) const override;
+  void add(std::span<const block> addends, std::span<block> sums,
+           u64 numThreads) const override;
+  std::vector<u8> isZero(std::span<const block> ciphers,
+                         u64 numThreads) const override;
+
+private:
+  ipcl::PublicKey mPk;
+  ipcl::PrivateKey mSk;
+};
@@ -13,6 +13,10 @@ using pt = vector<u64>;
 const u64 OKVS_LAMBDA = 40;
 const double OKVS_EPSILON = 0.1;
 const block OKVS_SEED = oc::block(6800382592637124185);
+// how RBOKVS derives the start position and band of a key, both parties
+// must use the same
+enum class OkvsRowHash { Blake3, Blake3OnePass, AesCtr };
+const OkvsRowHash OKVS_ROW_HASH = OkvsRowHash::AesCtr;
 
 using Rist25519_point = osuCrypto::Sodium::Rist25519;
 using Rist25519_number = osuCrypto::Sodium::Prime25519;
@@ -21,6 +25,8 @@ const size_t POINT_LENGTH_IN_BYTE = sizeof(Rist25519_point);
 using Rist25519_point_in_bytes = std::array<oc::u8, POINT_LENGTH_IN_BYTE>;
 
 const oc::u64 EC_CIPHER_SIZE_IN_NUMBER = 2;
+const oc::u64 EC_CIPHER_SIZE_IN_BLOCK =
+    EC_CIPHER_SIZE_IN_NUMBER * POINT_LENGTH_IN_BYTE / 16;
 const Rist25519_point dash(oc::block(70));
 const Rist25519_point ZERO_POINT(dash - dash);
 
@@ -29,4 +35,9 @@ const oc::u32 PAILLIER_CIPHER_SIZE_IN_BLOCK =
     ((PAILLIER_KEY_SIZE_IN_BIT * 2) / 128);
 const oc::u32 PAILLIER_CIPHER_SIZE_IN_BYTE = PAILLIER_CIPHER_SIZE_IN_BLOCK * 16;
 
-const u64 COM_CHUNK_SIZE = 100000000;
\ No newline at end of file
+// columns per message when an encoding is streamed, 16 MiB of paillier
+// ciphertexts
+const u64 STREAM_CHUNK_COLUMNS = u64(1) << 15;
+
+// arrays below 1 MiB go over one socket, a thread per stripe does not pay off
+const u64 STRIPE_MIN_BLOCKS = u64(1) << 16;
\ No newline at end of file
@@ -0,0 +1,99 @@
+#pragma once
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <cryptoTools/Common/Defines.h>
+
+using oc::u64;
+using oc::u8;
+
+// one protocol message made of typed fields. scalars are stored as they are
+// and arrays behind their element count, so a header and the payload it
+// describes go over in a single send instead of a send and flush each
+class FrameWriter {
+public:
+  template <typename T> FrameWriter &put(const T &value) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    append(&value, sizeof(T));
+    return *this;
+  }
+
+  template <typename T> FrameWriter &putArray(std::span<const T> values) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    put<u64>(values.size());
+    append(values.data(), values.size_bytes());
+    return *this;
+  }
+
+  template <typename T> FrameWriter &putArray(const std::vector<T> &values) {
+    return putArray(std::span<const T>(values));
+  }
+
+  std::vector<u8> &bytes() { return mBytes; }
+
+private:
+  std::vector<u8> mBytes;
+
+  void append(const void *src, u64 size) {
+    u64 pos = mBytes.size();
+    mBytes.resize(pos + size);
+    if (size) {
+      memcpy(mBytes.data() + pos, src, size);
+    }
+  }
+};
+
+// reads the fields of a frame in the order they were put. throws if the frame
+// ends early or an array does not have the size the caller expects
+class FrameReader {
+public:
+  FrameReader() = default;
+  explicit FrameReader(std::vector<u8> bytes) : mBytes(std::move(bytes)) {}
+
+  template <typename T> T get() {
+    static_assert(std::is_trivially_copyable_v<T>);
+    T value;
+    take(&value, sizeof(T));
+    return value;
+  }
+
+  template <typename T> std::vector<T> getArray() {
+    static_assert(std::is_trivially_copyable_v<T>);
+    u64 count = get<u64>();
+    if (count > (mBytes.size() - mPos) / sizeof(T)) {
+      throw std::runtime_error("frame: array longer than the frame");
+    }
+    std::vector<T> values(count);
+    take(values.data(), count * sizeof(T));
+    return values;
+  }
+
+  // into a buffer the caller sized from an earlier field
+  template <typename T> void getArray(std::span<T> values) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    if (get<u64>() != values.size()) {
+      throw std::runtime_error("frame: unexpected array size");
+    }
+    take(values.data(), values.size_bytes());
+  }
+
+  bool done() const { return mPos == mBytes.size(); }
+
+private:
+  std::vector<u8> mBytes;
+  u64 mPos = 0;
+
+  void take(void *dst, u64 size) {
+    if (size > mBytes.size() - mPos) {
+      throw std::runtime_error("frame: read past the end");
+    }
+    if (size) {
+      memcpy(dst, mBytes.data() + mPos, size);
+    }
+    mPos += size;
+  }
+};
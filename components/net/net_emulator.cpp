@@ -0,0 +1,265 @@
+#include "net_emulator.h"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <random>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// bytes read at a time, and bytes a direction holds before it stops reading
+const u64 kChunkBytes = u64(1) << 14;
+const u64 kMaxQueuedBytes = u64(1) << 24;
+
+struct Chunk {
+  std::vector<char> data;
+  Clock::time_point due;
+};
+
+Clock::duration fromMs(double ms) {
+  return std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<double, std::milli>(ms));
+}
+
+bool writeAll(int fd, const char *ptr, u64 size) {
+  while (size) {
+    ssize_t n = ::send(fd, ptr, size, MSG_NOSIGNAL);
+    if (n <= 0) {
+      return false;
+    }
+    ptr += n;
+    size -= n;
+  }
+  return true;
+}
+
+void noDelay(int fd) {
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+} // namespace
+
+bool NetProfile::parse(const std::string &spec, NetProfile &profile) {
+  if (spec == "lan") {
+    profile = {10000, 0.2, 0};
+    return true;
+  }
+  if (spec == "wan") {
+    profile = {100, 80, 0};
+    return true;
+  }
+  const std::string prefix = "custom:";
+  if (spec.compare(0, prefix.size(), prefix) != 0) {
+    return false;
+  }
+  NetProfile p;
+  int n = sscanf(spec.c_str() + prefix.size(), "%lf,%lf,%lf",
+                 &p.mBandwidthMbps, &p.mRttMs, &p.mJitterMs);
+  if (n < 2 || p.mBandwidthMbps < 0 || p.mRttMs < 0 || p.mJitterMs < 0) {
+    return false;
+  }
+  profile = p;
+  return true;
+}
+
+std::string NetProfile::toString() const {
+  char buf[96];
+  snprintf(buf, sizeof(buf), "%g Mbps, rtt %g ms, jitter %g ms",
+           mBandwidthMbps, mRttMs, mJitterMs);
+  return buf;
+}
+
+// the destructor may read the fds while serve sets them
+struct NetEmulator::Link {
+  std::atomic<int> front{-1};
+  std::atomic<int> back{-1};
+};
+
+NetEmulator::NetEmulator(const NetProfile &profile, const std::string &backIp,
+                         u64 backPort, u64 numLinks)
+    : mProfile(profile), mBackIp(backIp), mBackPort(backPort) {
+  for (u64 i = 0; i < numLinks; ++i) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    socklen_t len = sizeof(addr);
+    if (fd < 0 || ::bind(fd, (sockaddr *)&addr, sizeof(addr)) != 0 ||
+        ::listen(fd, 1) != 0 || getsockname(fd, (sockaddr *)&addr, &len)) {
+      if (fd >= 0) {
+        ::close(fd);
+      }
+      for (int l : mListenFds) {
+        ::close(l);
+      }
+      throw std::runtime_error("net emulator: cannot listen");
+    }
+    mListenFds.push_back(fd);
+    mFrontPorts.push_back(ntohs(addr.sin_port));
+    mLinks.push_back(std::make_unique<Link>());
+  }
+  for (u64 i = 0; i < numLinks; ++i) {
+    mThreads.emplace_back(&NetEmulator::serve, this, i);
+  }
+}
+
+NetEmulator::~NetEmulator() {
+  mStop = true;
+  // unblocks accept, connect retries and the pumps' reads and writes
+  for (int fd : mListenFds) {
+    ::shutdown(fd, SHUT_RDWR);
+  }
+  for (auto &link : mLinks) {
+    if (link->front >= 0) {
+      ::shutdown(link->front, SHUT_RDWR);
+    }
+    if (link->back >= 0) {
+      ::shutdown(link->back, SHUT_RDWR);
+    }
+  }
+  for (auto &thrd : mThreads) {
+    thrd.join();
+  }
+  for (int fd : mListenFds) {
+    ::close(fd);
+  }
+  for (auto &link : mLinks) {
+    if (link->front >= 0) {
+      ::close(link->front);
+    }
+    if (link->back >= 0) {
+      ::close(link->back);
+    }
+  }
+}
+
+void NetEmulator::serve(u64 i) {
+  Link &link = *mLinks[i];
+  int front = ::accept(mListenFds[i], nullptr, nullptr);
+  if (front < 0) {
+    return;
+  }
+  noDelay(front);
+
+  // the listening side may not be up yet
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(u16(mBackPort + i));
+  inet_pton(AF_INET, mBackIp.c_str(), &addr.sin_addr);
+  int back = -1;
+  while (!mStop) {
+    back = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (::connect(back, (sockaddr *)&addr, sizeof(addr)) == 0) {
+      break;
+    }
+    ::close(back);
+    back = -1;
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  link.front = front;
+  if (back < 0) {
+    return;
+  }
+  noDelay(back);
+  link.back = back;
+  if (mStop) {
+    ::shutdown(front, SHUT_RDWR);
+    ::shutdown(back, SHUT_RDWR);
+  }
+
+  std::thread up(&NetEmulator::pump, this, front, back, 2 * i);
+  pump(back, front, 2 * i + 1);
+  up.join();
+}
+
+void NetEmulator::pump(int from, int to, u64 seed) {
+  std::mutex mtx;
+  std::condition_variable cv;
+  std::deque<Chunk> queue;
+  u64 queued = 0;
+  bool eof = false;
+  bool broken = false;
+
+  std::thread writer([&]() {
+    std::unique_lock<std::mutex> lock(mtx);
+    while (true) {
+      cv.wait(lock, [&] { return eof || !queue.empty(); });
+      if (queue.empty()) {
+        break;
+      }
+      Chunk chunk = std::move(queue.front());
+      queue.pop_front();
+      lock.unlock();
+      std::this_thread::sleep_until(chunk.due);
+      bool ok = writeAll(to, chunk.data.data(), chunk.data.size());
+      lock.lock();
+      queued -= chunk.data.size();
+      cv.notify_all();
+      if (!ok) {
+        broken = true;
+        return;
+      }
+    }
+    ::shutdown(to, SHUT_WR);
+  });
+
+  std::mt19937_64 rng(seed);
+  std::uniform_real_distribution<double> jitter(0, mProfile.mJitterMs);
+  const auto oneWay = fromMs(mProfile.mRttMs / 2);
+  // time to put one byte on the link
+  const double nsPerByte =
+      mProfile.mBandwidthMbps > 0 ? 8e3 / mProfile.mBandwidthMbps : 0;
+
+  auto linkFree = Clock::now();
+  auto lastDue = linkFree;
+  std::vector<char> buf(kChunkBytes);
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mtx);
+      cv.wait(lock, [&] { return broken || queued < kMaxQueuedBytes; });
+      if (broken) {
+        break;
+      }
+    }
+    ssize_t n = ::recv(from, buf.data(), buf.size(), 0);
+    if (n <= 0) {
+      break;
+    }
+    mBytes += n;
+
+    auto start = std::max(Clock::now(), linkFree);
+    linkFree = start + std::chrono::duration_cast<Clock::duration>(
+                           std::chrono::nanoseconds(u64(n * nsPerByte)));
+    auto due = linkFree + oneWay;
+    if (mProfile.mJitterMs > 0) {
+      due += fromMs(jitter(rng));
+    }
+    // tcp delivers in order, jitter only ever delays
+    lastDue = std::max(lastDue, due);
+
+    std::lock_guard<std::mutex> lock(mtx);
+    queue.push_back({std::vector<char>(buf.begin(), buf.begin() + n), lastDue});
+    queued += n;
+    cv.notify_all();
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    eof = true;
+    cv.notify_all();
+  }
+  writer.join();
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <cryptoTools/Common/Defines.h>
+
+using oc::u16;
+using oc::u64;
+
+// a link between the parties, the same in both directions
+struct NetProfile {
+  // megabits per second, 0 for no limit
+  double mBandwidthMbps = 0;
+  // round trip time, half of it is added to every byte in each direction
+  double mRttMs = 0;
+  // extra one way delay, uniform in [0, mJitterMs]
+  double mJitterMs = 0;
+
+  // "lan", "wan" or "custom:<mbps>,<rtt ms>[,<jitter ms>]", false if spec is
+  // none of them
+  static bool parse(const std::string &spec, NetProfile &profile);
+
+  std::string toString() const;
+};
+
+// shapes tcp connections on one machine. the emulator listens on
+// frontPort(i) for the side that connects and forwards every accepted
+// connection to backPort + i on backIp, which the listening side serves.
+// each direction is a bucket refilled at the profile's bandwidth with room for
+// one chunk: a chunk leaves once the link has sent everything before it, and
+// is delivered half an rtt plus jitter later, in order
+class NetEmulator {
+public:
+  NetEmulator(const NetProfile &profile, const std::string &backIp,
+              u64 backPort, u64 numLinks);
+  ~NetEmulator();
+  NetEmulator(const NetEmulator &) = delete;
+  NetEmulator &operator=(const NetEmulator &) = delete;
+
+  u16 frontPort(u64 i) const { return mFrontPorts[i]; }
+  // bytes forwarded in both directions so far
+  u64 bytesForwarded() const { return mBytes; }
+
+private:
+  struct Link;
+
+  NetProfile mProfile;
+  std::string mBackIp;
+  u64 mBackPort;
+  std::vector<int> mListenFds;
+  std::vector<u16> mFrontPorts;
+  std::vector<std::unique_ptr<Link>> mLinks;
+  std::vector<std::thread> mThreads;
+  std::atomic<bool> mStop{false};
+  std::atomic<u64> mBytes{0};
+
+  void serve(u64 i);
+  void pump(int from, int to, u64 seed);
+};
@@ -0,0 +1,244 @@
+#include "shm_channel.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <pthread.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+
+const char kMagic[8] = {'U', 'F', 'P', 'S', 'I', 'S', 'H', 'M'};
+// the control block gets a page of its own, the rings start page aligned
+const u64 kHeaderBytes = u64(1) << 12;
+
+} // namespace
+
+// positions count every byte ever written and read, so head - tail is what
+// the ring holds and neither wraps in practice
+struct ShmChannel::Ring {
+  pthread_mutex_t mtx;
+  pthread_cond_t cv;
+  u64 head;
+  u64 tail;
+  u32 closed;
+};
+
+struct ShmChannel::Control {
+  char magic[8];
+  u64 capacity;
+  // set by the creator once the rings are initialised, then by the opener
+  // once it has mapped them
+  std::atomic<u32> ready;
+  std::atomic<u32> attached;
+  Ring rings[2];
+};
+
+namespace {
+
+void initMutex(pthread_mutex_t *mtx) {
+  pthread_mutexattr_t mattr;
+  pthread_mutexattr_init(&mattr);
+  pthread_mutexattr_setpshared(&mattr, PTHREAD_PROCESS_SHARED);
+  pthread_mutex_init(mtx, &mattr);
+  pthread_mutexattr_destroy(&mattr);
+}
+
+void initCond(pthread_cond_t *cv) {
+  pthread_condattr_t cattr;
+  pthread_condattr_init(&cattr);
+  pthread_condattr_setpshared(&cattr, PTHREAD_PROCESS_SHARED);
+  pthread_cond_init(cv, &cattr);
+  pthread_condattr_destroy(&cattr);
+}
+
+} // namespace
+
+std::shared_ptr<ShmChannel> ShmChannel::create(const std::string &name,
+                                               u64 capacity) {
+  static_assert(sizeof(Control) <= kHeaderBytes);
+  int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0 && errno == EEXIST) {
+    shm_unlink(name.c_str());
+    fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  }
+  if (fd < 0) {
+    throw std::runtime_error("shm channel: cannot create " + name);
+  }
+  const u64 length = kHeaderBytes + 2 * capacity;
+  if (ftruncate(fd, length) != 0) {
+    ::close(fd);
+    shm_unlink(name.c_str());
+    throw std::runtime_error("shm channel: cannot size " + name);
+  }
+  void *base =
+      mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (base == MAP_FAILED) {
+    shm_unlink(name.c_str());
+    throw std::runtime_error("shm channel: cannot map " + name);
+  }
+
+  std::shared_ptr<ShmChannel> channel(new ShmChannel());
+  channel->mName = name;
+  channel->mBase = base;
+  channel->mLength = length;
+  channel->mCapacity = capacity;
+  auto *control = new (base) Control();
+  memcpy(control->magic, kMagic, sizeof(kMagic));
+  control->capacity = capacity;
+  for (auto &ring : control->rings) {
+    initMutex(&ring.mtx);
+    initCond(&ring.cv);
+    ring.head = ring.tail = 0;
+    ring.closed = 0;
+  }
+  channel->mControl = control;
+  channel->mSendRing = &control->rings[0];
+  channel->mRecvRing = &control->rings[1];
+  channel->mSendData = static_cast<u8 *>(base) + kHeaderBytes;
+  channel->mRecvData = channel->mSendData + capacity;
+  control->ready.store(1, std::memory_order_release);
+  return channel;
+}
+
+std::shared_ptr<ShmChannel> ShmChannel::open(const std::string &name) {
+  // the creator may not be up yet
+  int fd = -1;
+  struct stat st;
+  while (true) {
+    fd = shm_open(name.c_str(), O_RDWR, 0600);
+    if (fd >= 0 && fstat(fd, &st) == 0 && u64(st.st_size) > kHeaderBytes) {
+      break;
+    }
+    if (fd >= 0) {
+      ::close(fd);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  void *base =
+      mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (base == MAP_FAILED) {
+    throw std::runtime_error("shm channel: cannot map " + name);
+  }
+  auto *control = static_cast<Control *>(base);
+  while (control->ready.load(std::memory_order_acquire) == 0) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  if (memcmp(control->magic, kMagic, sizeof(kMagic)) != 0 ||
+      kHeaderBytes + 2 * control->capacity != u64(st.st_size)) {
+    munmap(base, st.st_size);
+    throw std::runtime_error("shm channel: " + name + " is not a channel");
+  }
+
+  std::shared_ptr<ShmChannel> channel(new ShmChannel());
+  channel->mBase = base;
+  channel->mLength = st.st_size;
+  channel->mCapacity = control->capacity;
+  channel->mControl = control;
+  channel->mSendRing = &control->rings[1];
+  channel->mRecvRing = &control->rings[0];
+  channel->mRecvData = static_cast<u8 *>(base) + kHeaderBytes;
+  channel->mSendData = channel->mRecvData + control->capacity;
+  control->attached.store(1, std::memory_order_release);
+  // both sides hold the mapping, nothing needs the name any more
+  shm_unlink(name.c_str());
+  return channel;
+}
+
+bool ShmChannel::isCreator() const {
+  return mSendRing == &mControl->rings[0];
+}
+
+ShmChannel::~ShmChannel() {
+  if (!mBase) {
+    return;
+  }
+  close();
+  // the opener never came, do not leave the object behind
+  if (!mName.empty() && mControl->attached.load() == 0) {
+    shm_unlink(mName.c_str());
+  }
+  munmap(mBase, mLength);
+}
+
+bool ShmChannel::send(const u8 *data, u64 size) {
+  Ring &ring = *mSendRing;
+  while (size) {
+    pthread_mutex_lock(&ring.mtx);
+    while (ring.head - ring.tail == mCapacity && !ring.closed) {
+      pthread_cond_wait(&ring.cv, &ring.mtx);
+    }
+    if (ring.closed) {
+      pthread_mutex_unlock(&ring.mtx);
+      return false;
+    }
+    const u64 head = ring.head;
+    const u64 space = mCapacity - (head - ring.tail);
+    pthread_mutex_unlock(&ring.mtx);
+
+    const u64 n = std::min(size, space);
+    const u64 pos = head % mCapacity;
+    const u64 first = std::min(n, mCapacity - pos);
+    memcpy(mSendData + pos, data, first);
+    memcpy(mSendData, data + first, n - first);
+
+    pthread_mutex_lock(&ring.mtx);
+    ring.head = head + n;
+    pthread_cond_broadcast(&ring.cv);
+    pthread_mutex_unlock(&ring.mtx);
+    data += n;
+    size -= n;
+    mBytesSent += n;
+  }
+  return true;
+}
+
+bool ShmChannel::recv(u8 *data, u64 size) {
+  Ring &ring = *mRecvRing;
+  while (size) {
+    pthread_mutex_lock(&ring.mtx);
+    while (ring.head == ring.tail && !ring.closed) {
+      pthread_cond_wait(&ring.cv, &ring.mtx);
+    }
+    // what was sent before the close is still delivered
+    if (ring.head == ring.tail) {
+      pthread_mutex_unlock(&ring.mtx);
+      return false;
+    }
+    const u64 tail = ring.tail;
+    const u64 avail = ring.head - tail;
+    pthread_mutex_unlock(&ring.mtx);
+
+    const u64 n = std::min(size, avail);
+    const u64 pos = tail % mCapacity;
+    const u64 first = std::min(n, mCapacity - pos);
+    memcpy(data, mRecvData + pos, first);
+    memcpy(data + first, mRecvData, n - first);
+
+    pthread_mutex_lock(&ring.mtx);
+    ring.tail = tail + n;
+    pthread_cond_broadcast(&ring.cv);
+    pthread_mutex_unlock(&ring.mtx);
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+
+void ShmChannel::close() {
+  for (auto &ring : mControl->rings) {
+    pthread_mutex_lock(&ring.mtx);
+    ring.closed = 1;
+    pthread_cond_broadcast(&ring.cv);
+    pthread_mutex_unlock(&ring.mtx);
+  }
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <string>
+
+#include <cryptoTools/Common/Defines.h>
+
+using oc::u32;
+using oc::u64;
+using oc::u8;
+
+// a duplex byte pipe between two parties on one host: a posix shared memory
+// object holding one ring buffer per direction. the creator sends on the
+// first ring and the side that opens it on the second. each ring has a single
+// writer and a single reader, the lock only guards the positions and the copy
+// itself runs unlocked
+class ShmChannel {
+public:
+  ShmChannel(const ShmChannel &) = delete;
+  ShmChannel &operator=(const ShmChannel &) = delete;
+  ~ShmChannel();
+
+  // creates the object name, replacing a stale one from a run that died
+  static std::shared_ptr<ShmChannel> create(const std::string &name,
+                                            u64 capacity);
+  // maps the object name, waiting for its creator like a connect retries.
+  // the name is unlinked once both sides have it mapped
+  static std::shared_ptr<ShmChannel> open(const std::string &name);
+
+  // block until all of data is in the ring or taken from it, false once the
+  // peer has closed the channel
+  bool send(const u8 *data, u64 size);
+  bool recv(u8 *data, u64 size);
+
+  // wakes a peer blocked in send or recv, which then fails
+  void close();
+
+  u64 bytesSent() const { return mBytesSent; }
+  // whether this side made the channel with create
+  bool isCreator() const;
+
+private:
+  struct Ring;
+  struct Control;
+
+  ShmChannel() = default;
+
+  std::string mName;
+  void *mBase = nullptr;
+  u64 mLength = 0;
+  Control *mControl = nullptr;
+  Ring *mSendRing = nullptr;
+  Ring *mRecvRing = nullptr;
+  u8 *mSendData = nullptr;
+  u8 *mRecvData = nullptr;
+  u64 mCapacity = 0;
+  std::atomic<u64> mBytesSent{0};
+};
@@ -0,0 +1,136 @@
+#include "shm_socket.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace {
+
+// resumes the coroutines whose shm operations are done, in the order they
+// finished, on a thread of its own
+class ShmExecutor {
+public:
+  ShmExecutor() : mThread([this] { run(); }) {}
+
+  ~ShmExecutor() {
+    {
+      std::lock_guard<std::mutex> lock(mMtx);
+      mStop = true;
+    }
+    mCv.notify_one();
+    mThread.join();
+  }
+
+  void post(std::function<void()> fn) {
+    {
+      std::lock_guard<std::mutex> lock(mMtx);
+      mQueue.push_back(std::move(fn));
+    }
+    mCv.notify_one();
+  }
+
+private:
+  std::mutex mMtx;
+  std::condition_variable mCv;
+  std::deque<std::function<void()>> mQueue;
+  bool mStop = false;
+  std::thread mThread;
+
+  void run() {
+    std::unique_lock<std::mutex> lock(mMtx);
+    while (true) {
+      mCv.wait(lock, [&] { return mStop || !mQueue.empty(); });
+      if (mQueue.empty()) {
+        return;
+      }
+      auto fn = std::move(mQueue.front());
+      mQueue.pop_front();
+      lock.unlock();
+      fn();
+      lock.lock();
+    }
+  }
+};
+
+// one for each side of the channels, so the two parties of a run in one
+// process are resumed on threads of their own
+ShmExecutor &shmExecutor(bool creator) {
+  static ShmExecutor creators, openers;
+  return creator ? creators : openers;
+}
+
+} // namespace
+
+// the operations of one direction, done one at a time in the order they were
+// awaited
+struct ShmSocket::Worker {
+  std::mutex mtx;
+  std::condition_variable cv;
+  std::deque<Op *> ops;
+  bool stop = false;
+  std::thread thrd;
+};
+
+struct ShmSocket::State {
+  std::shared_ptr<ShmChannel> channel;
+  Worker sender;
+  Worker receiver;
+
+  explicit State(std::shared_ptr<ShmChannel> ch) : channel(std::move(ch)) {
+    sender.thrd = std::thread([this] { run(sender); });
+    receiver.thrd = std::thread([this] { run(receiver); });
+  }
+
+  // an operation still blocked in the channel fails once it is closed, the
+  // ones queued behind it fail at once
+  ~State() {
+    for (Worker *worker : {&sender, &receiver}) {
+      std::lock_guard<std::mutex> lock(worker->mtx);
+      worker->stop = true;
+    }
+    channel->close();
+    for (Worker *worker : {&sender, &receiver}) {
+      worker->cv.notify_one();
+      worker->thrd.join();
+    }
+  }
+
+  void run(Worker &worker) {
+    std::unique_lock<std::mutex> lock(worker.mtx);
+    while (true) {
+      worker.cv.wait(lock, [&] { return worker.stop || !worker.ops.empty(); });
+      if (worker.ops.empty()) {
+        return;
+      }
+      Op *op = worker.ops.front();
+      worker.ops.pop_front();
+      lock.unlock();
+
+      bool ok = op->sending ? channel->send(op->data.data(), op->data.size())
+                            : channel->recv(op->data.data(), op->data.size());
+      if (ok) {
+        op->result = {coproto::error_code{}, op->data.size()};
+      } else {
+        op->result = {coproto::code::remoteClosed, 0};
+      }
+      // op belongs to the awaiter from here on
+      shmExecutor(channel->isCreator()).post(std::move(op->resume));
+      lock.lock();
+    }
+  }
+};
+
+ShmSocket::ShmSocket(std::shared_ptr<ShmChannel> channel)
+    : mState(std::make_shared<State>(std::move(channel))) {}
+
+void ShmSocket::close() { mState->channel->close(); }
+
+void ShmSocket::submit(Op *op) {
+  Worker &worker = op->sending ? op->state->sender : op->state->receiver;
+  {
+    std::lock_guard<std::mutex> lock(worker.mtx);
+    worker.ops.push_back(op);
+  }
+  worker.cv.notify_one();
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <functional>
+#include <memory>
+#include <utility>
+
+#include <coproto/Socket/Socket.h>
+#include <macoro/stop.h>
+
+#include "shm_channel.h"
+
+// coproto socket over a ShmChannel. the blocking copies into and out of the
+// rings run on two threads of the socket, one per direction, so awaiting an
+// operation never blocks the awaiting thread: a send waiting for room in a
+// full ring leaves that thread free to drive the peer's recv. the awaiting
+// coroutine is resumed on the thread of a shm executor, the way the asio
+// sockets resume on an io thread. the sockets over channels this process
+// created share one and those over channels it opened another
+class ShmSocket {
+public:
+  explicit ShmSocket(std::shared_ptr<ShmChannel> channel);
+
+  struct State;
+
+  struct Op {
+    State *state;
+    coproto::span<u8> data;
+    bool sending;
+    std::function<void()> resume;
+    std::pair<coproto::error_code, u64> result;
+
+    bool await_ready() const noexcept { return false; }
+    template <typename Handle> void await_suspend(Handle handle) {
+      resume = [handle]() mutable { handle.resume(); };
+      // the op may complete and resume the awaiter before submit returns
+      submit(this);
+    }
+    std::pair<coproto::error_code, u64> await_resume() { return result; }
+  };
+
+  Op send(coproto::span<u8> data, macoro::stop_token token = {}) {
+    return {mState.get(), data, true};
+  }
+
+  Op recv(coproto::span<u8> data, macoro::stop_token token = {}) {
+    return {mState.get(), data, false};
+  }
+
+  // fails the pending and later operations of both sides
+  void close();
+
+private:
+  struct Worker;
+
+  // hands op to the thread of its direction
+  static void submit(Op *op);
+
+  std::shared_ptr<State> mState;
+};
+
+inline coproto::Socket makeShmSocket(std::shared_ptr<ShmChannel> channel) {
+  return coproto::makeSocket(ShmSocket(std::move(channel)));
+}
@@ -0,0 +1,144 @@
+#include "engine.h"
+
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+
+#include <ipcl/mod_exp.hpp>
+
+namespace {
+
+const u64 kLanes = 8;
+const u64 kMaxChunk = 256;
+// chunks per worker, enough to even out uneven ones
+const u64 kChunksPerThread = 4;
+
+// runs fn(lo, hi) for the chunks of [0, count), numThreads workers taking the
+// next chunk as they finish one
+template <typename Fn>
+void runChunks(u64 count, u64 chunk, u64 numThreads, Fn fn) {
+  const u64 numChunks = (count + chunk - 1) / chunk;
+  numThreads = std::max<u64>(1, std::min(numThreads, numChunks));
+  std::atomic<u64> next{0};
+  auto worker = [&]() {
+    for (u64 c = next++; c < numChunks; c = next++) {
+      fn(c * chunk, std::min(count, (c + 1) * chunk));
+    }
+  };
+  std::vector<std::thread> thrds;
+  thrds.reserve(numThreads - 1);
+  for (u64 t = 1; t < numThreads; ++t) {
+    thrds.emplace_back(worker);
+  }
+  worker();
+  for (auto &thrd : thrds) {
+    thrd.join();
+  }
+}
+
+} // namespace
+
+u64 PaillierEngine::chunkSize(u64 count) const {
+  const u64 perChunk =
+      (count + mNumThreads * kChunksPerThread - 1) /
+      std::max<u64>(1, mNumThreads * kChunksPerThread);
+  const u64 lanes = (perChunk + kLanes - 1) / kLanes * kLanes;
+  return std::clamp(lanes, kLanes, kMaxChunk);
+}
+
+ipcl::CipherText PaillierEngine::add(
+    const std::vector<std::vector<BigNumber>> &addends) const {
+  std::vector<BigNumber> sums(addends[0]);
+  runChunks(sums.size(), chunkSize(sums.size()), mNumThreads,
+            [&](u64 lo, u64 hi) {
+              for (u64 a = 1; a < addends.size(); ++a) {
+                for (u64 i = lo; i < hi; ++i) {
+                  sums[i] = sums[i] * addends[a][i] % mNSquare;
+                }
+              }
+            });
+  return ipcl::CipherText(mPk, sums);
+}
+
+ipcl::PlainText
+PaillierEngine::decrypt(const ipcl::PrivateKey &sk,
+                        const std::vector<BigNumber> &ciphers) const {
+  std::vector<BigNumber> plains(ciphers.size());
+  runChunks(ciphers.size(), chunkSize(ciphers.size()), mNumThreads,
+            [&](u64 lo, u64 hi) {
+              std::vector<BigNumber> chunk(ciphers.begin() + lo,
+                                           ciphers.begin() + hi);
+              // the padding repeats the last ciphertext and is dropped
+              while (chunk.size() % kLanes != 0) {
+                chunk.push_back(chunk.back());
+              }
+              auto dec = sk.decrypt(ipcl::CipherText(mPk, chunk));
+              for (u64 i = lo; i < hi; ++i) {
+                plains[i] = dec.getElement(i - lo);
+              }
+            });
+  return ipcl::PlainText(plains);
+}
+
+u64 PaillierEngine::slotsPerCipher(u64 slotBits) {
+  // the packed plaintext has to stay below N
+  return (PAILLIER_KEY_SIZE_IN_BIT - 1) / slotBits;
+}
+
+ipcl::CipherText PaillierEngine::pack(const std::vector<BigNumber> &ciphers,
+                                      u64 slotBits) const {
+  if (slotBits == 0 || slotBits > 64) {
+    throw std::runtime_error("paillier engine: slots of 1 to 64 bits");
+  }
+  const u64 slots = slotsPerCipher(slotBits);
+  const u64 count = ciphers.size();
+  std::vector<BigNumber> packed((count + slots - 1) / slots);
+
+  std::vector<u32> shiftWords(slotBits / 32 + 1, 0);
+  shiftWords[slotBits / 32] = u32(1) << (slotBits % 32);
+  const BigNumber shift(shiftWords.data(), shiftWords.size());
+
+  runChunks(packed.size(), chunkSize(packed.size()), mNumThreads,
+            [&](u64 lo, u64 hi) {
+              // the lanes past hi repeat the last one and are dropped
+              const u64 lanes = (hi - lo + kLanes - 1) / kLanes * kLanes;
+              std::vector<BigNumber> acc(lanes, BigNumber::One());
+              const std::vector<BigNumber> exps(lanes, shift);
+              const std::vector<BigNumber> mods(lanes, mNSquare);
+              for (u64 k = slots; k-- > 0;) {
+                if (k + 1 < slots) {
+                  acc = ipcl::modExp(acc, exps, mods);
+                }
+                for (u64 g = lo; g < lo + lanes; ++g) {
+                  const u64 i = std::min(g, hi - 1) * slots + k;
+                  if (i < count) {
+                    acc[g - lo] = acc[g - lo] * ciphers[i] % mNSquare;
+                  }
+                }
+              }
+              std::copy(acc.begin(), acc.begin() + (hi - lo),
+                        packed.begin() + lo);
+            });
+  return ipcl::CipherText(mPk, packed);
+}
+
+std::vector<u64> PaillierEngine::unpack(const ipcl::PlainText &packed,
+                                        u64 count, u64 slotBits) {
+  const u64 slots = slotsPerCipher(slotBits);
+  const u64 mask = slotBits == 64 ? ~u64(0) : (u64(1) << slotBits) - 1;
+  std::vector<u64> values(count);
+  for (u64 g = 0; g < packed.getSize(); ++g) {
+    auto words = packed.getElementVec(g);
+    words.resize(PAILLIER_KEY_SIZE_IN_BIT / 32 + 2, 0);
+    for (u64 k = 0; k < slots && g * slots + k < count; ++k) {
+      const u64 bit = k * slotBits;
+      const u64 w = bit / 32;
+      // a slot spans at most three words
+      unsigned __int128 window = words[w] | u64(words[w + 1]) << 32;
+      window |= (unsigned __int128)words[w + 2] << 64;
+      values[g * slots + k] = u64(window >> (bit % 32)) & mask;
+    }
+  }
+  return values;
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <vector>
+
+#include <cryptoTools/Common/Defines.h>
+#include <ipcl/bignum.h>
+#include <ipcl/ciphertext.hpp>
+#include <ipcl/plaintext.hpp>
+#include <ipcl/pri_key.hpp>
+#include <ipcl/pub_key.hpp>
+
+#include "config.h"
+
+// paillier over many ciphertexts at once. the work is cut into chunks that
+// start at multiples of 8, the lanes of ipcl's multi-buffer exponentiation,
+// and numThreads workers take the chunks one after the other, so a slow
+// chunk does not hold up a whole static slice
+class PaillierEngine {
+public:
+  PaillierEngine(const ipcl::PublicKey &pk, u64 numThreads)
+      : mPk(pk), mNSquare(*pk.getNSQ()), mNumThreads(numThreads) {}
+
+  // element-wise sum of the addends. each chunk of the sum is accumulated in
+  // place, one addend after the other, without a ciphertext per addend
+  ipcl::CipherText
+  add(const std::vector<std::vector<BigNumber>> &addends) const;
+
+  // plaintexts of ciphers. the last chunk is padded to 8 ciphertexts, so
+  // every exponentiation fills all lanes
+  ipcl::PlainText decrypt(const ipcl::PrivateKey &sk,
+                          const std::vector<BigNumber> &ciphers) const;
+
+  // slot packing, for ciphertexts whose plaintexts are known to stay below
+  // 2^slotBits, guard bits for the additions included. a decoding of a key
+  // that was not encoded has a plaintext of the full width of N and wipes
+  // out every slot it is packed with, so zero tests on okvs decodings
+  // cannot pack
+  static u64 slotsPerCipher(u64 slotBits);
+  // ciphertexts of sum_k m_{g * slots + k} * 2^(k * slotBits), a slot per
+  // ciphertext shifted in homomorphically, highest slot first
+  ipcl::CipherText pack(const std::vector<BigNumber> &ciphers,
+                        u64 slotBits) const;
+  // the count plaintexts packed into packed, slotBits of at most 64
+  static std::vector<u64> unpack(const ipcl::PlainText &packed, u64 count,
+                                 u64 slotBits);
+
+private:
+  ipcl::PublicKey mPk;
+  BigNumber mNSquare;
+  u64 mNumThreads;
+
+  // chunk length for count values, a multiple of 8 giving each worker a few
+  // chunks to balance over
+  u64 chunkSize(u64 count) const;
+};
@@ -0,0 +1,217 @@
+#include "key_pool.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <spdlog/spdlog.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char kMagic[8] = {'U', 'F', 'P', 'S', 'I', 'K', 'E', 'Y'};
+const u64 kVersion = 1;
+const u64 kPrimeWords = PAILLIER_KEY_SIZE_IN_BIT / 64;
+
+struct KeyFileHeader {
+  char magic[8];
+  u64 version;
+  u64 keyBits;
+  u64 pWords;
+  u64 qWords;
+};
+
+// seconds after which a .taken or .tmp file of a pool is a leftover
+const time_t kStaleSeconds = 600;
+
+bool writeAll(int fd, const void *data, u64 size) {
+  auto bytes = static_cast<const char *>(data);
+  while (size > 0) {
+    ssize_t n = write(fd, bytes, size);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    bytes += n;
+    size -= n;
+  }
+  return true;
+}
+
+// keys of a pool are key-<tag>.bin, the files being written end in .tmp
+bool isPoolKey(const fs::path &path) {
+  const std::string name = path.filename().string();
+  return name.rfind("key-", 0) == 0 && path.extension() == ".bin";
+}
+
+// named after the low bits of N, which differ from key to key
+std::string poolKeyPath(const std::string &dir, const ipcl::KeyPair &key) {
+  std::vector<u32> words;
+  key.pub_key.getN()->num2vec(words);
+  words.resize(2, 0);
+  char tag[17];
+  snprintf(tag, sizeof(tag), "%08x%08x", words[1], words[0]);
+  return (fs::path(dir) / ("key-" + std::string(tag) + ".bin")).string();
+}
+
+} // namespace
+
+std::optional<ipcl::KeyPair> loadPaillierKey(const std::string &path) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    return std::nullopt;
+  }
+  KeyFileHeader header;
+  if (!in.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+      memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+      header.version != kVersion ||
+      header.keyBits != PAILLIER_KEY_SIZE_IN_BIT ||
+      header.pWords == 0 || header.pWords > kPrimeWords ||
+      header.qWords == 0 || header.qWords > kPrimeWords) {
+    return std::nullopt;
+  }
+  std::vector<u32> pWords(header.pWords), qWords(header.qWords);
+  if (!in.read(reinterpret_cast<char *>(pWords.data()),
+               pWords.size() * sizeof(u32)) ||
+      !in.read(reinterpret_cast<char *>(qWords.data()),
+               qWords.size() * sizeof(u32))) {
+    return std::nullopt;
+  }
+
+  BigNumber p(pWords.data(), pWords.size());
+  BigNumber q(qWords.data(), qWords.size());
+  BigNumber n = p * q;
+  if (n.BitSize() != PAILLIER_KEY_SIZE_IN_BIT) {
+    return std::nullopt;
+  }
+  ipcl::PublicKey pk(n, PAILLIER_KEY_SIZE_IN_BIT, true);
+  ipcl::PrivateKey sk(pk, p, q);
+  return ipcl::KeyPair{pk, sk};
+}
+
+void savePaillierKey(const std::string &path, const ipcl::KeyPair &key) {
+  std::vector<u32> pWords, qWords;
+  key.priv_key.getP()->num2vec(pWords);
+  key.priv_key.getQ()->num2vec(qWords);
+  KeyFileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.keyBits = PAILLIER_KEY_SIZE_IN_BIT;
+  header.pWords = pWords.size();
+  header.qWords = qWords.size();
+
+  // the primes are the secret key, so the file is created readable by the
+  // owner only. a .tmp left by a crash is replaced
+  std::string tmpPath = path + ".tmp";
+  std::remove(tmpPath.c_str());
+  int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_EXCL, 0600);
+  if (fd < 0) {
+    throw std::runtime_error("paillier key: cannot create " + tmpPath);
+  }
+  bool written = writeAll(fd, &header, sizeof(header)) &&
+                 writeAll(fd, pWords.data(), pWords.size() * sizeof(u32)) &&
+                 writeAll(fd, qWords.data(), qWords.size() * sizeof(u32)) &&
+                 fsync(fd) == 0;
+  written = close(fd) == 0 && written;
+  if (!written) {
+    std::remove(tmpPath.c_str());
+    throw std::runtime_error("paillier key: cannot write " + tmpPath);
+  }
+  if (std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+    std::remove(tmpPath.c_str());
+    throw std::runtime_error("paillier key: cannot rename to " + path);
+  }
+}
+
+PaillierKeyPool::PaillierKeyPool(const std::string &dir, u64 capacity)
+    : mDir(dir), mCapacity(capacity) {
+  std::error_code ec;
+  if (fs::create_directories(mDir, ec)) {
+    fs::permissions(mDir, fs::perms::owner_all, ec);
+  }
+  if (!fs::is_directory(mDir)) {
+    throw std::runtime_error("paillier key pool: cannot create " + mDir);
+  }
+
+  // a run holds a .taken or .tmp file for milliseconds, older ones are what
+  // a crash left behind, a claimed key among them
+  const time_t now = time(nullptr);
+  for (const auto &entry : fs::directory_iterator(mDir, ec)) {
+    const std::string ext = entry.path().extension().string();
+    struct stat st;
+    if ((ext == ".taken" || ext == ".tmp") &&
+        stat(entry.path().c_str(), &st) == 0 &&
+        now - st.st_ctime > kStaleSeconds) {
+      std::remove(entry.path().c_str());
+    }
+  }
+}
+
+u64 PaillierKeyPool::size() const {
+  u64 count = 0;
+  std::error_code ec;
+  for (const auto &entry : fs::directory_iterator(mDir, ec)) {
+    count += isPoolKey(entry.path());
+  }
+  return count;
+}
+
+ipcl::KeyPair PaillierKeyPool::take() {
+  std::error_code ec;
+  for (const auto &entry : fs::directory_iterator(mDir, ec)) {
+    if (!isPoolKey(entry.path())) {
+      continue;
+    }
+    // whoever renames the file first owns the key, a concurrent run taking
+    // the same one fails to rename and moves on
+    const std::string path = entry.path().string();
+    const std::string claimed = path + ".taken";
+    if (std::rename(path.c_str(), claimed.c_str()) != 0) {
+      continue;
+    }
+    auto key = loadPaillierKey(claimed);
+    std::remove(claimed.c_str());
+    if (key) {
+      return *key;
+    }
+    spdlog::warn("paillier key pool: dropped unreadable key {}", path);
+  }
+
+  spdlog::info("paillier key pool {} is empty, generating a key", mDir);
+  return ipcl::generateKeypair(PAILLIER_KEY_SIZE_IN_BIT, true);
+}
+
+void PaillierKeyPool::fill() {
+  // one fill per pool, the lock goes with the process
+  const std::string lockPath = (fs::path(mDir) / ".fill.lock").string();
+  int lock = open(lockPath.c_str(), O_WRONLY | O_CREAT, 0600);
+  if (lock < 0 || flock(lock, LOCK_EX | LOCK_NB) != 0) {
+    if (lock >= 0) {
+      close(lock);
+    }
+    return;
+  }
+  try {
+    while (size() < mCapacity) {
+      auto key = ipcl::generateKeypair(PAILLIER_KEY_SIZE_IN_BIT, true);
+      savePaillierKey(poolKeyPath(mDir, key), key);
+    }
+  } catch (const std::runtime_error &e) {
+    spdlog::warn("{}", e.what());
+  }
+  close(lock);
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <optional>
+#include <string>
+
+#include <cryptoTools/Common/Defines.h>
+#include <ipcl/ipcl.hpp>
+
+#include "config.h"
+
+// a paillier key pair on disk is its primes p and q. the rest of both keys
+// follows from them in milliseconds, the seconds of key generation all go
+// into finding the primes
+
+// the key pair saved at path, nullopt if there is none or the file is not a
+// key of PAILLIER_KEY_SIZE_IN_BIT bits
+std::optional<ipcl::KeyPair> loadPaillierKey(const std::string &path);
+// saves key, readable by the owner only, replacing path atomically
+void savePaillierKey(const std::string &path, const ipcl::KeyPair &key);
+
+// key pairs generated ahead of time, a file each in a directory. a key taken
+// from the pool is removed from it, so no two runs share one. fill() tops the
+// pool up, meant to run in a process of its own so no run waits for the
+// prime search
+class PaillierKeyPool {
+public:
+  // opens dir, creating it if needed, and removes the claimed keys and half
+  // written files that crashed runs left behind
+  PaillierKeyPool(const std::string &dir, u64 capacity);
+
+  // keys ready in the pool
+  u64 size() const;
+
+  // a key of the pool, or a freshly generated one if the pool is empty
+  ipcl::KeyPair take();
+
+  // generates keys until the pool holds capacity of them. returns at once if
+  // another fill of the pool is running
+  void fill();
+
+private:
+  std::string mDir;
+  u64 mCapacity;
+};
@@ -0,0 +1,181 @@
+#include "rand_pool.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include <blake3.h>
+#include <cryptoTools/Crypto/PRNG.h>
+#include <ipcl/mod_exp.hpp>
+
+#include "utils/util.h"
+
+namespace {
+
+const char kMagic[8] = {'U', 'F', 'P', 'S', 'I', 'R', 'N', 'P'};
+const u64 kVersion = 1;
+// values per modexp call, a multiple of the 8 lanes of ipcl's multi-buffer
+// exponentiation
+const u64 kBatch = 256;
+// r is drawn 128 bits longer than N and reduced, so it is close to uniform
+const u64 kRandWords = PAILLIER_KEY_SIZE_IN_BIT / 32 + 4;
+const u64 kValueWords = PAILLIER_CIPHER_SIZE_IN_BLOCK * 4;
+
+struct PoolFileHeader {
+  char magic[8];
+  u64 version;
+  u64 valueBlocks;
+  block keyTag;
+  u64 count;
+};
+
+PoolFileHeader makeHeader(const block &keyTag, u64 count) {
+  PoolFileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.valueBlocks = PAILLIER_CIPHER_SIZE_IN_BLOCK;
+  header.keyTag = keyTag;
+  header.count = count;
+  return header;
+}
+
+// the little endian words of bn, zero padded to a ciphertext
+void toBlocks(const BigNumber &bn, block *out) {
+  std::vector<u32> words;
+  bn.num2vec(words);
+  memset(out, 0, PAILLIER_CIPHER_SIZE_IN_BYTE);
+  memcpy(out, words.data(),
+         std::min<u64>(words.size(), kValueWords) * sizeof(u32));
+}
+
+BigNumber fromBlocks(const block *in) {
+  return BigNumber(reinterpret_cast<const Ipp32u *>(in), kValueWords);
+}
+
+} // namespace
+
+PaillierRandPool::PaillierRandPool(const ipcl::PublicKey &pk)
+    : mN(*pk.getN()), mNSquare(*pk.getNSQ()) {
+  std::vector<u32> words;
+  mN.num2vec(words);
+  blake3_hasher hasher;
+  blake3_hasher_init(&hasher);
+  blake3_hasher_update(&hasher, words.data(), words.size() * sizeof(u32));
+  blake3_hasher_finalize(&hasher, mKeyTag.data(), sizeof(block));
+}
+
+void PaillierRandPool::compact() {
+  mValues.erase(mValues.begin(),
+                mValues.begin() + mNext * PAILLIER_CIPHER_SIZE_IN_BLOCK);
+  mNext = 0;
+}
+
+void PaillierRandPool::fill(u64 count, u64 numThreads) {
+  compact();
+  const u64 old = mValues.size();
+  mValues.resize(old + count * PAILLIER_CIPHER_SIZE_IN_BLOCK);
+  block *dst = mValues.data() + old;
+
+  const u64 numBatches = (count + kBatch - 1) / kBatch;
+  parallel_for(numBatches, numThreads, [&](u64 start, u64 end) {
+    PRNG prng(oc::sysRandomSeed());
+    std::vector<u32> words(kRandWords);
+    for (u64 b = start; b < end; ++b) {
+      const u64 lo = b * kBatch;
+      const u64 n = std::min(kBatch, count - lo);
+      std::vector<BigNumber> base(n);
+      for (auto &r : base) {
+        prng.get(words.data(), words.size());
+        r = BigNumber(words.data(), words.size()) % mN;
+      }
+      auto values = ipcl::modExp(base, std::vector<BigNumber>(n, mN),
+                                 std::vector<BigNumber>(n, mNSquare));
+      for (u64 i = 0; i < n; ++i) {
+        toBlocks(values[i], dst + (lo + i) * PAILLIER_CIPHER_SIZE_IN_BLOCK);
+      }
+    }
+  });
+}
+
+bool PaillierRandPool::load(const std::string &path) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    return false;
+  }
+  PoolFileHeader header;
+  if (!in.read(reinterpret_cast<char *>(&header), sizeof(header))) {
+    return false;
+  }
+  PoolFileHeader expected = makeHeader(mKeyTag, header.count);
+  if (memcmp(&header, &expected, sizeof(header)) != 0) {
+    return false;
+  }
+
+  compact();
+  const u64 old = mValues.size();
+  mValues.resize(old + header.count * PAILLIER_CIPHER_SIZE_IN_BLOCK);
+  if (!in.read(reinterpret_cast<char *>(mValues.data() + old),
+               header.count * PAILLIER_CIPHER_SIZE_IN_BYTE)) {
+    mValues.resize(old);
+    return false;
+  }
+  in.close();
+  // a value must never encrypt twice, even if this run dies before saving
+  std::remove(path.c_str());
+  return true;
+}
+
+void PaillierRandPool::save(const std::string &path) const {
+  PoolFileHeader header = makeHeader(mKeyTag, size());
+  std::string tmpPath = path + ".tmp";
+  {
+    std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(
+                  mValues.data() + mNext * PAILLIER_CIPHER_SIZE_IN_BLOCK),
+              size() * PAILLIER_CIPHER_SIZE_IN_BYTE);
+    if (!out) {
+      std::remove(tmpPath.c_str());
+      throw std::runtime_error("paillier rand pool: cannot write " + tmpPath);
+    }
+  }
+  if (std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+    std::remove(tmpPath.c_str());
+    throw std::runtime_error("paillier rand pool: cannot rename to " + path);
+  }
+}
+
+void PaillierRandPool::encrypt(std::span<const u64> plains,
+                               std::span<block> out, u64 numThreads) {
+  if (out.size() != plains.size() * PAILLIER_CIPHER_SIZE_IN_BLOCK) {
+    throw std::runtime_error("paillier rand pool: size mismatch");
+  }
+  if (size() < plains.size()) {
+    throw std::runtime_error("paillier rand pool: " +
+                             std::to_string(plains.size()) +
+                             " encryptions, " + std::to_string(size()) +
+                             " values left");
+  }
+
+  const block *values =
+      mValues.data() + mNext * PAILLIER_CIPHER_SIZE_IN_BLOCK;
+  parallel_for(plains.size(), numThreads, [&](u64 start, u64 end) {
+    for (u64 i = start; i < end; ++i) {
+      const block *rn = values + i * PAILLIER_CIPHER_SIZE_IN_BLOCK;
+      block *cipher = out.data() + i * PAILLIER_CIPHER_SIZE_IN_BLOCK;
+      // (1 + 0 * N) * r^N is r^N itself
+      if (plains[i] == 0) {
+        memcpy(cipher, rn, PAILLIER_CIPHER_SIZE_IN_BYTE);
+        continue;
+      }
+      u64 m = plains[i];
+      BigNumber gm =
+          BigNumber(reinterpret_cast<Ipp32u *>(&m), 2) * mN + BigNumber::One();
+      toBlocks(gm * fromBlocks(rn) % mNSquare, cipher);
+    }
+  });
+  mNext += plains.size();
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <span>
+#include <string>
+#include <vector>
+
+#include <cryptoTools/Common/Defines.h>
+#include <cryptoTools/Common/block.h>
+#include <ipcl/bignum.h>
+#include <ipcl/pub_key.hpp>
+
+#include "config.h"
+
+// r^N mod N^2 for random r, the modular exponentiation of a paillier
+// encryption, computed ahead of time for one public key. with a value from
+// the pool the encryption of m is (1 + m * N) * r^N mod N^2, a single
+// modular multiplication. values are stored like ciphertexts, flat runs of
+// PAILLIER_CIPHER_SIZE_IN_BLOCK blocks, and each is handed out only once
+class PaillierRandPool {
+public:
+  explicit PaillierRandPool(const ipcl::PublicKey &pk);
+
+  // values not handed out yet
+  u64 size() const {
+    return mValues.size() / PAILLIER_CIPHER_SIZE_IN_BLOCK - mNext;
+  }
+
+  // computes count more values, each thread exponentiating a batch at a time
+  void fill(u64 count, u64 numThreads);
+
+  // takes over the values saved at path, which is removed so no value is
+  // used twice. false if there is no file or it was saved for another key
+  bool load(const std::string &path);
+  // saves the values not handed out yet, replacing path atomically
+  void save(const std::string &path) const;
+
+  // encryptions of plains into out, PAILLIER_CIPHER_SIZE_IN_BLOCK blocks
+  // each, using up a value per plaintext. throws if the pool has too few
+  void encrypt(std::span<const u64> plains, std::span<block> out,
+               u64 numThreads);
+
+private:
+  BigNumber mN;
+  BigNumber mNSquare;
+  // identifies the key in a saved pool
+  block mKeyTag;
+  std::vector<block> mValues;
+  u64 mNext = 0;
+
+  // drops the values handed out so far
+  void compact();
+};
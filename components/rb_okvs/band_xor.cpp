@@ -0,0 +1,133 @@
+#include "band_xor.h"
+
+#include <array>
+#include <immintrin.h>
+
+namespace {
+
+// masks selecting two codewords of a 256-bit load, bit 1 for the first one
+alignas(32) const long long kPairMask[4][4] = {
+    {0, 0, 0, 0},
+    {0, 0, -1, -1},
+    {-1, -1, 0, 0},
+    {-1, -1, -1, -1},
+};
+
+// masks selecting four codewords of a 512-bit load, bit 3 for the first one
+constexpr std::array<u8, 16> kQuadMask = []() {
+  std::array<u8, 16> mask{};
+  for (u64 nibble = 0; nibble < 16; ++nibble) {
+    for (u64 k = 0; k < 4; ++k) {
+      if ((nibble >> (3 - k)) & 1) {
+        mask[nibble] |= 3 << (2 * k);
+      }
+    }
+  }
+  return mask;
+}();
+
+// Words == 0 means the number of words is only known at runtime
+template <u64 Words> inline u64 bandWords(u64 width) {
+  return Words ? Words : divCeil(width, 64);
+}
+
+template <u64 Words>
+block bandXorScalar(const block *codeWords, const u64 *band, u64 width) {
+  block res = ZeroBlock;
+  for (u64 w = 0; w < bandWords<Words>(width); ++w) {
+    // visit the set bits only
+    for (u64 tmp = band[w]; tmp; tmp &= tmp - 1) {
+      res ^= codeWords[w * 64 + 63 - __builtin_ctzll(tmp)];
+    }
+  }
+  return res;
+}
+
+template <u64 Words>
+__attribute__((target("avx2"))) block
+bandXorAvx2(const block *codeWords, const u64 *band, u64 width) {
+  __m256i acc0 = _mm256_setzero_si256(), acc1 = _mm256_setzero_si256();
+  for (u64 w = 0; w < bandWords<Words>(width); ++w) {
+    const u64 tmp = band[w];
+    auto ptr = reinterpret_cast<const long long *>(codeWords + w * 64);
+    for (u64 k = 0; k < 64; k += 4) {
+      const u64 nibble = (tmp >> (60 - k)) & 0xF;
+      // masked-out codewords are not touched, so reading past the end of the
+      // codewords behind zero bits is safe
+      auto mask0 = _mm256_load_si256(
+          reinterpret_cast<const __m256i *>(kPairMask[nibble >> 2]));
+      auto mask1 = _mm256_load_si256(
+          reinterpret_cast<const __m256i *>(kPairMask[nibble & 3]));
+      acc0 = _mm256_xor_si256(acc0, _mm256_maskload_epi64(ptr + 2 * k, mask0));
+      acc1 =
+          _mm256_xor_si256(acc1, _mm256_maskload_epi64(ptr + 2 * k + 4, mask1));
+    }
+  }
+  acc0 = _mm256_xor_si256(acc0, acc1);
+  return block(_mm_xor_si128(_mm256_castsi256_si128(acc0),
+                             _mm256_extracti128_si256(acc0, 1)));
+}
+
+template <u64 Words>
+__attribute__((target("avx512f"))) block
+bandXorAvx512(const block *codeWords, const u64 *band, u64 width) {
+  __m512i acc0 = _mm512_setzero_si512(), acc1 = _mm512_setzero_si512();
+  for (u64 w = 0; w < bandWords<Words>(width); ++w) {
+    const u64 tmp = band[w];
+    auto ptr = reinterpret_cast<const long long *>(codeWords + w * 64);
+    for (u64 k = 0; k < 64; k += 8) {
+      const u64 byte = (tmp >> (56 - k)) & 0xFF;
+      acc0 = _mm512_xor_si512(
+          acc0, _mm512_maskz_loadu_epi64(kQuadMask[byte >> 4], ptr + 2 * k));
+      acc1 = _mm512_xor_si512(
+          acc1,
+          _mm512_maskz_loadu_epi64(kQuadMask[byte & 0xF], ptr + 2 * k + 8));
+    }
+  }
+  acc0 = _mm512_xor_si512(acc0, acc1);
+  __m256i acc = _mm256_xor_si256(_mm512_castsi512_si256(acc0),
+                                 _mm512_extracti64x4_epi64(acc0, 1));
+  return block(_mm_xor_si128(_mm256_castsi256_si128(acc),
+                             _mm256_extracti128_si256(acc, 1)));
+}
+
+template <template <u64> class Kernel> BandXorFunc specialize(u64 width) {
+  // getParams gives bands of 3-4 words for epsilon = 0.1, 4-5 for 0.07 and
+  // 5-7 for 0.05; anything else takes the generic loop
+  switch (divCeil(width, 64)) {
+  case 3:
+    return Kernel<3>::func;
+  case 4:
+    return Kernel<4>::func;
+  case 5:
+    return Kernel<5>::func;
+  case 6:
+    return Kernel<6>::func;
+  case 7:
+    return Kernel<7>::func;
+  default:
+    return Kernel<0>::func;
+  }
+}
+
+template <u64 Words> struct Scalar {
+  static constexpr BandXorFunc func = bandXorScalar<Words>;
+};
+template <u64 Words> struct Avx2 {
+  static constexpr BandXorFunc func = bandXorAvx2<Words>;
+};
+template <u64 Words> struct Avx512 {
+  static constexpr BandXorFunc func = bandXorAvx512<Words>;
+};
+
+} // namespace
+
+BandXorFunc selectBandXor(u64 width) {
+  if (__builtin_cpu_supports("avx512f")) {
+    return specialize<Avx512>(width);
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    return specialize<Avx2>(width);
+  }
+  return specialize<Scalar>(width);
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <vector>
+
+#include <cryptoTools/Common/Defines.h>
+#include <cryptoTools/Common/block.h>
+
+using namespace oc;
+
+// XOR of the codewords selected by a band. bit k of the band is
+// (band[k / 64] >> (63 - k % 64)) & 1 and selects codeWords[k]; every bit at
+// or beyond `width` must be zero, codewords behind those bits are never read.
+using BandXorFunc = block (*)(const block *codeWords, const u64 *band,
+                              u64 width);
+
+// the fastest kernel supported by this cpu, specialized for the band width
+BandXorFunc selectBandXor(u64 width);
+
+// the same for values of several blocks: res ^= codeWords[k] for every set
+// bit k, where codeWords[k] is the value at codeWords + k * valueBlocks.
+// ValueBlocks fixes the width at compile time, 0 takes valueBlocks instead
+template <u64 ValueBlocks>
+inline void bandXorValues(block *res, const block *codeWords, const u64 *band,
+                          u64 width, u64 valueBlocks = ValueBlocks) {
+  const u64 vBlocks = ValueBlocks ? ValueBlocks : valueBlocks;
+  for (u64 w = 0; w < divCeil(width, 64); ++w) {
+    for (u64 tmp = band[w]; tmp; tmp &= tmp - 1) {
+      const block *src =
+          codeWords + (w * 64 + 63 - __builtin_ctzll(tmp)) * vBlocks;
+      for (u64 k = 0; k < vBlocks; ++k) {
+        res[k] ^= src[k];
+      }
+    }
+  }
+}
+
+// the same for codewords held in a vector each, codeWords[k] being the value
+// of bit k
+inline void bandXorValues(block *res, const std::vector<block> *codeWords,
+                          const u64 *band, u64 width, u64 valueBlocks) {
+  for (u64 w = 0; w < divCeil(width, 64); ++w) {
+    for (u64 tmp = band[w]; tmp; tmp &= tmp - 1) {
+      const block *src = codeWords[w * 64 + 63 - __builtin_ctzll(tmp)].data();
+      for (u64 k = 0; k < valueBlocks; ++k) {
+        res[k] ^= src[k];
+      }
+    }
+  }
+}
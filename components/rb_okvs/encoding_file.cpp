@@ -0,0 +1,226 @@
+#include "encoding_file.h"
+
+#include <atomic>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const char kMagic[8] = {'R', 'B', 'O', 'K', 'V', 'S', 'E', 'N'};
+const u64 kVersion = 1;
+const u64 kHeaderBytes = u64(1) << 12;
+
+EncodingFileHeader makeHeader(const RBOKVSParam &param, u64 valueBlocks,
+                              const block &tag) {
+  EncodingFileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.numRows = param.mNumRows;
+  header.numCols = param.numCols();
+  header.bandWidth = param.mBandWidth;
+  header.stasSecParam = param.mStasSecParam;
+  header.scaler = param.mScaler;
+  header.r1 = param.mR1;
+  header.r2 = param.mR2;
+  header.seed = param.mSeed;
+  header.rowHash = static_cast<u64>(param.mRowHash);
+  header.valueBlocks = valueBlocks;
+  header.tag = tag;
+  header.dataOffset = kHeaderBytes;
+  header.dataBlocks = header.numCols * valueBlocks;
+  return header;
+}
+
+void writeAll(int fd, const void *buf, u64 size) {
+  const u8 *ptr = static_cast<const u8 *>(buf);
+  while (size) {
+    ssize_t n = ::write(fd, ptr, size);
+    if (n <= 0) {
+      throw std::runtime_error("encoding file: write failed");
+    }
+    ptr += n;
+    size -= n;
+  }
+}
+
+} // namespace
+
+void saveEncoding(const std::string &path, const RBOKVSParam &param,
+                  u64 valueBlocks, const block &tag,
+                  std::span<const block> encoding) {
+  EncodingFileHeader header = makeHeader(param, valueBlocks, tag);
+  if (encoding.size() != header.dataBlocks) {
+    throw std::runtime_error("encoding file: size mismatch");
+  }
+
+  // write next to the target and rename, a reader never sees half a file
+  std::string tmpPath = path + ".tmp";
+  int fd = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    throw std::runtime_error("encoding file: cannot create " + tmpPath);
+  }
+  try {
+    u8 page[kHeaderBytes] = {};
+    memcpy(page, &header, sizeof(header));
+    writeAll(fd, page, kHeaderBytes);
+    writeAll(fd, encoding.data(), encoding.size_bytes());
+  } catch (...) {
+    ::close(fd);
+    ::unlink(tmpPath.c_str());
+    throw;
+  }
+  ::close(fd);
+
+  if (::rename(tmpPath.c_str(), path.c_str()) != 0) {
+    ::unlink(tmpPath.c_str());
+    throw std::runtime_error("encoding file: cannot rename to " + path);
+  }
+}
+
+bool MappedEncoding::open(const std::string &path, const RBOKVSParam &param,
+                          u64 valueBlocks, const block &tag) {
+  close();
+
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || u64(st.st_size) < kHeaderBytes) {
+    ::close(fd);
+    return false;
+  }
+  void *base = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                    fd, 0);
+  ::close(fd);
+  if (base == MAP_FAILED) {
+    return false;
+  }
+
+  EncodingFileHeader expected = makeHeader(param, valueBlocks, tag);
+  EncodingFileHeader header;
+  memcpy(&header, base, sizeof(header));
+  if (memcmp(&header, &expected, sizeof(header)) != 0 ||
+      header.dataOffset + header.dataBlocks * sizeof(block) !=
+          u64(st.st_size)) {
+    munmap(base, st.st_size);
+    return false;
+  }
+
+  // the encoding is read front to back when it is sent
+  madvise(base, st.st_size, MADV_SEQUENTIAL);
+  mBase = base;
+  mLength = st.st_size;
+  mData = std::span<block>(
+      reinterpret_cast<block *>(static_cast<u8 *>(base) + header.dataOffset),
+      header.dataBlocks);
+  return true;
+}
+
+void MappedEncoding::close() {
+  if (mBase) {
+    munmap(mBase, mLength);
+  }
+  mBase = nullptr;
+  mLength = 0;
+  mData = {};
+}
+
+void EncodingBuffer::allocate(u64 numBlocks, bool shared) {
+  release();
+  if (numBlocks == 0) {
+    return;
+  }
+  if (!shared) {
+    map(-1, numBlocks);
+    return;
+  }
+
+  static std::atomic<u64> counter{0};
+  std::string name = "/ufpsi-enc-" + std::to_string(getpid()) + "-" +
+                     std::to_string(counter++);
+  int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0) {
+    throw std::runtime_error("encoding buffer: cannot create " + name);
+  }
+  if (ftruncate(fd, numBlocks * sizeof(block)) != 0) {
+    ::close(fd);
+    shm_unlink(name.c_str());
+    throw std::runtime_error("encoding buffer: cannot size " + name);
+  }
+  try {
+    map(fd, numBlocks);
+  } catch (...) {
+    ::close(fd);
+    shm_unlink(name.c_str());
+    throw;
+  }
+  ::close(fd);
+  mName = name;
+}
+
+std::string EncodingBuffer::handOff() {
+  std::string name = std::move(mName);
+  mName.clear();
+  release();
+  return name;
+}
+
+void EncodingBuffer::adopt(const std::string &name, u64 numBlocks) {
+  release();
+  int fd = shm_open(name.c_str(), O_RDWR, 0600);
+  if (fd < 0) {
+    throw std::runtime_error("encoding buffer: cannot open " + name);
+  }
+  // the name is ours now, the object goes away with the last mapping
+  shm_unlink(name.c_str());
+  struct stat st;
+  if (fstat(fd, &st) != 0 || u64(st.st_size) != numBlocks * sizeof(block)) {
+    ::close(fd);
+    throw std::runtime_error("encoding buffer: " + name +
+                             " has the wrong size");
+  }
+  try {
+    map(fd, numBlocks);
+  } catch (...) {
+    ::close(fd);
+    throw;
+  }
+  ::close(fd);
+}
+
+void EncodingBuffer::map(int fd, u64 numBlocks) {
+  const u64 length = numBlocks * sizeof(block);
+  void *base =
+      fd < 0 ? mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0)
+             : mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (base == MAP_FAILED) {
+    throw std::runtime_error("encoding buffer: cannot map " +
+                             std::to_string(length) + " bytes");
+  }
+  // fewer tlb misses when decoding reads across the whole encoding
+  madvise(base, length, MADV_HUGEPAGE);
+  mBase = base;
+  mLength = length;
+  mData = std::span<block>(static_cast<block *>(base), numBlocks);
+}
+
+void EncodingBuffer::release() {
+  if (mBase) {
+    munmap(mBase, mLength);
+  }
+  // never handed off, nobody else will remove it
+  if (!mName.empty()) {
+    shm_unlink(mName.c_str());
+  }
+  mBase = nullptr;
+  mLength = 0;
+  mData = {};
+  mName.clear();
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include <span>
+#include <string>
+
+#include "rb_okvs.h"
+
+// an RBOKVS encoding on disk: one page holding EncodingFileHeader, then the
+// mSize * valueBlocks blocks of the encoding starting on a page boundary, so
+// the file can be mapped and sent straight from the mapping
+struct EncodingFileHeader {
+  char magic[8];
+  u64 version;
+  // the okvs the encoding belongs to
+  u64 numRows;
+  u64 numCols;
+  u64 bandWidth;
+  u64 stasSecParam;
+  double scaler;
+  block r1, r2, seed;
+  u64 rowHash;
+  // blocks per value, 1 for block encodings
+  u64 valueBlocks;
+  // identifies the encoded data set, chosen by the caller
+  block tag;
+  // byte offset and number of blocks of the encoding
+  u64 dataOffset;
+  u64 dataBlocks;
+};
+
+// write an encoding of an okvs with param, replacing path atomically
+void saveEncoding(const std::string &path, const RBOKVSParam &param,
+                  u64 valueBlocks, const block &tag,
+                  std::span<const block> encoding);
+
+// private mapping of a saved encoding. pages are read on demand and are
+// shared with the page cache until written
+class MappedEncoding {
+public:
+  MappedEncoding() = default;
+  ~MappedEncoding() { close(); }
+  MappedEncoding(const MappedEncoding &) = delete;
+  MappedEncoding &operator=(const MappedEncoding &) = delete;
+
+  // false if the file is missing, damaged, or was saved for another okvs,
+  // value width or tag
+  bool open(const std::string &path, const RBOKVSParam &param,
+            u64 valueBlocks, const block &tag);
+  void close();
+
+  bool isOpen() const { return mBase != nullptr; }
+  std::span<block> data() const { return mData; }
+
+private:
+  void *mBase = nullptr;
+  u64 mLength = 0;
+  std::span<block> mData;
+};
+
+// anonymous mapping an encoding is received into. it is not zeroed up front,
+// pages are only backed once data is written to them, and release hands the
+// memory back as soon as the values have been decoded. a shared buffer lives
+// in a posix shared memory object instead, which a party on the same host can
+// take over with adopt rather than receiving a copy
+class EncodingBuffer {
+public:
+  EncodingBuffer() = default;
+  explicit EncodingBuffer(u64 numBlocks, bool shared = false) {
+    allocate(numBlocks, shared);
+  }
+  ~EncodingBuffer() { release(); }
+  EncodingBuffer(const EncodingBuffer &) = delete;
+  EncodingBuffer &operator=(const EncodingBuffer &) = delete;
+
+  void allocate(u64 numBlocks, bool shared);
+  void release();
+
+  // the shared object of the buffer, empty if it is private or was handed off
+  const std::string &sharedName() const { return mName; }
+  // unmaps the buffer here and leaves its shared object for the peer to adopt
+  std::string handOff();
+  // replaces the buffer with the shared object a peer handed off, which must
+  // hold numBlocks blocks, and removes its name
+  void adopt(const std::string &name, u64 numBlocks);
+
+  std::span<block> data() const { return mData; }
+
+private:
+  void *mBase = nullptr;
+  u64 mLength = 0;
+  std::span<block> mData;
+  std::string mName;
+
+  void map(int fd, u64 numBlocks);
+};
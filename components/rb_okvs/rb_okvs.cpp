@@ -1,10 +1,11 @@
+#include <algorithm>
 #include <format>
 #include <memory>
-#include <thread>
 #include <vector>
 
 #include "blake3.h"
 #include "rb_okvs.h"
+#include "utils/util.h"
 
 #include <ipcl/bignum.h>
 
@@ -190,6 +191,9 @@ void RBOKVS::init(const RBOKVSParam &param) {
   mRPos = param.mR1;
   mRBand = param.mR2;
   mPrng.SetSeed(param.mSeed);
+  mRowHash = param.mRowHash;
+  mRowAes.setKey(mRPos);
+  mBandXor = selectBandXor(mW);
   mTimer.reset();
 }
 
@@ -198,6 +202,31 @@ void RBOKVS::setSeed(const block &seed) {
   mRPos = prng.get<block>();
   mRBand = prng.get<block>();
   mPrng.SetSeed(prng.get<block>());
+  mRowAes.setKey(mRPos);
+}
+
+// big endian bytes to the band layout, byte 0 is the top byte of the first
+// u64 word
+static inline void bytesToBand(const u8 *bytes, u64 numBlocks, block *band) {
+  for (u64 i = 0; i < numBlocks; ++i) {
+    u64 lo, hi;
+    memcpy(&lo, bytes + i * 16, 8);
+    memcpy(&hi, bytes + i * 16 + 8, 8);
+    band[i] = block(__builtin_bswap64(hi), __builtin_bswap64(lo));
+  }
+}
+
+// clear the bits at and beyond width
+static inline void maskBand(block *band, u64 width) {
+  u64 *ptr = reinterpret_cast<u64 *>(band);
+  u64 words = divCeil(width, 128) * 2;
+  u64 w = width / 64;
+  if (width % 64) {
+    ptr[w++] &= ~0ull << (64 - width % 64);
+  }
+  for (; w < words; ++w) {
+    ptr[w] = 0;
+  }
 }
 
 u64 RBOKVS::hashPos(const block &input) {
@@ -205,7 +234,6 @@ u64 RBOKVS::hashPos(const block &input) {
     return 0;
   }
   u8 hashOut[8];
-  u64 out = 0;
 
   blake3_hasher hasher;
   blake3_hasher_init(&hasher);
@@ -213,11 +241,9 @@ u64 RBOKVS::hashPos(const block &input) {
   blake3_hasher_update(&hasher, &input, sizeof(input));
   blake3_hasher_finalize(&hasher, hashOut, 8);
 
-  // todo: memory copy
-  for (u64 i = 0; i < 8; ++i) {
-    out ^= (static_cast<u64>(hashOut[i]) << (56 - i * 8));
-  }
-  return out % (mSize - mW);
+  u64 out;
+  memcpy(&out, hashOut, 8);
+  return __builtin_bswap64(out) % (mSize - mW);
 }
 
 void RBOKVS::hashBand(const block &input, block *output) {
@@ -237,62 +263,117 @@ void RBOKVS::hashBand(const block &input, block *output) {
     hashOut[wBytes - 1] &= ~(0xFF >> (mW % 8));
   }
 
-  // hashOut[wBytes - 1] &= ~(0xFF >> (8 - mW % 8));
-
   // padding zero to the end of the last block
   memset(hashOut + wBytes, 0, wBlockBytes - wBytes);
 
-  for (u64 i = 0; i < wBlockBytes / 16; ++i) {
-    output[i].data()[7] = hashOut[i * 16];
-    output[i].data()[6] = hashOut[i * 16 + 1];
-    output[i].data()[5] = hashOut[i * 16 + 2];
-    output[i].data()[4] = hashOut[i * 16 + 3];
-    output[i].data()[3] = hashOut[i * 16 + 4];
-    output[i].data()[2] = hashOut[i * 16 + 5];
-    output[i].data()[1] = hashOut[i * 16 + 6];
-    output[i].data()[0] = hashOut[i * 16 + 7];
-
-    output[i].data()[15] = hashOut[i * 16 + 8];
-    output[i].data()[14] = hashOut[i * 16 + 9];
-    output[i].data()[13] = hashOut[i * 16 + 10];
-    output[i].data()[12] = hashOut[i * 16 + 11];
-    output[i].data()[11] = hashOut[i * 16 + 12];
-    output[i].data()[10] = hashOut[i * 16 + 13];
-    output[i].data()[9] = hashOut[i * 16 + 14];
-    output[i].data()[8] = hashOut[i * 16 + 15];
+  bytesToBand(hashOut, wBlockBytes / 16, output);
+}
+
+void RBOKVS::hashRows(const block *keys, u64 count, u64 *positions,
+                      block *bands) {
+  switch (mRowHash) {
+  case OkvsRowHash::Blake3: {
+    const u64 wBlocks = divCeil(mW, 128);
+    for (u64 i = 0; i < count; ++i) {
+      positions[i] = hashPos(keys[i]);
+      hashBand(keys[i], bands + i * wBlocks);
+    }
+    break;
+  }
+  case OkvsRowHash::Blake3OnePass:
+    hashRowsBlake3OnePass(keys, count, positions, bands);
+    break;
+  case OkvsRowHash::AesCtr:
+    hashRowsAes(keys, count, positions, bands);
+    break;
+  }
+}
+
+// one keyed BLAKE3 call per key, the first 8 output bytes are the position
+// and the rest the band
+void RBOKVS::hashRowsBlake3OnePass(const block *keys, u64 count,
+                                   u64 *positions, block *bands) {
+  const u64 wBlocks = divCeil(mW, 128);
+  const u64 wBytes = divCeil(mW, 8);
+  u8 hashKey[BLAKE3_KEY_LEN];
+  memcpy(hashKey, &mRPos, sizeof(mRPos));
+  memcpy(hashKey + sizeof(mRPos), &mRBand, sizeof(mRBand));
+  u8 hashOut[8 + wBlocks * 16];
+  memset(hashOut, 0, sizeof(hashOut));
+
+  for (u64 i = 0; i < count; ++i) {
+    blake3_hasher hasher;
+    blake3_hasher_init_keyed(&hasher, hashKey);
+    blake3_hasher_update(&hasher, &keys[i], sizeof(block));
+    blake3_hasher_finalize(&hasher, hashOut, 8 + wBytes);
+
+    u64 pos;
+    memcpy(&pos, hashOut, 8);
+    positions[i] = (mSize == mW) ? 0 : __builtin_bswap64(pos) % (mSize - mW);
+    bytesToBand(hashOut + 8, wBlocks, bands + i * wBlocks);
+    maskBand(bands + i * wBlocks, mW);
   }
 }
 
-EncodeStatus RBOKVS::reformalize(MatrixRow &row) {
+// fixed-key AES, 8 keys at a time. every key is first compressed to
+// t = AES(x) ^ x, then AES(t ^ j) ^ t for j = 0..wBlocks gives the position
+// (j = 0) and the band blocks
+void RBOKVS::hashRowsAes(const block *keys, u64 count, u64 *positions,
+                         block *bands) {
+  constexpr u64 batch = 8;
+  const u64 wBlocks = divCeil(mW, 128);
+  const u64 perKey = wBlocks + 1;
+  block tweaks[batch];
+  block in[batch * perKey];
+  block out[batch * perKey];
+
+  for (u64 i = 0; i < count; i += batch) {
+    const u64 n = std::min<u64>(batch, count - i);
+    mRowAes.ecbEncBlocks(keys + i, n, tweaks);
+    for (u64 k = 0; k < n; ++k) {
+      tweaks[k] ^= keys[i + k];
+      for (u64 j = 0; j < perKey; ++j) {
+        in[k * perKey + j] = tweaks[k] ^ toBlock(j);
+      }
+    }
+    mRowAes.ecbEncBlocks(in, n * perKey, out);
+
+    for (u64 k = 0; k < n; ++k) {
+      const block *res = out + k * perKey;
+      block *band = bands + (i + k) * wBlocks;
+      u64 pos = (res[0] ^ tweaks[k]).get<u64>(0);
+      positions[i + k] = (mSize == mW) ? 0 : pos % (mSize - mW);
+      for (u64 j = 0; j < wBlocks; ++j) {
+        band[j] = res[j + 1] ^ tweaks[k];
+      }
+      maskBand(band, mW);
+    }
+  }
+}
+
+EncodeStatus RBOKVS::reformalizeBand(block *data, u64 &startPos) {
   u64 wBlocks = divCeil(mW, 128);
   u64 numZeroBlocks = wBlocks;
   // find the first non-zero block
   for (u64 i = 0; i < wBlocks; ++i) {
-    if (row.data[i] != ZeroBlock) {
+    if (data[i] != ZeroBlock) {
       numZeroBlocks = i;
       break;
     }
   }
 
   if (numZeroBlocks == wBlocks) {
-    // all zero row
-    if (row.val == ZeroBlock) {
-      // use a special value to indicate a meaningless row
-      row.startPos = -1;
-      return EncodeStatus::ALLZERO;
-    } else {
-      return EncodeStatus::FAIL;
-    }
+    return EncodeStatus::ALLZERO;
   }
 
   // shift the first non-zero block to the firset block and pad zeros
-  u64 leftShift = static_cast<u64>(row.data[numZeroBlocks].mData[0] == 0) +
+  u64 leftShift = static_cast<u64>(data[numZeroBlocks].mData[0] == 0) +
                   2 * numZeroBlocks;
-  u64 *ptr = reinterpret_cast<u64 *>(row.data.get());
+  u64 *ptr = reinterpret_cast<u64 *>(data);
   if (leftShift != 0) {
     memmove(ptr, ptr + leftShift, sizeof(u64) * (2 * wBlocks - leftShift));
     memset(ptr + 2 * wBlocks - leftShift, 0, sizeof(u64) * leftShift);
-    row.startPos += leftShift * 64;
+    startPos += leftShift * 64;
   }
 
   // shift the first 1 to the first bit
@@ -306,71 +387,52 @@ EncodeStatus RBOKVS::reformalize(MatrixRow &row) {
     }
     ptr[2 * wBlocks - leftShift - 1] <<= numLeadingZeros;
 
-    row.startPos += numLeadingZeros;
+    startPos += numLeadingZeros;
   }
 
   return EncodeStatus::SUCCESS;
 }
 
-EncodeStatus RBOKVS::reformalize(MatrixRow_LongValue &row,
-                                 const u64 VALUE_LENGTH_IN_BLOCK) {
-  u64 wBlocks = divCeil(mW, 128);
-  u64 numZeroBlocks = wBlocks;
-  // find the first non-zero block
-  for (u64 i = 0; i < wBlocks; ++i) {
-    if (row.data[i] != ZeroBlock) {
-      numZeroBlocks = i;
-      break;
-    }
+EncodeStatus RBOKVS::reformalize(MatrixRow &row) {
+  if (reformalizeBand(row.data, row.startPos) == EncodeStatus::SUCCESS) {
+    return EncodeStatus::SUCCESS;
   }
 
-  if (numZeroBlocks == wBlocks) {
-    // all zero row
-    bool flag = 0;
-    for (u64 i = 0; i < VALUE_LENGTH_IN_BLOCK; i++) {
-      if (row.val[i] != ZeroBlock) {
-        flag = 1;
-      }
-    }
-
-    if (flag == 0) {
-      // use a special value to indicate a meaningless row
-      row.startPos = -1;
-      return EncodeStatus::ALLZERO;
-    } else {
-      printf("EncodeStatus::FAIL");
-      printf("\n");
-      printf("flag == 0");
-      printf("\n");
-      return EncodeStatus::FAIL;
-    }
+  // all zero row
+  if (row.val == ZeroBlock) {
+    // use a special value to indicate a meaningless row
+    row.startPos = -1;
+    return EncodeStatus::ALLZERO;
+  } else {
+    return EncodeStatus::FAIL;
   }
+}
 
-  // shift the first non-zero block to the firset block and pad zeros
-  u64 leftShift = static_cast<u64>(row.data[numZeroBlocks].mData[0] == 0) +
-                  2 * numZeroBlocks;
-  u64 *ptr = reinterpret_cast<u64 *>(row.data.get());
-  if (leftShift != 0) {
-    memmove(ptr, ptr + leftShift, sizeof(u64) * (2 * wBlocks - leftShift));
-    memset(ptr + 2 * wBlocks - leftShift, 0, sizeof(u64) * leftShift);
-    row.startPos += leftShift * 64;
+EncodeStatus RBOKVS::reformalize(MatrixRow_LongValue &row,
+                                 const u64 VALUE_LENGTH_IN_BLOCK) {
+  if (reformalizeBand(row.data, row.startPos) == EncodeStatus::SUCCESS) {
+    return EncodeStatus::SUCCESS;
   }
 
-  // shift the first 1 to the first bit
-  int numLeadingZeros = __builtin_clzll(ptr[0]);
-  // no extra space
-  // todo: maybe handle all block at one time but use more space
-  if (numLeadingZeros != 0) {
-    for (u64 i = 0; i < 2 * wBlocks - leftShift - 1; i++) {
-      ptr[i] =
-          (ptr[i] << numLeadingZeros) | (ptr[i + 1] >> (64 - numLeadingZeros));
+  // all zero row
+  bool flag = 0;
+  for (u64 i = 0; i < VALUE_LENGTH_IN_BLOCK; i++) {
+    if (row.val[i] != ZeroBlock) {
+      flag = 1;
     }
-    ptr[2 * wBlocks - leftShift - 1] <<= numLeadingZeros;
-
-    row.startPos += numLeadingZeros;
   }
 
-  return EncodeStatus::SUCCESS;
+  if (flag == 0) {
+    // use a special value to indicate a meaningless row
+    row.startPos = -1;
+    return EncodeStatus::ALLZERO;
+  } else {
+    printf("EncodeStatus::FAIL");
+    printf("\n");
+    printf("flag == 0");
+    printf("\n");
+    return EncodeStatus::FAIL;
+  }
 }
 
 EncodeStatus RBOKVS::insert(u64 *bitToRowMap, MatrixRow *rows, u64 rowIdx) {
@@ -451,6 +513,23 @@ EncodeStatus RBOKVS::insert(u64 *bitToRowMap, MatrixRow_LongValue *rows,
   return EncodeStatus::SUCCESS;
 }
 
+void RBOKVS::backSubstitute(const u64 *bitToRowMap, MatrixRow *rows,
+                            block *output) {
+  // solve the linear system
+  u64 *ptr;
+  for (i64 i = mSize - 1; i >= 0; --i) {
+    if (bitToRowMap[i] != mN) {
+      ptr = reinterpret_cast<u64 *>(rows[bitToRowMap[i]].data);
+      // the pivot itself is not part of the sum. the band never reaches past
+      // the last column, so the kernel stays inside output
+      ptr[0] &= 0x7FFFFFFFFFFFFFFF;
+      output[i] = rows[bitToRowMap[i]].val ^ mBandXor(output + i, ptr, mW);
+    } else {
+      output[i] = mPrng.get<block>();
+    }
+  }
+}
+
 EncodeStatus RBOKVS::encode(const block *keys, const block *vals,
                             block *output) {
   mTimer.setTimePoint("encode start");
@@ -458,9 +537,15 @@ EncodeStatus RBOKVS::encode(const block *keys, const block *vals,
   // printf("1\n");
   // printf("encode start\n");
 
-  std::unique_ptr<u64[]> bitToRowMap(new u64[mSize]);
-  std::unique_ptr<MatrixRow[]> rows(new MatrixRow[mN]);
+  RowArena localArena;
+  RowArena &arena = mArena ? *mArena : localArena;
+  RowArena::Scope scope(arena);
+
+  u64 *bitToRowMap = arena.allocate<u64>(mSize);
+  MatrixRow *rows = arena.allocate<MatrixRow>(mN);
   u64 wBlocks = divCeil(mW, 128);
+  block *bands = arena.allocate<block>(mN * wBlocks);
+  u64 *positions = arena.allocate<u64>(mN);
 
   // initialize
   for (u64 i = 0; i < mSize; ++i) {
@@ -473,11 +558,10 @@ EncodeStatus RBOKVS::encode(const block *keys, const block *vals,
   // printf("set 0\n");
 
   // initialize rows
-  // todo: maybe parallelize this
+  hashRows(keys, mN, positions, bands);
   for (u64 i = 0; i < mN; ++i) {
-    rows[i].startPos = hashPos(keys[i]);
-    rows[i].data.reset(new block[wBlocks]);
-    hashBand(keys[i], rows[i].data.get());
+    rows[i].startPos = positions[i];
+    rows[i].data = bands + i * wBlocks;
     rows[i].val = vals[i];
 
     // printf("%dth row: ", i);
@@ -495,7 +579,7 @@ EncodeStatus RBOKVS::encode(const block *keys, const block *vals,
 
   EncodeStatus status;
   for (u64 i = 0; i < mN; ++i) {
-    status = insert(bitToRowMap.get(), rows.get(), i);
+    status = insert(bitToRowMap, rows, i);
     if (status == EncodeStatus::FAIL) {
       return status;
     }
@@ -515,167 +599,121 @@ EncodeStatus RBOKVS::encode(const block *keys, const block *vals,
 
   // printf("4\n");
 
-  // solve the linear system
-  u64 *ptr, tmp, j;
-  for (i64 i = mSize - 1; i >= 0; --i) {
-    if (bitToRowMap[i] != mN) {
-      ptr = reinterpret_cast<u64 *>(rows[bitToRowMap[i]].data.get());
-      output[i] = rows[bitToRowMap[i]].val;
-      // first way to solve the linear system
-      // for (u64 j = i + 1; j < i + mW && j < mSize; ++j){
-      //     if ((ptr[(j - i) / 64] >> (63 - (j - i) % 64)) & 1){
-      //         output[i] ^= output[j];
-      //     }
-      // }
-      ptr[0] &= 0x7FFFFFFFFFFFFFFF;
-      j = i;
-      // expand the loop, handling 64 bits at one time
-      // except the last u64(maybe less than 64 bits)
-      for (; j < i + mW - 64 && j < mSize - 64; j += 64) {
-        tmp = ptr[(j - i) / 64];
-        output[i] ^= (tmp & 1) ? output[j + 63] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 62] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 61] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 60] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 59] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 58] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 57] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 56] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 55] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 54] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 53] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 52] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 51] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 50] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 49] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 48] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 47] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 46] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 45] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 44] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 43] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 42] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 41] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 40] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 39] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 38] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 37] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 36] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 35] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 34] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 33] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 32] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 31] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 30] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 29] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 28] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 27] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 26] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 25] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 24] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 23] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 22] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 21] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 20] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 19] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 18] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 17] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 16] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 15] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 14] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 13] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 12] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 11] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 10] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 9] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 8] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 7] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 6] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 5] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 4] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 3] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 2] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j + 1] : ZeroBlock;
-        tmp >>= 1;
-        output[i] ^= (tmp & 1) ? output[j] : ZeroBlock;
-      }
-      for (; j < i + mW && j < mSize; ++j) {
-        if ((ptr[(j - i) / 64] >> (63 - (j - i) % 64)) & 1) {
-          output[i] ^= output[j];
+  backSubstitute(bitToRowMap, rows, output);
+
+  mTimer.setTimePoint("back substitution");
+
+  return EncodeStatus::SUCCESS;
+}
+
+EncodeStatus RBOKVS::encode(const block *keys, const block *vals,
+                            block *output, u64 numThreads) {
+  // every column range must be much wider than the band, otherwise most rows
+  // straddle a boundary and nothing is left to eliminate concurrently
+  numThreads = std::min<u64>(numThreads, mSize / (4 * mW));
+  if (numThreads <= 1) {
+    return encode(keys, vals, output);
+  }
+
+  mTimer.setTimePoint("encode start");
+
+  RowArena localArena;
+  RowArena &arena = mArena ? *mArena : localArena;
+  RowArena::Scope scope(arena);
+
+  u64 *bitToRowMap = arena.allocate<u64>(mSize);
+  MatrixRow *rows = arena.allocate<MatrixRow>(mN);
+  u64 wBlocks = divCeil(mW, 128);
+  block *bands = arena.allocate<block>(mN * wBlocks);
+  u64 *positions = arena.allocate<u64>(mN);
+
+  // initialize
+  for (u64 i = 0; i < mSize; ++i) {
+    bitToRowMap[i] = mN;
+  }
+  memset(output, 0, sizeof(block) * mSize);
+
+  mTimer.setTimePoint("alloc and init");
+
+  // the columns are split into numThreads ranges [rangeBegin(k),
+  // rangeBegin(k + 1)). a row whose band lies inside one range only ever meets
+  // pivots of that range, so the ranges can be eliminated independently. rows
+  // whose band crosses a range boundary are inserted afterwards.
+  auto rangeBegin = [&](u64 k) { return k * mSize / numThreads; };
+
+  // rangeRows[t][k]: rows hashed by thread t that lie inside range k, in
+  // increasing order. crossRows[t]: rows hashed by thread t that cross a
+  // boundary.
+  std::vector<std::vector<std::vector<u64>>> rangeRows(
+      numThreads, std::vector<std::vector<u64>>(numThreads));
+  std::vector<std::vector<u64>> crossRows(numThreads);
+
+  // initialize rows
+  // a worker per slice t of the keys, which owns rangeRows[t] and crossRows[t]
+  u64 batchSize = mN / numThreads;
+  parallel_for(numThreads, numThreads, [&](u64 tBegin, u64 tEnd) {
+    for (u64 t = tBegin; t < tEnd; ++t) {
+      const u64 start = t * batchSize;
+      const u64 end = (t == numThreads - 1) ? mN : start + batchSize;
+      hashRows(keys + start, end - start, positions + start,
+               bands + start * wBlocks);
+      for (u64 i = start; i < end; ++i) {
+        rows[i].startPos = positions[i];
+        rows[i].data = bands + i * wBlocks;
+        rows[i].val = vals[i];
+
+        u64 k = rows[i].startPos * numThreads / mSize;
+        while (rangeBegin(k + 1) <= rows[i].startPos) {
+          ++k;
+        }
+        while (rangeBegin(k) > rows[i].startPos) {
+          --k;
+        }
+        if (rows[i].startPos + mW <= rangeBegin(k + 1)) {
+          rangeRows[t][k].push_back(i);
+        } else {
+          crossRows[t].push_back(i);
         }
       }
-    } else {
-      output[i] = mPrng.get<block>();
     }
+  });
 
-    // if((i % 10000) == 0){
+  mTimer.setTimePoint("alloc and hash");
+
+  // a worker per column range k
+  std::vector<EncodeStatus> rangeStatus(numThreads, EncodeStatus::SUCCESS);
+  parallel_for(numThreads, numThreads, [&](u64 kBegin, u64 kEnd) {
+    for (u64 k = kBegin; k < kEnd; ++k) {
+      for (u64 t = 0; t < numThreads && rangeStatus[k] == EncodeStatus::SUCCESS;
+           ++t) {
+        for (auto i : rangeRows[t][k]) {
+          if (insert(bitToRowMap, rows, i) == EncodeStatus::FAIL) {
+            rangeStatus[k] = EncodeStatus::FAIL;
+            break;
+          }
+        }
+      }
+    }
+  });
+  for (auto status : rangeStatus) {
+    if (status == EncodeStatus::FAIL) {
+      return status;
+    }
+  }
 
-    // printf("do %d th\n", i);
-    // }
+  // boundary rows, a small fraction of mN
+  for (u64 t = 0; t < numThreads; ++t) {
+    for (auto i : crossRows[t]) {
+      if (insert(bitToRowMap, rows, i) == EncodeStatus::FAIL) {
+        return EncodeStatus::FAIL;
+      }
+    }
   }
 
+  mTimer.setTimePoint("elimination");
+
+  backSubstitute(bitToRowMap, rows, output);
+
   mTimer.setTimePoint("back substitution");
 
   return EncodeStatus::SUCCESS;
@@ -687,9 +725,16 @@ EncodeStatus RBOKVS::encode(const std::vector<block> &keys,
                             std::vector<std::vector<block>> &output) {
   mTimer.setTimePoint("encode start");
 
-  std::unique_ptr<u64[]> bitToRowMap(new u64[mSize]);
-  std::unique_ptr<MatrixRow_LongValue[]> rows(new MatrixRow_LongValue[mN]);
+  RowArena localArena;
+  RowArena &arena = mArena ? *mArena : localArena;
+  RowArena::Scope scope(arena);
+
+  u64 *bitToRowMap = arena.allocate<u64>(mSize);
+  MatrixRow_LongValue *rows = arena.allocate<MatrixRow_LongValue>(mN);
   u64 wBlocks = divCeil(mW, 128);
+  block *bands = arena.allocate<block>(mN * wBlocks);
+  block *values = arena.allocate<block>(mN * VALUE_LENGTH_IN_BLOCK);
+  u64 *positions = arena.allocate<u64>(mN);
 
   // initialize
   for (u64 i = 0; i < mSize; ++i) {
@@ -705,14 +750,12 @@ EncodeStatus RBOKVS::encode(const std::vector<block> &keys,
   // mTimer.setTimePoint("alloc and init");
 
   // initialize rows
-  // todo: maybe parallelize this
+  hashRows(keys.data(), mN, positions, bands);
   for (u64 i = 0; i < mN; ++i) {
-    rows[i].startPos = hashPos(keys[i]);
-    rows[i].data.reset(new block[wBlocks]);
-    hashBand(keys[i], rows[i].data.get());
-    // memcpy(rows[i].val.data(), vals[i].data(), sizeof(block) *
-    // VALUE_LENGTH_IN_BLOCK);
-    rows[i].val.assign(vals[i].begin(), vals[i].end());
+    rows[i].startPos = positions[i];
+    rows[i].data = bands + i * wBlocks;
+    rows[i].val = values + i * VALUE_LENGTH_IN_BLOCK;
+    memcpy(rows[i].val, vals[i].data(), sizeof(block) * VALUE_LENGTH_IN_BLOCK);
   }
 
   // for(u64 i = 0; i < 5; ++i){
@@ -724,7 +767,7 @@ EncodeStatus RBOKVS::encode(const std::vector<block> &keys,
   // mTimer.setTimePoint("alloc and hash");
   EncodeStatus status;
   for (u64 i = 0; i < mN; ++i) {
-    status = insert(bitToRowMap.get(), rows.get(), i, VALUE_LENGTH_IN_BLOCK);
+    status = insert(bitToRowMap, rows, i, VALUE_LENGTH_IN_BLOCK);
     if (status == EncodeStatus::FAIL) {
       return status;
     }
@@ -738,301 +781,16 @@ EncodeStatus RBOKVS::encode(const std::vector<block> &keys,
 
   // mTimer.setTimePoint("elimination");
 
-  ////////////////////////////////////////////////////////////////
-  // need to check
-  block ZeroBlocks[VALUE_LENGTH_IN_BLOCK];
-  for (auto i = 0; i < VALUE_LENGTH_IN_BLOCK; i++) {
-    ZeroBlocks[i] = ZeroBlock;
-  }
-
   // solve the linear system
-  u64 *ptr, tmp, j;
   for (i64 i = mSize - 1; i >= 0; --i) {
     if (bitToRowMap[i] != mN) {
-      ptr = reinterpret_cast<u64 *>(rows[bitToRowMap[i]].data.get());
-      // memcpy(output[i], rows[bitToRowMap[i]].val.data(), sizeof(block) *
-      // VALUE_LENGTH_IN_BLOCK);
-      for (auto cnt = 0; cnt < VALUE_LENGTH_IN_BLOCK; cnt++) {
-        output[i][cnt] = rows[bitToRowMap[i]].val[cnt];
-      }
-      // first way to solve the linear system
-      // for (u64 j = i + 1; j < i + mW && j < mSize; ++j){
-      //     if ((ptr[(j - i) / 64] >> (63 - (j - i) % 64)) & 1){
-      //         output[i] ^= output[j];
-      //     }
-      // }
+      MatrixRow_LongValue &row = rows[bitToRowMap[i]];
+      u64 *ptr = reinterpret_cast<u64 *>(row.data);
       ptr[0] &= 0x7FFFFFFFFFFFFFFF;
-      j = i;
-      // expand the loop, handling 64 bits at one time
-      // except the last u64(maybe less than 64 bits)
-      for (; j < i + mW - 64 && j < mSize - 64; j += 64) {
-        tmp = ptr[(j - i) / 64];
-        // output[i] ^= (tmp & 1) ? output[j + 63] : ZeroBlock;
-        // XOR((output[i]), ((tmp & 1) ? output[j + 63] : ZeroBlocks.data()))
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 63].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 62].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 61].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 60].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 59].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 58].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 57].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 56].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 55].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 54].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 53].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 52].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 51].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 50].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 49].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 48].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 47].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 46].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 45].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 44].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 43].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 42].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 41].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 40].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 39].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 38].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 37].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 36].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 35].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 34].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 33].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 32].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 31].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 30].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 29].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 28].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 27].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 26].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 25].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 24].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 23].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 22].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 21].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 20].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 19].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 18].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 17].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 16].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 15].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 14].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 13].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 12].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 11].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 10].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 9].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 8].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 7].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 6].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 5].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 4].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 3].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 2].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(),
-                   (tmp & 1) ? output[j + 1].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-        tmp >>= 1;
-        blocks_XOR(output[i].data(), (tmp & 1) ? output[j].data() : ZeroBlocks,
-                   VALUE_LENGTH_IN_BLOCK);
-      }
-      for (; j < i + mW && j < mSize; ++j) {
-        if ((ptr[(j - i) / 64] >> (63 - (j - i) % 64)) & 1) {
-          blocks_XOR(output[i].data(), output[j].data(), VALUE_LENGTH_IN_BLOCK);
-        }
-      }
-
+      memcpy(output[i].data(), row.val, sizeof(block) * VALUE_LENGTH_IN_BLOCK);
+      bandXorValues(output[i].data(), &output[i], ptr, mW,
+                    VALUE_LENGTH_IN_BLOCK);
     } else {
-      // output[i] = mPrng.get<block>();
-      block temp_block;
       for (u64 cnt = 0; cnt < VALUE_LENGTH_IN_BLOCK; cnt++) {
         output[i][cnt] = mPrng.get<block>();
       }
@@ -1046,475 +804,123 @@ EncodeStatus RBOKVS::encode(const std::vector<block> &keys,
 }
 
 block RBOKVS::decode(const block *codeWords, const block &key) {
-  u64 startPos = hashPos(key);
-  block data[divCeil(mW, 128)], res = ZeroBlock;
-  hashBand(key, data);
+  u64 startPos;
+  block data[divCeil(mW, 128)];
+  hashRows(&key, 1, &startPos, data);
 
-  u64 *ptr = reinterpret_cast<u64 *>(data);
-  u64 tmp, j;
-  for (j = 0; j < mW - 64; j += 64) {
-    tmp = ptr[j / 64];
-    res ^= (tmp & 1) ? codeWords[startPos + j + 63] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 62] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 61] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 60] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 59] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 58] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 57] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 56] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 55] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 54] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 53] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 52] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 51] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 50] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 49] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 48] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 47] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 46] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 45] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 44] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 43] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 42] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 41] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 40] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 39] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 38] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 37] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 36] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 35] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 34] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 33] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 32] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 31] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 30] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 29] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 28] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 27] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 26] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 25] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 24] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 23] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 22] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 21] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 20] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 19] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 18] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 17] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 16] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 15] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 14] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 13] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 12] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 11] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 10] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 9] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 8] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 7] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 6] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 5] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 4] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 3] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 2] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j + 1] : ZeroBlock;
-    tmp >>= 1;
-    res ^= (tmp & 1) ? codeWords[startPos + j] : ZeroBlock;
-  }
-  for (; j < mW; ++j) {
-    if ((ptr[j / 64] >> (63 - j % 64)) & 1) {
-      res ^= codeWords[startPos + j];
-    }
-  }
-  // don't expand the loop
-  // for (u64 i = 0; i < mW; ++i){
-  //     if ((ptr[i / 64] >> (63 - i % 64)) & 1){
-  //         res ^= codeWords[startPos + i];
-  //     }
-  // }
-  return res;
+  return mBandXor(codeWords + startPos, reinterpret_cast<u64 *>(data), mW);
 }
 
 std::vector<block>
 RBOKVS::decode(const std::vector<std::vector<block>> &codeWords,
                const block &key, const u64 &VALUE_LENGTH_IN_BLOCK) {
-  u64 startPos = hashPos(key);
+  u64 startPos;
   block data[divCeil(mW, 128)];
+  hashRows(&key, 1, &startPos, data);
 
   std::vector<block> res(VALUE_LENGTH_IN_BLOCK, ZeroBlock);
-  block ZeroBlocks[VALUE_LENGTH_IN_BLOCK];
-  for (auto i = 0; i < VALUE_LENGTH_IN_BLOCK; i++) {
-    ZeroBlocks[i] = ZeroBlock;
-  }
-
-  hashBand(key, data);
-
-  u64 *ptr = reinterpret_cast<u64 *>(data);
-  u64 tmp, j;
-  for (j = 0; j < mW - 64; j += 64) {
-    tmp = ptr[j / 64];
-    // res ^= (tmp & 1) ? codeWords[startPos+ j + 63] : ZeroBlock;
-
-    for (int k = 0; k < 64; ++k) {
-      int idx = 63 - k;
-      blocks_XOR(res.data(),
-                 (tmp & 1) ? codeWords[startPos + j + idx].data() : ZeroBlocks,
-                 VALUE_LENGTH_IN_BLOCK);
-      tmp >>= 1;
-    }
+  bandXorValues(res.data(), &codeWords[startPos],
+                reinterpret_cast<u64 *>(data), mW, VALUE_LENGTH_IN_BLOCK);
+  return res;
+}
 
-    /*
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 63].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 62].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 61].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 60].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 59].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 58].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 57].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 56].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 55].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 54].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 53].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 52].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 51].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 50].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 49].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 48].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 47].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 46].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 45].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 44].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 43].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 42].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 41].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 40].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 39].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 38].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 37].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 36].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 35].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 34].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 33].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 32].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 31].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 30].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 29].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 28].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 27].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 26].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 25].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 24].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 23].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 22].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 21].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 20].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 19].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 18].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 17].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 16].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 15].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 14].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 13].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 12].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 11].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 10].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 9].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 8].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 7].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 6].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 5].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 4].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 3].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 2].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j + 1].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    tmp >>= 1;
-    blocks_XOR(res.data(),
-               (tmp & 1) ? codeWords[startPos + j].data() : ZeroBlocks,
-               VALUE_LENGTH_IN_BLOCK);
-    */
-  }
-  for (; j < mW; ++j) {
-    if ((ptr[j / 64] >> (63 - j % 64)) & 1) {
-      // res ^= codeWords[startPos + j];
-      blocks_XOR(res.data(), codeWords[startPos + j].data(),
-                 VALUE_LENGTH_IN_BLOCK);
+void RBOKVS::decodeRange(const block *codeWords, const block *keys, u64 size,
+                         block *output) {
+  // hash a chunk of keys at once, then decode it
+  constexpr u64 chunk = 256;
+  const u64 wBlocks = divCeil(mW, 128);
+  std::vector<u64> positions(chunk);
+  std::vector<block> bands(chunk * wBlocks);
+  for (u64 j = 0; j < size; j += chunk) {
+    const u64 n = std::min<u64>(chunk, size - j);
+    hashRows(keys + j, n, positions.data(), bands.data());
+    for (u64 k = 0; k < n; ++k) {
+      output[j + k] =
+          mBandXor(codeWords + positions[k],
+                   reinterpret_cast<u64 *>(&bands[k * wBlocks]), mW);
     }
   }
-
-  // don't expand the loop
-  // for (u64 i = 0; i < mW; ++i){
-  //     if ((ptr[i / 64] >> (63 - i % 64)) & 1){
-  //         res ^= codeWords[startPos + i];
-  //     }
-  // }
-  return res;
 }
 
 void RBOKVS::decode(const block *codeWords, const block *keys, u64 size,
                     block *output, u64 numThreads) {
-  numThreads = std::max<u64>(1u, numThreads);
-  u64 batchSize = size / numThreads;
-  std::thread decodeThrds[numThreads];
-  for (u64 i = 0; i < numThreads; ++i) {
-    decodeThrds[i] = std::thread([&, i]() {
-      const u64 start = i * batchSize;
-      const u64 end = (i == numThreads - 1) ? size : start + batchSize;
-      for (u64 j = start; j < end; ++j) {
-        output[j] = decode(codeWords, keys[j]);
+  parallel_for(size, numThreads, [&](u64 start, u64 end) {
+    decodeRange(codeWords, keys + start, end - start, output + start);
+  });
+}
+
+void RBOKVS::decode(std::span<const block> codeWords,
+                    std::span<const block> keys,
+                    const u64 &VALUE_LENGTH_IN_BLOCK,
+                    std::span<block> output, u64 numThreads) {
+  const u64 size = keys.size();
+  if (codeWords.size() != mSize * VALUE_LENGTH_IN_BLOCK ||
+      output.size() != size * VALUE_LENGTH_IN_BLOCK) {
+    throw std::runtime_error("rb_okvs batch decode: size mismatch");
+  }
+  numThreads = std::max<u64>(1u, std::min<u64>(numThreads, size));
+  if (size == 0) {
+    return;
+  }
+
+  const u64 wBlocks = divCeil(mW, 128);
+  // (start position, key index) and the band of every key
+  std::vector<std::pair<u64, u64>> order(size);
+  std::unique_ptr<block[]> bands(new block[size * wBlocks]);
+  std::unique_ptr<u64[]> positions(new u64[size]);
+
+  parallel_for(size, numThreads, [&](u64 start, u64 end) {
+    hashRows(keys.data() + start, end - start, positions.get() + start,
+             bands.get() + start * wBlocks);
+    for (u64 i = start; i < end; ++i) {
+      order[i] = {positions[i], i};
+    }
+  });
+
+  // neighbouring queries share most of their columns after sorting, and the
+  // threads work on disjoint parts of the encoding
+  std::sort(order.begin(), order.end());
+
+  const u64 valueBytes = VALUE_LENGTH_IN_BLOCK * sizeof(block);
+  parallel_for(size, numThreads, [&](u64 start, u64 end) {
+    for (u64 s = start; s < end; ++s) {
+      const u64 startPos = order[s].first;
+      const u64 idx = order[s].second;
+
+      // the columns the next query reads past the window of this one
+      if (s + 1 < end) {
+        const u64 from = std::max(startPos + mW, order[s + 1].first);
+        const u64 to = std::min(order[s + 1].first + mW, mSize);
+        for (u64 c = from; c < to; ++c) {
+          auto col = reinterpret_cast<const char *>(
+              &codeWords[c * VALUE_LENGTH_IN_BLOCK]);
+          for (u64 b = 0; b < valueBytes; b += 64) {
+            __builtin_prefetch(col + b);
+          }
+        }
       }
-    });
+
+      decodeRow(codeWords.data(), startPos,
+                reinterpret_cast<const u64 *>(bands.get() + idx * wBlocks),
+                VALUE_LENGTH_IN_BLOCK, &output[idx * VALUE_LENGTH_IN_BLOCK]);
+    }
+  });
+}
+
+void RBOKVS::decodeRow(const block *codeWords, u64 startPos, const u64 *band,
+                       const u64 &VALUE_LENGTH_IN_BLOCK, block *res) const {
+  memset(res, 0, VALUE_LENGTH_IN_BLOCK * sizeof(block));
+  const block *window = codeWords + startPos * VALUE_LENGTH_IN_BLOCK;
+  switch (VALUE_LENGTH_IN_BLOCK) {
+  case PAILLIER_CIPHER_SIZE_IN_BLOCK:
+    bandXorValues<PAILLIER_CIPHER_SIZE_IN_BLOCK>(res, window, band, mW);
+    break;
+  case EC_CIPHER_SIZE_IN_BLOCK:
+    bandXorValues<EC_CIPHER_SIZE_IN_BLOCK>(res, window, band, mW);
+    break;
+  default:
+    bandXorValues<0>(res, window, band, mW, VALUE_LENGTH_IN_BLOCK);
   }
-  for (auto &thrd : decodeThrds)
-    thrd.join();
 }
 
 void RBOKVS_rist::init(const u64 &n, const double &epsilon,
@@ -1725,138 +1131,138 @@ bool cmp(const MatrixRow_rist &x, const MatrixRow_rist &y) {
   return x.start_position < y.start_position;
 }
 
-EncodeStatus
-RBOKVS_rist::encode(const std::vector<block> &keys,
-                    const std::vector<std::vector<Rist25519_number>> &vals,
-                    const u64 &VALUE_LENGTH_IN_NUMBER,
-                    std::vector<std::vector<Rist25519_point>> &output,
-                    const Rist25519_point &OKVS_RISTRETTO_BASEPOINT) {
-
-  std::vector<std::vector<Rist25519_number>> _data(
-      num_columns, std::vector<Rist25519_number>(VALUE_LENGTH_IN_NUMBER));
-
-  for (u64 i = 0; i < num_columns; i++) {
-    for (u64 j = 0; j < VALUE_LENGTH_IN_NUMBER; j++) {
-      _data[i][j] = Rist25519_number(okvs_prng);
-    }
+// Montgomery's trick: invert all n numbers with one inversion and 3(n - 1)
+// multiplications. none of x may be 0
+static void batch_invert(Rist25519_number *x, u64 n,
+                         Rist25519_number *scratch) {
+  if (n == 0) {
+    return;
   }
-
-  std::vector<MatrixRow_rist> rows(num_element);
-
-  for (u64 i = 0; i < keys.size(); i++) {
-    rows[i].start_position = hash_to_position(keys[i]);
-
-    rows[i].piv = 0;
-
-    rows[i].data.reset(new Rist25519_number[width_band]);
-    hash_to_band(keys[i], rows[i].data.get());
-
-    rows[i].val = std::vector<Rist25519_number>(VALUE_LENGTH_IN_NUMBER);
-    rows[i].val.assign(vals[i].begin(), vals[i].end());
+  scratch[0] = x[0];
+  for (u64 i = 1; i < n; i++) {
+    scratch[i] = scratch[i - 1] * x[i];
   }
+  Rist25519_number inv = scratch[n - 1].inverse();
+  for (u64 i = n - 1; i > 0; i--) {
+    Rist25519_number tmp = inv * scratch[i - 1];
+    inv *= x[i];
+    x[i] = tmp;
+  }
+  x[0] = inv;
+}
 
-  // printf("encode key_%d : data\n", 21);
-  // print_element(keys[21]);
-  // printf("\n");
-  // for(int i = 0; i < width_band; i++){
-  //     printf("%d ", (rows[21].data[i] == Rist25519_number(1)));
-  // }
-  // printf("\n");
-  // printf("encode hash pos: %d", rows[21].start_position);
-  // printf("\n");
-  // printf("encode val 21\n");
-  // print_number(rows[21].val[0]);
-  // printf("\n");
-
-  std::sort(rows.begin(), rows.end(), cmp);
-  // printf("\n");
-  // printf("[sorted] encode hash pos 5: %d", rows[5].start_position);
-  // printf("\n");
-  // printf("\n");
-  // printf("[sorted] encode hash pos 10: %d", rows[10].start_position);
-  // printf("\n");
-  // printf("\n");
-  // printf("[sorted] encode hash pos 15: %d", rows[15].start_position);
-  // printf("\n");
-
-  u64 pivots(0);
-
+EncodeStatus
+RBOKVS_rist::solve(const std::vector<block> &keys,
+                   const std::vector<std::vector<Rist25519_number>> &vals,
+                   const u64 &VALUE_LENGTH_IN_NUMBER,
+                   Rist25519_number *solution, u64 num_threads) {
+  const u64 value_length = VALUE_LENGTH_IN_NUMBER;
+  const Rist25519_number zero(0), one(1);
+
+  for (u64 i = 0; i < num_columns * value_length; i++) {
+    solution[i] = Rist25519_number(okvs_prng);
+  }
+
+  RowArena localArena;
+  RowArena &arena = row_arena ? *row_arena : localArena;
+  RowArena::Scope scope(arena);
+
+  MatrixRow_rist *rows = arena.allocate<MatrixRow_rist>(num_element);
+  Rist25519_number *bands =
+      arena.allocate<Rist25519_number>(num_element * width_band);
+  Rist25519_number *values =
+      arena.allocate<Rist25519_number>(num_element * value_length);
+  Rist25519_number *pivot_values =
+      arena.allocate<Rist25519_number>(num_element);
+  Rist25519_number *scratch = arena.allocate<Rist25519_number>(num_element);
+
+  // rows are hashed independently
+  parallel_for(num_element, num_threads, [&](u64 start, u64 end) {
+    for (u64 i = start; i < end; i++) {
+      rows[i].start_position = hash_to_position(keys[i]);
+      rows[i].piv = 0;
+      rows[i].data = bands + i * width_band;
+      hash_to_band(keys[i], rows[i].data);
+      rows[i].val = values + i * value_length;
+      std::copy(vals[i].begin(), vals[i].end(), rows[i].val);
+    }
+  });
+
+  std::sort(rows, rows + num_element, cmp);
+
+  // fraction-free elimination: a pivot row keeps its pivot p and the rows
+  // below are eliminated as p * lower - m * pivot_row, so no inversion is
+  // needed until back substitution, which inverts all pivots in one batch
   for (u64 row = 0; row < num_element; row++) {
-    // top:[0, row] ; bot[row+1, num_element - 1]
-    auto some = rows.begin() + row;
-    for (u64 i = 0; i < width_band; i++) {
-      if ((some->data)[i] == Rist25519_number(0)) {
+    auto some = rows + row;
+    u64 i = 0;
+    while (i < width_band && some->data[i] == zero) {
+      i++;
+    }
+    if (i == width_band) {
+      // all-zero band, the system has no solution for random values
+      return FAIL;
+    }
+    some->piv = some->start_position + i;
+    const Rist25519_number p = some->data[i];
+    pivot_values[row] = p;
+
+    for (u64 j = row + 1; j < num_element; j++) {
+      if (rows[j].start_position > some->piv) {
+        break;
+      }
+      const u64 offset = some->piv - rows[j].start_position;
+      const Rist25519_number multiplier = rows[j].data[offset];
+      if (multiplier == zero) {
         continue;
       }
-      some->piv = some->start_position + i;
-      pivots += 1;
-      if ((some->data)[i] != Rist25519_number(1)) {
-        Rist25519_number inv = (some->data)[i].inverse();
-        (some->data)[i] = Rist25519_number(1);
-        for (u64 j = i + 1; j < width_band; j++) {
-          (some->data)[j] *= inv;
+      if (p != one) {
+        for (u64 k = 0; k < width_band; k++) {
+          if (rows[j].data[k] != zero) {
+            rows[j].data[k] *= p;
+          }
         }
-        for (u64 j = 0; j < VALUE_LENGTH_IN_NUMBER; j++) {
-          (some->val)[j] *= inv;
+        for (u64 k = 0; k < value_length; k++) {
+          rows[j].val[k] *= p;
         }
       }
-
-      for (u64 j = row + 1; j < num_element; j++) {
-        if (rows[j].start_position > some->piv) {
-          break;
+      if (multiplier == one) {
+        for (u64 k = i + 1; k < width_band; k++) {
+          rows[j].data[offset + k - i] -= some->data[k];
         }
-        rows[j].piv = (some->piv) - (rows[j].start_position);
-        Rist25519_number multplier = rows[j].data[rows[j].piv];
-        if (multplier != Rist25519_number(0)) {
-          if (multplier != Rist25519_number(1)) {
-            for (u64 k = i + 1; k < width_band; k++) {
-              rows[j].data[rows[j].piv + k - i] -= (some->data)[k] * multplier;
-            }
-            for (u64 k = 0; k < VALUE_LENGTH_IN_NUMBER; k++) {
-              rows[j].val[k] -= (some->val)[k] * multplier;
-            }
-
-          } else {
-            for (u64 k = i + 1; k < width_band; k++) {
-              rows[j].data[rows[j].piv + k - i] -= (some->data)[k];
-            }
-            for (u64 k = 0; k < VALUE_LENGTH_IN_NUMBER; k++) {
-              rows[j].val[k] -= (some->val)[k];
-            }
+        for (u64 k = 0; k < value_length; k++) {
+          rows[j].val[k] -= some->val[k];
+        }
+      } else {
+        for (u64 k = i + 1; k < width_band; k++) {
+          if (some->data[k] != zero) {
+            rows[j].data[offset + k - i] -= some->data[k] * multiplier;
           }
         }
-        rows[j].data[rows[j].piv] = Rist25519_number(0);
+        for (u64 k = 0; k < value_length; k++) {
+          rows[j].val[k] -= some->val[k] * multiplier;
+        }
       }
-      break;
+      rows[j].data[offset] = zero;
     }
   }
 
-  if (pivots != num_element) {
-    // printf("\n-------------------\nerror: band should not be
-    // all-zero\n-------------------\n");
-  }
+  batch_invert(pivot_values, num_element, scratch);
 
   for (i64 row = num_element - 1; row >= 0; row--) {
+    const u64 start = rows[row].start_position;
     for (u64 i = 0; i < width_band; i++) {
-      if (rows[row].data[i] == Rist25519_number(0)) {
-        continue;
-      }
-      if (rows[row].piv == (rows[row].start_position + i)) {
+      if (rows[row].data[i] == zero || start + i == rows[row].piv) {
         continue;
       }
-      for (u64 k = 0; k < VALUE_LENGTH_IN_NUMBER; k++) {
+      for (u64 k = 0; k < value_length; k++) {
         rows[row].val[k] -=
-            _data[rows[row].start_position + i][k] * rows[row].data[i];
+            solution[(start + i) * value_length + k] * rows[row].data[i];
       }
     }
-    for (u64 k = 0; k < VALUE_LENGTH_IN_NUMBER; k++) {
-      _data[rows[row].piv][k] = rows[row].val[k];
-    }
-  }
-
-  for (u64 i = 0; i < num_columns; i++) {
-    for (u64 j = 0; j < VALUE_LENGTH_IN_NUMBER; j++) {
-      output[i][j] = _data[i][j] * OKVS_RISTRETTO_BASEPOINT;
+    Rist25519_number *x = solution + rows[row].piv * value_length;
+    for (u64 k = 0; k < value_length; k++) {
+      x[k] = rows[row].val[k] * pivot_values[row];
     }
   }
 
@@ -1867,113 +1273,23 @@ EncodeStatus
 RBOKVS_rist::encode(const std::vector<block> &keys,
                     const std::vector<std::vector<Rist25519_number>> &vals,
                     const u64 &VALUE_LENGTH_IN_NUMBER,
-                    std::vector<std::vector<Rist25519_point>> &output) {
-
-  std::vector<std::vector<Rist25519_number>> _data(
-      num_columns, std::vector<Rist25519_number>(VALUE_LENGTH_IN_NUMBER));
-
-  for (u64 i = 0; i < num_columns; i++) {
-    for (u64 j = 0; j < VALUE_LENGTH_IN_NUMBER; j++) {
-      _data[i][j] = Rist25519_number(okvs_prng);
-    }
-  }
-
-  std::vector<MatrixRow_rist> rows(num_element);
-
-  for (u64 i = 0; i < keys.size(); i++) {
-    rows[i].start_position = hash_to_position(keys[i]);
-
-    rows[i].piv = 0;
-
-    rows[i].data.reset(new Rist25519_number[width_band]);
-    hash_to_band(keys[i], rows[i].data.get());
-
-    rows[i].val = std::vector<Rist25519_number>(VALUE_LENGTH_IN_NUMBER);
-    rows[i].val.assign(vals[i].begin(), vals[i].end());
-  }
-
-  std::sort(rows.begin(), rows.end(), cmp);
-
-  u64 pivots(0);
-
-  for (u64 row = 0; row < num_element; row++) {
-    // top:[0, row] ; bot[row+1, num_element - 1]
-    auto some = rows.begin() + row;
-    for (u64 i = 0; i < width_band; i++) {
-      if ((some->data)[i] == Rist25519_number(0)) {
-        continue;
-      }
-      some->piv = some->start_position + i;
-      pivots += 1;
-      if ((some->data)[i] != Rist25519_number(1)) {
-        Rist25519_number inv = (some->data)[i].inverse();
-        (some->data)[i] = Rist25519_number(1);
-        for (u64 j = i + 1; j < width_band; j++) {
-          (some->data)[j] *= inv;
-        }
-        for (u64 j = 0; j < VALUE_LENGTH_IN_NUMBER; j++) {
-          (some->val)[j] *= inv;
-        }
-      }
-
-      for (u64 j = row + 1; j < num_element; j++) {
-        if (rows[j].start_position > some->piv) {
-          break;
-        }
-        rows[j].piv = (some->piv) - (rows[j].start_position);
-        Rist25519_number multplier = rows[j].data[rows[j].piv];
-        if (multplier != Rist25519_number(0)) {
-          if (multplier != Rist25519_number(1)) {
-            for (u64 k = i + 1; k < width_band; k++) {
-              rows[j].data[rows[j].piv + k - i] -= (some->data)[k] * multplier;
-            }
-            for (u64 k = 0; k < VALUE_LENGTH_IN_NUMBER; k++) {
-              rows[j].val[k] -= (some->val)[k] * multplier;
-            }
-
-          } else {
-            for (u64 k = i + 1; k < width_band; k++) {
-              rows[j].data[rows[j].piv + k - i] -= (some->data)[k];
-            }
-            for (u64 k = 0; k < VALUE_LENGTH_IN_NUMBER; k++) {
-              rows[j].val[k] -= (some->val)[k];
-            }
-          }
-        }
-        rows[j].data[rows[j].piv] = Rist25519_number(0);
-      }
-      break;
-    }
-  }
-
-  if (pivots != num_element) {
-    // printf("\n-------------------\nerror: band should not be
-    // all-zero\n-------------------\n");
-  }
-
-  for (i64 row = num_element - 1; row >= 0; row--) {
-    for (u64 i = 0; i < width_band; i++) {
-      if (rows[row].data[i] == Rist25519_number(0)) {
-        continue;
-      }
-      if (rows[row].piv == (rows[row].start_position + i)) {
-        continue;
-      }
-      for (u64 k = 0; k < VALUE_LENGTH_IN_NUMBER; k++) {
-        rows[row].val[k] -=
-            _data[rows[row].start_position + i][k] * rows[row].data[i];
+                    std::vector<std::vector<Rist25519_point>> &output,
+                    const Rist25519_point &OKVS_RISTRETTO_BASEPOINT,
+                    u64 num_threads) {
+  std::vector<Rist25519_number> solution(num_columns * VALUE_LENGTH_IN_NUMBER);
+  if (solve(keys, vals, VALUE_LENGTH_IN_NUMBER, solution.data(),
+            num_threads) != SUCCESS) {
+    return FAIL;
+  }
+
+  parallel_for(num_columns, num_threads, [&](u64 start, u64 end) {
+    for (u64 i = start; i < end; i++) {
+      for (u64 j = 0; j < VALUE_LENGTH_IN_NUMBER; j++) {
+        output[i][j] = solution[i * VALUE_LENGTH_IN_NUMBER + j] *
+                       OKVS_RISTRETTO_BASEPOINT;
       }
     }
-    for (u64 k = 0; k < VALUE_LENGTH_IN_NUMBER; k++) {
-      _data[rows[row].piv][k] = rows[row].val[k];
-    }
-  }
-
-  for (u64 i = 0; i < num_columns; i++) {
-    for (u64 j = 0; j < VALUE_LENGTH_IN_NUMBER; j++) {
-      output[i][j] = Rist25519_point::mulGenerator(_data[i][j]);
-    }
-  }
+  });
 
   return SUCCESS;
 }
@@ -1982,126 +1298,52 @@ EncodeStatus
 RBOKVS_rist::encode(const std::vector<block> &keys,
                     const std::vector<std::vector<Rist25519_number>> &vals,
                     const u64 &VALUE_LENGTH_IN_NUMBER,
-                    std::vector<std::vector<Rist25519_number>> &output) {
-  std::vector<std::vector<Rist25519_number>> _data(
-      num_columns, std::vector<Rist25519_number>(VALUE_LENGTH_IN_NUMBER));
-
-  for (u64 i = 0; i < num_columns; i++) {
-    for (u64 j = 0; j < VALUE_LENGTH_IN_NUMBER; j++) {
-      _data[i][j] = Rist25519_number(okvs_prng);
-    }
-  }
-
-  std::vector<MatrixRow_rist> rows(num_element);
-
-  for (u64 i = 0; i < keys.size(); i++) {
-    rows[i].start_position = hash_to_position(keys[i]);
-
-    rows[i].piv = 0;
-
-    rows[i].data.reset(new Rist25519_number[width_band]);
-    hash_to_band(keys[i], rows[i].data.get());
-
-    rows[i].val = std::vector<Rist25519_number>(VALUE_LENGTH_IN_NUMBER);
-    rows[i].val.assign(vals[i].begin(), vals[i].end());
-  }
-
-  std::sort(rows.begin(), rows.end(), cmp);
-  // printf("\n");
-  u64 pivots(0);
-
-  for (u64 row = 0; row < num_element; row++) {
-    // top:[0, row] ; bot[row+1, num_element - 1]
-    auto some = rows.begin() + row;
-    for (u64 i = 0; i < width_band; i++) {
-      if ((some->data)[i] == Rist25519_number(0)) {
-        continue;
-      }
-      some->piv = some->start_position + i;
-      pivots += 1;
-      if ((some->data)[i] != Rist25519_number(1)) {
-        Rist25519_number inv = (some->data)[i].inverse();
-        (some->data)[i] = Rist25519_number(1);
-        for (u64 j = i + 1; j < width_band; j++) {
-          (some->data)[j] *= inv;
-        }
-        for (u64 j = 0; j < VALUE_LENGTH_IN_NUMBER; j++) {
-          (some->val)[j] *= inv;
-        }
-      }
-
-      for (u64 j = row + 1; j < num_element; j++) {
-        if (rows[j].start_position > some->piv) {
-          break;
-        }
-        rows[j].piv = (some->piv) - (rows[j].start_position);
-        Rist25519_number multplier = rows[j].data[rows[j].piv];
-        if (multplier != Rist25519_number(0)) {
-          if (multplier != Rist25519_number(1)) {
-            for (u64 k = i + 1; k < width_band; k++) {
-              rows[j].data[rows[j].piv + k - i] -= (some->data)[k] * multplier;
-            }
-            for (u64 k = 0; k < VALUE_LENGTH_IN_NUMBER; k++) {
-              rows[j].val[k] -= (some->val)[k] * multplier;
-            }
-
-          } else {
-            for (u64 k = i + 1; k < width_band; k++) {
-              rows[j].data[rows[j].piv + k - i] -= (some->data)[k];
-            }
-            for (u64 k = 0; k < VALUE_LENGTH_IN_NUMBER; k++) {
-              rows[j].val[k] -= (some->val)[k];
-            }
-          }
-        }
-        rows[j].data[rows[j].piv] = Rist25519_number(0);
+                    std::vector<std::vector<Rist25519_point>> &output,
+                    u64 num_threads) {
+  std::vector<Rist25519_number> solution(num_columns * VALUE_LENGTH_IN_NUMBER);
+  if (solve(keys, vals, VALUE_LENGTH_IN_NUMBER, solution.data(),
+            num_threads) != SUCCESS) {
+    return FAIL;
+  }
+
+  parallel_for(num_columns, num_threads, [&](u64 start, u64 end) {
+    for (u64 i = start; i < end; i++) {
+      for (u64 j = 0; j < VALUE_LENGTH_IN_NUMBER; j++) {
+        output[i][j] = Rist25519_point::mulGenerator(
+            solution[i * VALUE_LENGTH_IN_NUMBER + j]);
       }
-      break;
     }
-  }
+  });
 
-  if (pivots != num_element) {
-    // printf("\n-------------------\nerror: band should not be
-    // all-zero\n-------------------\n");
-  }
+  return SUCCESS;
+}
 
-  for (i64 row = num_element - 1; row >= 0; row--) {
-    for (u64 i = 0; i < width_band; i++) {
-      if (rows[row].data[i] == Rist25519_number(0)) {
-        continue;
-      }
-      if (rows[row].piv == (rows[row].start_position + i)) {
-        continue;
-      }
-      for (u64 k = 0; k < VALUE_LENGTH_IN_NUMBER; k++) {
-        rows[row].val[k] -=
-            _data[rows[row].start_position + i][k] * rows[row].data[i];
-      }
-    }
-    for (u64 k = 0; k < VALUE_LENGTH_IN_NUMBER; k++) {
-      _data[rows[row].piv][k] = rows[row].val[k];
-    }
+EncodeStatus
+RBOKVS_rist::encode(const std::vector<block> &keys,
+                    const std::vector<std::vector<Rist25519_number>> &vals,
+                    const u64 &VALUE_LENGTH_IN_NUMBER,
+                    std::vector<std::vector<Rist25519_number>> &output,
+                    u64 num_threads) {
+  std::vector<Rist25519_number> solution(num_columns * VALUE_LENGTH_IN_NUMBER);
+  if (solve(keys, vals, VALUE_LENGTH_IN_NUMBER, solution.data(),
+            num_threads) != SUCCESS) {
+    return FAIL;
   }
 
   for (u64 i = 0; i < num_columns; i++) {
-    for (u64 j = 0; j < VALUE_LENGTH_IN_NUMBER; j++) {
-      output[i][j] = _data[i][j];
-    }
+    std::copy(solution.begin() + i * VALUE_LENGTH_IN_NUMBER,
+              solution.begin() + (i + 1) * VALUE_LENGTH_IN_NUMBER,
+              output[i].begin());
   }
 
   return SUCCESS;
 }
 
-std::vector<Rist25519_point>
-RBOKVS_rist::decode(const std::vector<std::vector<Rist25519_point>> &codeWords,
-                    const block &key, const u64 &VALUE_LENGTH_IN_NUMBER) {
-
+void RBOKVS_rist::decode(
+    const std::vector<std::vector<Rist25519_point>> &codeWords,
+    const block &key, const u64 &VALUE_LENGTH_IN_NUMBER,
+    Rist25519_point *result) {
   u64 start_position = hash_to_position(key);
-  std::unique_ptr<Rist25519_number[]> data;
-  data.reset(new Rist25519_number[width_band]);
-  hash_to_band(key, data.get());
-
-  std::vector<Rist25519_point> result(VALUE_LENGTH_IN_NUMBER, ZERO_POINT);
 
   u64 width_band_in_byte = divCeil(width_band, 8);
   u8 hashOut[width_band_in_byte];
@@ -2111,83 +1353,41 @@ RBOKVS_rist::decode(const std::vector<std::vector<Rist25519_point>> &codeWords,
   blake3_hasher_update(&hasher, &key, sizeof(key));
   blake3_hasher_finalize(&hasher, hashOut, width_band_in_byte);
 
-  // printf("decode key 21\n");
-  // print_element(key);
-  // printf("\n");
-  // printf("hash pos 21:%d\n", start_position);
-
-  u64 i(0);
-  for (i = 0; i < width_band_in_byte - 1; i++) {
-
-    // print_u8(hashOut + i, 1);
-
-    if ((hashOut[i] & 0b10000000) != 0) {
-      for (u64 k = 0; k < VALUE_LENGTH_IN_NUMBER; k++) {
-        result[k] += codeWords[start_position + i * 8 + 0][k];
-      }
-    }
-    if ((hashOut[i] & 0b01000000) != 0) {
-      for (u64 k = 0; k < VALUE_LENGTH_IN_NUMBER; k++) {
-        result[k] += codeWords[start_position + i * 8 + 1][k];
-      }
-    }
-    if ((hashOut[i] & 0b00100000) != 0) {
-      for (u64 k = 0; k < VALUE_LENGTH_IN_NUMBER; k++) {
-        result[k] += codeWords[start_position + i * 8 + 2][k];
-      }
-    }
-    if ((hashOut[i] & 0b00010000) != 0) {
-      for (u64 k = 0; k < VALUE_LENGTH_IN_NUMBER; k++) {
-        result[k] += codeWords[start_position + i * 8 + 3][k];
-      }
-    }
-    if ((hashOut[i] & 0b00001000) != 0) {
-      for (u64 k = 0; k < VALUE_LENGTH_IN_NUMBER; k++) {
-        result[k] += codeWords[start_position + i * 8 + 4][k];
-      }
-    }
-    if ((hashOut[i] & 0b00000100) != 0) {
-      for (u64 k = 0; k < VALUE_LENGTH_IN_NUMBER; k++) {
-        result[k] += codeWords[start_position + i * 8 + 5][k];
-      }
-    }
-    if ((hashOut[i] & 0b00000010) != 0) {
-      for (u64 k = 0; k < VALUE_LENGTH_IN_NUMBER; k++) {
-        result[k] += codeWords[start_position + i * 8 + 6][k];
-      }
-    }
-    if ((hashOut[i] & 0b00000001) != 0) {
-      for (u64 k = 0; k < VALUE_LENGTH_IN_NUMBER; k++) {
-        result[k] += codeWords[start_position + i * 8 + 7][k];
-      }
-    }
+  for (u64 k = 0; k < VALUE_LENGTH_IN_NUMBER; k++) {
+    result[k] = ZERO_POINT;
   }
-
-  u64 j(0);
-  if ((width_band % 8) == 0) {
-
-    // print_u8(hashOut + i, 1);
-    // printf("\n");
-    for (j = 0; j < 8; j++) {
-      if ((hashOut[i] & (((u8)1) << (7 - j))) != 0) {
-        for (u64 k = 0; k < VALUE_LENGTH_IN_NUMBER; k++) {
-          result[k] += codeWords[start_position + i * 8 + j][k];
-        }
-      }
-    }
-  } else {
-    for (j = 0; (j < (width_band % 8)); j++) {
-      if ((hashOut[i] & (((u8)1) << (7 - j))) != 0) {
-        for (u64 k = 0; k < VALUE_LENGTH_IN_NUMBER; k++) {
-          result[k] += codeWords[start_position + i * 8 + j][k];
-        }
+  // the band is 0/1, so the combination is a sum of the selected codewords
+  for (u64 i = 0; i < width_band; i++) {
+    if ((hashOut[i / 8] >> (7 - i % 8)) & 1) {
+      auto &codeWord = codeWords[start_position + i];
+      for (u64 k = 0; k < VALUE_LENGTH_IN_NUMBER; k++) {
+        result[k] += codeWord[k];
       }
     }
   }
+}
 
+std::vector<Rist25519_point>
+RBOKVS_rist::decode(const std::vector<std::vector<Rist25519_point>> &codeWords,
+                    const block &key, const u64 &VALUE_LENGTH_IN_NUMBER) {
+  std::vector<Rist25519_point> result(VALUE_LENGTH_IN_NUMBER);
+  decode(codeWords, key, VALUE_LENGTH_IN_NUMBER, result.data());
   return result;
 }
 
+void RBOKVS_rist::decode(
+    const std::vector<std::vector<Rist25519_point>> &codeWords,
+    const std::vector<block> &keys, const u64 &VALUE_LENGTH_IN_NUMBER,
+    std::vector<Rist25519_point> &output, u64 num_threads) {
+  output.resize(keys.size() * VALUE_LENGTH_IN_NUMBER);
+  parallel_for(keys.size(), num_threads, [&](u64 start, u64 end) {
+    for (u64 i = start; i < end; i++) {
+      decode(codeWords, keys[i], VALUE_LENGTH_IN_NUMBER,
+             output.data() + i * VALUE_LENGTH_IN_NUMBER);
+    }
+  });
+}
+
 EncodeStatus
 RBOKVS_rist::test_encode(const std::vector<block> &keys,
                          const std::vector<std::vector<Rist25519_number>> &vals,
@@ -2202,14 +1402,23 @@ RBOKVS_rist::test_encode(const std::vector<block> &keys,
     }
   }
 
-  std::vector<MatrixRow_rist> rows(num_element);
+  RowArena localArena;
+  RowArena &arena = row_arena ? *row_arena : localArena;
+  RowArena::Scope scope(arena);
+
+  MatrixRow_rist *rows = arena.allocate<MatrixRow_rist>(num_element);
+  Rist25519_number *bands =
+      arena.allocate<Rist25519_number>(num_element * width_band);
+  Rist25519_number *values =
+      arena.allocate<Rist25519_number>(num_element * VALUE_LENGTH_IN_NUMBER);
 
   for (u64 i = 0; i < keys.size(); i++) {
-    rows[i].val.assign(vals[i].begin(), vals[i].end());
+    rows[i].val = values + i * VALUE_LENGTH_IN_NUMBER;
+    std::copy(vals[i].begin(), vals[i].end(), rows[i].val);
     rows[i].piv = 0;
     rows[i].start_position = hash_to_position(keys[i]);
-    rows[i].data.reset(new Rist25519_number[width_band]);
-    hash_to_band(keys[i], rows[i].data.get());
+    rows[i].data = bands + i * width_band;
+    hash_to_band(keys[i], rows[i].data);
   }
 
   // printf("key_%d : data\n", 0);
@@ -2217,13 +1426,13 @@ RBOKVS_rist::test_encode(const std::vector<block> &keys,
   //     print_number(rows[0].data[i]);
   // }
 
-  std::sort(rows.begin(), rows.end(), cmp);
+  std::sort(rows, rows + num_element, cmp);
 
   u64 pivots(0);
 
   for (u64 row = 0; row < num_element; row++) {
     // top:[0, row] ; bot[row+1, num_element - 1]
-    auto some = rows.begin() + row;
+    auto some = rows + row;
     for (u64 i = 0; i < width_band; i++) {
       if ((some->data)[i] == Rist25519_number(0)) {
         continue;
@@ -2462,7 +1671,8 @@ void print_row_of_matrix(MatrixRow &a, u64 wBlocks) {
   std::cout << "\n";
 }
 
-void print_row_of_matrix_long_value(MatrixRow_LongValue &a, u64 wBlocks) {
+void print_row_of_matrix_long_value(MatrixRow_LongValue &a, u64 wBlocks,
+                                    u64 VALUE_LENGTH_IN_BLOCK) {
   std::cout << "startPos: ";
   std::cout << a.startPos << " ";
 
@@ -2470,14 +1680,15 @@ void print_row_of_matrix_long_value(MatrixRow_LongValue &a, u64 wBlocks) {
   print_row_data(&(a.data[0]), wBlocks);
 
   std::cout << "val: ";
-  for (auto iter = a.val.begin(); iter != a.val.end(); iter++) {
-    print_element(*iter);
+  for (u64 i = 0; i < VALUE_LENGTH_IN_BLOCK; i++) {
+    print_element(a.val[i]);
   }
 
   std::cout << "\n";
 }
 
-void print_row_of_matrix_rist(MatrixRow_rist &a, u64 band_width) {
+void print_row_of_matrix_rist(MatrixRow_rist &a, u64 band_width,
+                              u64 VALUE_LENGTH_IN_NUMBER) {
   std::cout << "startPos: ";
   std::cout << a.start_position << " ";
 
@@ -2488,8 +1699,8 @@ void print_row_of_matrix_rist(MatrixRow_rist &a, u64 band_width) {
   }
 
   std::cout << "   val: ";
-  for (auto iter = a.val.begin(); iter != a.val.end(); iter++) {
-    print_number(*iter);
+  for (u64 i = 0; i < VALUE_LENGTH_IN_NUMBER; i++) {
+    print_number(a.val[i]);
   }
 
   std::cout << "\n";
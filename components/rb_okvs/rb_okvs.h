@@ -1,12 +1,16 @@
 // authors: Xiang Liu, Yuanchao Luo, Longxin Wang
 #pragma once
+#include <span>
 #include <vector>
 
 #include <cryptoTools/Common/Defines.h>
 #include <cryptoTools/Common/Timer.h>
+#include <cryptoTools/Crypto/AES.h>
 #include <cryptoTools/Crypto/SodiumCurve.h>
 #include <ipcl/bignum.h>
 
+#include "band_xor.h"
+#include "row_arena.h"
 #include "config.h"
 
 #ifndef CRYPTOTOOLS_RBOKVS_H
@@ -14,25 +18,26 @@
 
 using element = oc::block;
 
+// band data and values of the rows below live in a RowArena
 struct MatrixRow {
   u64 startPos;
-  std::unique_ptr<block[]> data;
+  block *data;
   block val;
   u64 next;
 };
 
 struct MatrixRow_LongValue {
   u64 startPos;
-  std::unique_ptr<block[]> data;
-  std::vector<block> val;
+  block *data;
+  block *val;
   u64 next;
 };
 
 struct MatrixRow_rist {
   u64 start_position;
   u64 piv;
-  std::unique_ptr<Rist25519_number[]> data;
-  std::vector<Rist25519_number> val;
+  Rist25519_number *data;
+  Rist25519_number *val;
 };
 
 enum EncodeStatus { SUCCESS, FAIL, ALLZERO };
@@ -49,6 +54,8 @@ struct RBOKVSParam {
   block mR1, mR2;
   // random seed for encode
   block mSeed;
+  // derivation of the rows from the keys
+  OkvsRowHash mRowHash = OKVS_ROW_HASH;
 
   u64 numCols() const { return static_cast<u64>(mScaler * mNumRows); }
 };
@@ -67,6 +74,15 @@ public:
   block mRPos, mRBand;
   // PRNG for encode
   PRNG mPrng;
+  // derivation of the rows from the keys
+  OkvsRowHash mRowHash;
+  // keyed by mRPos, for OkvsRowHash::AesCtr
+  AES mRowAes;
+  // xor of the codewords selected by a band, picked in init
+  BandXorFunc mBandXor;
+  // scratch memory of encode, shared by several encodes to avoid allocating
+  // per encode. a private arena is used if null
+  RowArena *mArena = nullptr;
   // hash function
   // blake3_hasher mHasher;
   Timer mTimer;
@@ -90,7 +106,18 @@ public:
   u64 hashPos(const block &input);
   // get a random band(w bits)
   void hashBand(const block &input, block *output);
-
+  // hashPos and hashBand are the OkvsRowHash::Blake3 rows. hashRows gives
+  // the rows of count keys for any backend, the band of key i at
+  // bands + i * divCeil(mW, 128)
+  void hashRows(const block *keys, u64 count, u64 *positions, block *bands);
+  void hashRowsBlake3OnePass(const block *keys, u64 count, u64 *positions,
+                             block *bands);
+  void hashRowsAes(const block *keys, u64 count, u64 *positions,
+                   block *bands);
+
+  // shift the band so that its first 1 is the first bit, ALLZERO if there is
+  // no 1 left
+  EncodeStatus reformalizeBand(block *data, u64 &startPos);
   EncodeStatus reformalize(MatrixRow &row);
   EncodeStatus reformalize(MatrixRow_LongValue &row,
                            const u64 VALUE_LENGTH_IN_BLOCK);
@@ -100,6 +127,12 @@ public:
                       const u64 VALUE_LENGTH_IN_BLOCK);
 
   EncodeStatus encode(const block *keys, const block *vals, block *output);
+  // eliminate disjoint column ranges on numThreads threads
+  EncodeStatus encode(const block *keys, const block *vals, block *output,
+                      u64 numThreads);
+
+  // solve the eliminated system from the last column to the first
+  void backSubstitute(const u64 *bitToRowMap, MatrixRow *rows, block *output);
 
   // output
   EncodeStatus encode(const std::vector<block> &keys,
@@ -113,6 +146,18 @@ public:
 
   void decode(const block *codeWords, const block *keys, u64 size,
               block *output, u64 numThreads);
+  // decode size keys on the calling thread
+  void decodeRange(const block *codeWords, const block *keys, u64 size,
+                   block *output);
+  // decode keys.size() values at once. codeWords holds mSize values and
+  // output keys.size() values, VALUE_LENGTH_IN_BLOCK blocks each
+  void decode(std::span<const block> codeWords, std::span<const block> keys,
+              const u64 &VALUE_LENGTH_IN_BLOCK, std::span<block> output,
+              u64 numThreads);
+  // res = value of the row whose band starts at startPos, only the columns
+  // [startPos, startPos + mW) of codeWords are read
+  void decodeRow(const block *codeWords, u64 startPos, const u64 *band,
+                 const u64 &VALUE_LENGTH_IN_BLOCK, block *res) const;
 };
 
 class RBOKVS_rist {
@@ -130,6 +175,8 @@ public:
   block rand_position, rand_band;
   // PRNG for encode
   PRNG okvs_prng;
+  // scratch memory of encode, a private arena is used if null
+  RowArena *row_arena = nullptr;
 
   RBOKVS_rist() = default;
   RBOKVS_rist(const RBOKVS_rist &copy) {}
@@ -143,24 +190,43 @@ public:
   // get a random band(w rist_number)
   void hash_to_band(const block &input, Rist25519_number *output);
 
+  // solve the band system, random where the keys leave freedom. column c
+  // of the solution at solution + c * VALUE_LENGTH_IN_NUMBER
+  EncodeStatus solve(const std::vector<block> &keys,
+                     const std::vector<std::vector<Rist25519_number>> &vals,
+                     const u64 &VALUE_LENGTH_IN_NUMBER,
+                     Rist25519_number *solution, u64 num_threads = 1);
+
   // output
   EncodeStatus encode(const std::vector<block> &keys,
                       const std::vector<std::vector<Rist25519_number>> &vals,
                       const u64 &VALUE_LENGTH_IN_NUMBER,
                       std::vector<std::vector<Rist25519_point>> &output,
-                      const Rist25519_point &OKVS_RISTRETTO_BASEPOINT);
+                      const Rist25519_point &OKVS_RISTRETTO_BASEPOINT,
+                      u64 num_threads = 1);
   EncodeStatus encode(const std::vector<block> &keys,
                       const std::vector<std::vector<Rist25519_number>> &vals,
                       const u64 &VALUE_LENGTH_IN_NUMBER,
-                      std::vector<std::vector<Rist25519_point>> &output);
+                      std::vector<std::vector<Rist25519_point>> &output,
+                      u64 num_threads = 1);
   EncodeStatus encode(const std::vector<block> &keys,
                       const std::vector<std::vector<Rist25519_number>> &vals,
                       const u64 &VALUE_LENGTH_IN_NUMBER,
-                      std::vector<std::vector<Rist25519_number>> &output);
+                      std::vector<std::vector<Rist25519_number>> &output,
+                      u64 num_threads = 1);
 
   std::vector<Rist25519_point>
   decode(const std::vector<std::vector<Rist25519_point>> &codeWords,
          const block &key, const u64 &VALUE_LENGTH_IN_NUMBER);
+  void decode(const std::vector<std::vector<Rist25519_point>> &codeWords,
+              const block &key, const u64 &VALUE_LENGTH_IN_NUMBER,
+              Rist25519_point *result);
+  // decode keys.size() keys on num_threads threads, the value of key i at
+  // output[i * VALUE_LENGTH_IN_NUMBER]
+  void decode(const std::vector<std::vector<Rist25519_point>> &codeWords,
+              const std::vector<block> &keys,
+              const u64 &VALUE_LENGTH_IN_NUMBER,
+              std::vector<Rist25519_point> &output, u64 num_threads);
 
   EncodeStatus
   test_encode(const std::vector<block> &keys,
@@ -190,8 +256,10 @@ void print_row_data(osuCrypto::block *data, u64 wBlocks);
 
 void print_row_of_matrix(MatrixRow &a, u64 wBlocks);
 
-void print_row_of_matrix_long_value(MatrixRow_LongValue &a, u64 wBlocks);
-void print_row_of_matrix_rist(MatrixRow_rist &a, u64 band_width);
+void print_row_of_matrix_long_value(MatrixRow_LongValue &a, u64 wBlocks,
+                                    u64 VALUE_LENGTH_IN_BLOCK);
+void print_row_of_matrix_rist(MatrixRow_rist &a, u64 band_width,
+                              u64 VALUE_LENGTH_IN_NUMBER);
 
 void print_grid(const std::vector<u64> &grid);
 
@@ -200,7 +268,7 @@ BigNumber block_vector_to_bignumer(const std::vector<block> &ct);
 
 std::vector<block> bignumers_to_block_vector(const std::vector<BigNumber> &bn);
 std::vector<BigNumber>
-block_vector_to_bignumers(const std::vector<block> &ct, const u64 &value_size,
+block_vector_to_bignumers(std::span<const block> ct, const u64 &value_size,
                           std::shared_ptr<BigNumber> nsq);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,145 @@
+#include "rb_okvs_binned.h"
+
+#include <algorithm>
+
+#include "rr22/SimpleIndex.h"
+#include "utils/util.h"
+
+void RBOKVSBinned::init(const u64 &n, const double &epsilon,
+                        const u64 &stasSecParam, const block &seed,
+                        u64 binSize) {
+  mN = n;
+  mNumBins = std::max<u64>(1, divCeil(n, binSize));
+
+  // encode fails if any bin overflows or any bin fails, union bound over the
+  // bins
+  u64 binSsp = stasSecParam + log2ceil(mNumBins);
+  mItemsPerBin = volePSI::SimpleIndex::get_bin_size(mNumBins, n, binSsp);
+
+  PRNG prng(seed);
+  RBOKVS okvs;
+  mBinParam = okvs.getParams(mItemsPerBin, epsilon, binSsp, prng.get<block>());
+  mBinSize = mBinParam.numCols();
+  mSize = mNumBins * mBinSize;
+
+  mBinAes.setKey(prng.get<block>());
+  mPrng.SetSeed(prng.get<block>());
+}
+
+void RBOKVSBinned::hashBins(const block *keys, u64 count, u64 *bins) const {
+  constexpr u64 batch = 8;
+  block out[batch];
+  for (u64 i = 0; i < count; i += batch) {
+    const u64 n = std::min<u64>(batch, count - i);
+    mBinAes.ecbEncBlocks(keys + i, n, out);
+    for (u64 k = 0; k < n; ++k) {
+      bins[i + k] = (out[k] ^ keys[i + k]).get<u64>(1) % mNumBins;
+    }
+  }
+}
+
+EncodeStatus RBOKVSBinned::encode(const block *keys, const block *vals,
+                                  block *output, u64 numThreads) {
+  numThreads = std::max<u64>(1u, std::min<u64>(numThreads, mNumBins));
+
+  std::vector<u64> bins(mN);
+  parallel_for(mN, numThreads, [&](u64 start, u64 end) {
+    hashBins(keys + start, end - start, bins.data() + start);
+  });
+
+  // bin b holds rows [b * mItemsPerBin, (b + 1) * mItemsPerBin), the real
+  // ones first and random padding after them
+  std::vector<u64> binFill(mNumBins, 0);
+  std::vector<block> binKeys(mNumBins * mItemsPerBin);
+  std::vector<block> binVals(mNumBins * mItemsPerBin);
+  for (u64 i = 0; i < mN; ++i) {
+    u64 b = bins[i];
+    if (binFill[b] == mItemsPerBin) {
+      return EncodeStatus::FAIL;
+    }
+    u64 slot = b * mItemsPerBin + binFill[b]++;
+    binKeys[slot] = keys[i];
+    binVals[slot] = vals[i];
+  }
+  for (u64 b = 0; b < mNumBins; ++b) {
+    u64 slot = b * mItemsPerBin + binFill[b];
+    mPrng.get<block>(binKeys.data() + slot, mItemsPerBin - binFill[b]);
+    mPrng.get<block>(binVals.data() + slot, mItemsPerBin - binFill[b]);
+  }
+
+  std::vector<block> seeds(numThreads);
+  mPrng.get<block>(seeds.data(), numThreads);
+  std::vector<EncodeStatus> status(numThreads, EncodeStatus::SUCCESS);
+  // worker t takes bins t, t + numThreads, ...
+  parallel_for(numThreads, numThreads, [&](u64 tBegin, u64 tEnd) {
+    for (u64 t = tBegin; t < tEnd; ++t) {
+      RowArena arena(u64(1) << 22);
+      RBOKVSParam param = mBinParam;
+      param.mSeed = seeds[t];
+      RBOKVS okvs;
+      okvs.init(param);
+      okvs.mArena = &arena;
+      for (u64 b = t; b < mNumBins; b += numThreads) {
+        if (okvs.encode(binKeys.data() + b * mItemsPerBin,
+                        binVals.data() + b * mItemsPerBin,
+                        output + b * mBinSize) == EncodeStatus::FAIL) {
+          status[t] = EncodeStatus::FAIL;
+          break;
+        }
+      }
+    }
+  });
+  for (auto s : status) {
+    if (s == EncodeStatus::FAIL) {
+      return s;
+    }
+  }
+  return EncodeStatus::SUCCESS;
+}
+
+void RBOKVSBinned::decode(const block *codeWords, const block *keys, u64 size,
+                          block *output, u64 numThreads) {
+  numThreads = std::max<u64>(1u, std::min<u64>(numThreads, mNumBins));
+
+  std::vector<u64> bins(size);
+  parallel_for(size, numThreads, [&](u64 start, u64 end) {
+    hashBins(keys + start, end - start, bins.data() + start);
+  });
+
+  // counting sort of the keys by bin, keys of bin b at
+  // [binBegin[b], binBegin[b + 1])
+  std::vector<u64> binBegin(mNumBins + 1, 0);
+  for (u64 i = 0; i < size; ++i) {
+    ++binBegin[bins[i] + 1];
+  }
+  for (u64 b = 0; b < mNumBins; ++b) {
+    binBegin[b + 1] += binBegin[b];
+  }
+  std::vector<u64> order(size);
+  std::vector<block> sortedKeys(size);
+  std::vector<u64> binFill(binBegin.begin(), binBegin.end() - 1);
+  for (u64 i = 0; i < size; ++i) {
+    u64 slot = binFill[bins[i]]++;
+    order[slot] = i;
+    sortedKeys[slot] = keys[i];
+  }
+
+  // decode only needs the hash parameters, which all bins share
+  RBOKVS okvs;
+  okvs.init(mBinParam);
+  std::vector<block> sortedOutput(size);
+  parallel_for(numThreads, numThreads, [&](u64 tBegin, u64 tEnd) {
+    for (u64 t = tBegin; t < tEnd; ++t) {
+      for (u64 b = t; b < mNumBins; b += numThreads) {
+        okvs.decodeRange(codeWords + b * mBinSize,
+                         sortedKeys.data() + binBegin[b],
+                         binBegin[b + 1] - binBegin[b],
+                         sortedOutput.data() + binBegin[b]);
+      }
+    }
+  });
+
+  for (u64 s = 0; s < size; ++s) {
+    output[order[s]] = sortedOutput[s];
+  }
+}
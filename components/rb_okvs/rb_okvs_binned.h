@@ -0,0 +1,47 @@
+#pragma once
+#include <vector>
+
+#include <cryptoTools/Crypto/AES.h>
+
+#include "rb_okvs.h"
+
+// keys are hashed to bins of about binSize keys and every bin is an
+// independent RBOKVS of mItemsPerBin rows, so a bin's band matrix stays in
+// cache and bins are solved on different threads. the encoding is the
+// concatenation of the bin encodings, bin b at [b * mBinSize, (b + 1) *
+// mBinSize)
+class RBOKVSBinned {
+public:
+  // number of elements(rows)
+  u64 mN;
+  // number of bins
+  u64 mNumBins;
+  // rows of every bin, bins are padded with random rows to this size
+  u64 mItemsPerBin;
+  // columns of every bin
+  u64 mBinSize;
+  // columns of the whole encoding
+  u64 mSize;
+  // parameters of the bins, sized for mItemsPerBin rows
+  RBOKVSParam mBinParam;
+  // hashes keys to bins
+  AES mBinAes;
+  // padding rows and seeds of the bins
+  PRNG mPrng;
+
+  void init(const u64 &n, const double &epsilon, const u64 &stasSecParam,
+            const block &seed, u64 binSize = u64(1) << 14);
+
+  // columns over rows, including the padding of the bins
+  double overhead() const { return double(mSize) / mN; }
+
+  // bin of every key
+  void hashBins(const block *keys, u64 count, u64 *bins) const;
+
+  EncodeStatus encode(const block *keys, const block *vals, block *output,
+                      u64 numThreads);
+
+  // keys are grouped by bin and every bin is decoded as one batch
+  void decode(const block *codeWords, const block *keys, u64 size,
+              block *output, u64 numThreads);
+};
@@ -0,0 +1,241 @@
+#pragma once
+#include <array>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+#include "band_xor.h"
+#include "rb_okvs.h"
+
+template <u64 ValueBlocks> struct MatrixRow_Fixed {
+  u64 startPos;
+  block *data;
+  std::array<block, ValueBlocks> val;
+};
+
+// RBOKVS whose values are ValueBlocks blocks wide. values and encodings are
+// stored flat, value i at [i * ValueBlocks, (i + 1) * ValueBlocks)
+template <u64 ValueBlocks> class RBOKVS_Fixed : public RBOKVS {
+public:
+  using Row = MatrixRow_Fixed<ValueBlocks>;
+
+  // number of blocks of an encoding
+  u64 encodingSize() const { return mSize * ValueBlocks; }
+
+  EncodeStatus insert(u64 *bitToRowMap, Row *rows, u64 rowIdx);
+
+  // vals holds mN values and output mSize values
+  EncodeStatus encode(std::span<const block> keys, std::span<const block> vals,
+                      std::span<block> output);
+
+  // eliminate on the bands only and append the pivot columns the row was
+  // reduced by to pivotLog
+  EncodeStatus insertBand(u64 *bitToRowMap, MatrixRow *rows, u64 rowIdx,
+                          std::vector<u64> &pivotLog);
+
+  // same result as encode, but values are not touched during elimination.
+  // the logged reductions are replayed on the values in one pass that
+  // writes straight into output, which is then back-substituted in place
+  EncodeStatus encodeDeferred(std::span<const block> keys,
+                              std::span<const block> vals,
+                              std::span<block> output);
+
+  // output holds keys.size() values
+  void decode(std::span<const block> codeWords, std::span<const block> keys,
+              std::span<block> output, u64 numThreads) {
+    RBOKVS::decode(codeWords, keys, ValueBlocks, output, numThreads);
+  }
+};
+
+template <u64 ValueBlocks>
+EncodeStatus RBOKVS_Fixed<ValueBlocks>::insert(u64 *bitToRowMap, Row *rows,
+                                               u64 rowIdx) {
+  Row &row = rows[rowIdx];
+  u64 wBlocks = divCeil(mW, 128);
+  while (reformalizeBand(row.data, row.startPos) ==
+         EncodeStatus::SUCCESS) {
+    u64 collidingRowIdx = bitToRowMap[row.startPos];
+    if (collidingRowIdx == mN) {
+      bitToRowMap[row.startPos] = rowIdx;
+      return EncodeStatus::SUCCESS;
+    }
+
+    // band XOR
+    for (u64 i = 0; i < wBlocks; ++i) {
+      row.data[i] ^= rows[collidingRowIdx].data[i];
+    }
+    // value XOR
+    for (u64 i = 0; i < ValueBlocks; ++i) {
+      row.val[i] ^= rows[collidingRowIdx].val[i];
+    }
+  }
+
+  // all zero row
+  for (u64 i = 0; i < ValueBlocks; ++i) {
+    if (row.val[i] != ZeroBlock) {
+      return EncodeStatus::FAIL;
+    }
+  }
+  row.startPos = -1;
+  return EncodeStatus::ALLZERO;
+}
+
+template <u64 ValueBlocks>
+EncodeStatus RBOKVS_Fixed<ValueBlocks>::encode(std::span<const block> keys,
+                                               std::span<const block> vals,
+                                               std::span<block> output) {
+  if (keys.size() != mN || vals.size() != mN * ValueBlocks ||
+      output.size() != encodingSize()) {
+    throw std::runtime_error("rb_okvs fixed encode: size mismatch");
+  }
+
+  RowArena localArena;
+  RowArena &arena = mArena ? *mArena : localArena;
+  RowArena::Scope scope(arena);
+
+  u64 *bitToRowMap = arena.allocate<u64>(mSize);
+  Row *rows = arena.allocate<Row>(mN);
+  u64 wBlocks = divCeil(mW, 128);
+  block *bands = arena.allocate<block>(mN * wBlocks);
+  u64 *positions = arena.allocate<u64>(mN);
+
+  // initialize
+  for (u64 i = 0; i < mSize; ++i) {
+    bitToRowMap[i] = mN;
+  }
+
+  // initialize rows
+  hashRows(keys.data(), mN, positions, bands);
+  for (u64 i = 0; i < mN; ++i) {
+    rows[i].startPos = positions[i];
+    rows[i].data = bands + i * wBlocks;
+    memcpy(rows[i].val.data(), &vals[i * ValueBlocks],
+           sizeof(block) * ValueBlocks);
+  }
+
+  for (u64 i = 0; i < mN; ++i) {
+    if (insert(bitToRowMap, rows, i) == EncodeStatus::FAIL) {
+      return EncodeStatus::FAIL;
+    }
+  }
+
+  // solve the linear system
+  for (i64 i = mSize - 1; i >= 0; --i) {
+    block *res = &output[i * ValueBlocks];
+    if (bitToRowMap[i] != mN) {
+      Row &row = rows[bitToRowMap[i]];
+      u64 *ptr = reinterpret_cast<u64 *>(row.data);
+      ptr[0] &= 0x7FFFFFFFFFFFFFFF;
+      memcpy(res, row.val.data(), sizeof(block) * ValueBlocks);
+      bandXorValues<ValueBlocks>(res, res, ptr, mW);
+    } else {
+      mPrng.get<block>(res, ValueBlocks);
+    }
+  }
+
+  return EncodeStatus::SUCCESS;
+}
+
+template <u64 ValueBlocks>
+EncodeStatus RBOKVS_Fixed<ValueBlocks>::insertBand(u64 *bitToRowMap,
+                                                   MatrixRow *rows, u64 rowIdx,
+                                                   std::vector<u64> &pivotLog) {
+  MatrixRow &row = rows[rowIdx];
+  u64 wBlocks = divCeil(mW, 128);
+  while (reformalizeBand(row.data, row.startPos) ==
+         EncodeStatus::SUCCESS) {
+    u64 collidingRowIdx = bitToRowMap[row.startPos];
+    if (collidingRowIdx == mN) {
+      bitToRowMap[row.startPos] = rowIdx;
+      return EncodeStatus::SUCCESS;
+    }
+
+    pivotLog.push_back(row.startPos);
+    for (u64 i = 0; i < wBlocks; ++i) {
+      row.data[i] ^= rows[collidingRowIdx].data[i];
+    }
+  }
+
+  row.startPos = -1;
+  return EncodeStatus::ALLZERO;
+}
+
+template <u64 ValueBlocks>
+EncodeStatus RBOKVS_Fixed<ValueBlocks>::encodeDeferred(
+    std::span<const block> keys, std::span<const block> vals,
+    std::span<block> output) {
+  if (keys.size() != mN || vals.size() != mN * ValueBlocks ||
+      output.size() != encodingSize()) {
+    throw std::runtime_error("rb_okvs fixed encode: size mismatch");
+  }
+
+  RowArena localArena;
+  RowArena &arena = mArena ? *mArena : localArena;
+  RowArena::Scope scope(arena);
+
+  u64 *bitToRowMap = arena.allocate<u64>(mSize);
+  MatrixRow *rows = arena.allocate<MatrixRow>(mN);
+  u64 wBlocks = divCeil(mW, 128);
+  block *bands = arena.allocate<block>(mN * wBlocks);
+  u64 *positions = arena.allocate<u64>(mN);
+
+  for (u64 i = 0; i < mSize; ++i) {
+    bitToRowMap[i] = mN;
+  }
+
+  hashRows(keys.data(), mN, positions, bands);
+  for (u64 i = 0; i < mN; ++i) {
+    rows[i].startPos = positions[i];
+    rows[i].data = bands + i * wBlocks;
+  }
+
+  // pivot columns that row i was reduced by are
+  // pivotLog[logOffset[i]..logOffset[i + 1])
+  std::vector<u64> pivotLog;
+  u64 *logOffset = arena.allocate<u64>(mN + 1);
+  logOffset[0] = 0;
+  pivotLog.reserve(mN * 4);
+  for (u64 i = 0; i < mN; ++i) {
+    insertBand(bitToRowMap, rows, i, pivotLog);
+    logOffset[i + 1] = pivotLog.size();
+  }
+
+  // replay on the values in insertion order. every pivot a row was reduced
+  // by belongs to an earlier row, whose reduced value already sits at
+  // output[pivot]
+  std::array<block, ValueBlocks> zeroRowVal;
+  for (u64 i = 0; i < mN; ++i) {
+    bool isZeroRow = rows[i].startPos == u64(-1);
+    block *res = isZeroRow ? zeroRowVal.data()
+                           : &output[rows[i].startPos * ValueBlocks];
+    memcpy(res, &vals[i * ValueBlocks], sizeof(block) * ValueBlocks);
+    for (u64 j = logOffset[i]; j < logOffset[i + 1]; ++j) {
+      const block *src = &output[pivotLog[j] * ValueBlocks];
+      for (u64 k = 0; k < ValueBlocks; ++k) {
+        res[k] ^= src[k];
+      }
+    }
+
+    if (isZeroRow) {
+      for (u64 k = 0; k < ValueBlocks; ++k) {
+        if (res[k] != ZeroBlock) {
+          return EncodeStatus::FAIL;
+        }
+      }
+    }
+  }
+
+  // solve the linear system, the reduced values are already in place
+  for (i64 i = mSize - 1; i >= 0; --i) {
+    block *res = &output[i * ValueBlocks];
+    if (bitToRowMap[i] != mN) {
+      u64 *ptr = reinterpret_cast<u64 *>(rows[bitToRowMap[i]].data);
+      ptr[0] &= 0x7FFFFFFFFFFFFFFF;
+      bandXorValues<ValueBlocks>(res, res, ptr, mW);
+    } else {
+      mPrng.get<block>(res, ValueBlocks);
+    }
+  }
+
+  return EncodeStatus::SUCCESS;
+}
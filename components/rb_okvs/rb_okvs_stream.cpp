@@ -0,0 +1,59 @@
+#include "rb_okvs_stream.h"
+
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+
+#include "utils/util.h"
+
+RBOKVSStreamDecoder::RBOKVSStreamDecoder(RBOKVS &okvs,
+                                         std::span<const block> keys,
+                                         u64 valueBlocks,
+                                         std::span<block> output,
+                                         u64 numThreads)
+    : mOkvs(okvs), mValueBlocks(valueBlocks), mOutput(output),
+      mNumThreads(std::max<u64>(1, numThreads)),
+      mWBlocks(divCeil(okvs.mW, 128)), mOrder(keys.size()),
+      mBands(new block[keys.size() * mWBlocks]) {
+  const u64 size = keys.size();
+  if (output.size() != size * valueBlocks) {
+    throw std::runtime_error("rb_okvs stream decode: size mismatch");
+  }
+
+  std::vector<u64> positions(size);
+  parallel_for(size, mNumThreads, [&](u64 start, u64 end) {
+    mOkvs.hashRows(keys.data() + start, end - start, positions.data() + start,
+                   mBands.get() + start * mWBlocks);
+    for (u64 i = start; i < end; ++i) {
+      mOrder[i] = {positions[i], i};
+    }
+  });
+
+  // the encoding arrives back to front
+  std::sort(mOrder.begin(), mOrder.end(), std::greater<>());
+}
+
+void RBOKVSStreamDecoder::advance(const block *codeWords, u64 lo) {
+  u64 end = mNext;
+  while (end < mOrder.size() && mOrder[end].first >= lo) {
+    ++end;
+  }
+  const u64 count = end - mNext;
+  if (count == 0) {
+    return;
+  }
+
+  // threads only pay off for larger steps
+  const u64 numThrds =
+      std::min<u64>(mNumThreads, std::max<u64>(1, count / 1024));
+  parallel_for(count, numThrds, [&](u64 start, u64 stop) {
+    for (u64 s = mNext + start; s < mNext + stop; ++s) {
+      const u64 idx = mOrder[s].second;
+      mOkvs.decodeRow(
+          codeWords, mOrder[s].first,
+          reinterpret_cast<const u64 *>(mBands.get() + idx * mWBlocks),
+          mValueBlocks, &mOutput[idx * mValueBlocks]);
+    }
+  });
+  mNext = end;
+}
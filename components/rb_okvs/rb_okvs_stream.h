@@ -0,0 +1,37 @@
+#pragma once
+#include <memory>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "rb_okvs.h"
+
+// decodes a batch of keys against an encoding that arrives from its last
+// column to its first. the value of a key only needs the columns of its band
+// [startPos, startPos + mW), so it is decoded as soon as those have arrived
+// instead of after the whole encoding
+class RBOKVSStreamDecoder {
+public:
+  // output holds keys.size() values of valueBlocks blocks, written by advance
+  RBOKVSStreamDecoder(RBOKVS &okvs, std::span<const block> keys,
+                      u64 valueBlocks, std::span<block> output,
+                      u64 numThreads);
+
+  // columns [lo, mSize) of codeWords are final, decode every key whose band
+  // lies in them and has not been decoded yet
+  void advance(const block *codeWords, u64 lo);
+
+  bool done() const { return mNext == mOrder.size(); }
+
+private:
+  RBOKVS &mOkvs;
+  u64 mValueBlocks;
+  std::span<block> mOutput;
+  u64 mNumThreads;
+  u64 mWBlocks;
+  // (start position, key index), highest start position first
+  std::vector<std::pair<u64, u64>> mOrder;
+  std::unique_ptr<block[]> mBands;
+  // keys mOrder[0, mNext) are decoded
+  u64 mNext = 0;
+};
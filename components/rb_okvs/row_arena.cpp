@@ -0,0 +1,87 @@
+#include "row_arena.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <sys/mman.h>
+
+namespace {
+
+const u64 kPageSize = u64(1) << 12;
+const u64 kHugePageSize = u64(1) << 21;
+
+u64 roundUp(u64 x, u64 align) { return (x + align - 1) / align * align; }
+
+} // namespace
+
+RowArena::RowArena(u64 slabBytes, bool hugePages)
+    : mSlabBytes(slabBytes), mHugePages(hugePages) {}
+
+RowArena::~RowArena() {
+  for (auto &slab : mSlabs) {
+    munmap(slab.base, slab.size);
+  }
+}
+
+RowArena::Slab RowArena::newSlab(u64 bytes) {
+  u64 size = roundUp(std::max(bytes, mSlabBytes),
+                     mHugePages ? kHugePageSize : kPageSize);
+  void *ptr = MAP_FAILED;
+#ifdef MAP_HUGETLB
+  if (mHugePages) {
+    ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  }
+#endif
+  if (ptr == MAP_FAILED) {
+    ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED) {
+      throw std::runtime_error("row arena: mmap failed");
+    }
+#ifdef MADV_HUGEPAGE
+    if (mHugePages) {
+      madvise(ptr, size, MADV_HUGEPAGE);
+    }
+#endif
+  }
+  return {static_cast<u8 *>(ptr), size, 0};
+}
+
+void *RowArena::allocate(u64 bytes, u64 align) {
+  for (; mCur < mSlabs.size(); ++mCur) {
+    Slab &slab = mSlabs[mCur];
+    u64 offset = roundUp(slab.used, align);
+    if (offset + bytes <= slab.size) {
+      slab.used = offset + bytes;
+      return slab.base + offset;
+    }
+  }
+
+  // slabs are page aligned, so a fresh one satisfies any align up to a page
+  mSlabs.push_back(newSlab(bytes));
+  mCur = mSlabs.size() - 1;
+  mSlabs[mCur].used = bytes;
+  return mSlabs[mCur].base;
+}
+
+RowArena::Mark RowArena::mark() const {
+  if (mCur < mSlabs.size()) {
+    return {mCur, mSlabs[mCur].used};
+  }
+  return {mCur, 0};
+}
+
+void RowArena::rewind(const Mark &m) {
+  for (u64 i = m.slab; i < mSlabs.size(); ++i) {
+    mSlabs[i].used = (i == m.slab) ? m.used : 0;
+  }
+  mCur = m.slab;
+}
+
+u64 RowArena::capacity() const {
+  u64 total = 0;
+  for (auto &slab : mSlabs) {
+    total += slab.size;
+  }
+  return total;
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include <cryptoTools/Common/Defines.h>
+
+using namespace oc;
+
+// bump allocator for the scratch memory of an encode (bands, values, rows,
+// pivot maps). memory is carved out of a few large mmap'd slabs in
+// allocation order and is only given back to the system when the arena is
+// destroyed, so one arena can serve many encodes without any allocation
+// after the first.
+class RowArena {
+public:
+  // an allocation point, see mark() and rewind()
+  struct Mark {
+    u64 slab;
+    u64 used;
+  };
+
+  // rewinds the arena to where it was when the scope was opened
+  class Scope {
+  public:
+    explicit Scope(RowArena &arena) : mArena(arena), mMark(arena.mark()) {}
+    ~Scope() { mArena.rewind(mMark); }
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+  private:
+    RowArena &mArena;
+    Mark mMark;
+  };
+
+  // slabs are at least slabBytes large. with hugePages, slabs are backed by
+  // explicit huge pages when the system has them reserved and by
+  // transparent huge pages otherwise
+  explicit RowArena(u64 slabBytes = u64(1) << 26, bool hugePages = true);
+  ~RowArena();
+
+  RowArena(const RowArena &) = delete;
+  RowArena &operator=(const RowArena &) = delete;
+
+  void *allocate(u64 bytes, u64 align = 64);
+
+  // uninitialized storage for count objects, nothing is ever destructed
+  template <typename T> T *allocate(u64 count) {
+    static_assert(std::is_trivially_destructible_v<T>,
+                  "arena objects are never destructed");
+    constexpr u64 align = alignof(T) > 64 ? alignof(T) : 64;
+    return static_cast<T *>(allocate(sizeof(T) * count, align));
+  }
+
+  Mark mark() const;
+  // free everything allocated after m, the slabs are kept
+  void rewind(const Mark &m);
+  // free everything, the slabs are kept
+  void reset() { rewind({0, 0}); }
+
+  // bytes mapped by all slabs
+  u64 capacity() const;
+
+private:
+  struct Slab {
+    u8 *base;
+    u64 size;
+    u64 used;
+  };
+
+  Slab newSlab(u64 bytes);
+
+  std::vector<Slab> mSlabs;
+  // slab currently allocated from
+  u64 mCur = 0;
+  u64 mSlabBytes;
+  bool mHugePages;
+};
@@ -1,14 +1,17 @@
 #include <cryptoTools/Common/Defines.h>
 #include <cryptoTools/Common/block.h>
 #include <cryptoTools/Crypto/PRNG.h>
+#include <optional>
+#include <stdexcept>
 #include <vector>
 
 #include "utils/util.h"
 
 void sample_points(u64 dim, u64 delta, u64 send_size, u64 recv_size,
                    u64 intersection_size, vector<pt> &send_pts,
-                   vector<pt> &recv_pts, bool sample_flag) {
-  PRNG prng(oc::sysRandomSeed());
+                   vector<pt> &recv_pts, bool sample_flag,
+                   const block &seed) {
+  PRNG prng(seed);
 
   for (u64 i = 0; i < send_size; i++) {
     for (u64 j = 0; j < dim; j++) {
@@ -126,120 +129,90 @@ vector<pt> intersection(const pt &p, u64 dim, u64 delta, bool sigma) {
   return results;
 }
 
-std::vector<block> bignumer_to_block_vector(const BigNumber &bn) {
-  std::vector<u32> ct;
-  bn.num2vec(ct);
+namespace {
 
-  std::vector<block> cipher_block(PAILLIER_CIPHER_SIZE_IN_BLOCK, ZeroBlock);
+const u64 kCipherWords = PAILLIER_CIPHER_SIZE_IN_BLOCK * 4;
 
-  PRNG prng(oc::sysRandomSeed());
+} // namespace
 
-  if (ct.size() < PAILLIER_CIPHER_SIZE_IN_BLOCK * 4) {
-    for (auto i = 0; i < PAILLIER_CIPHER_SIZE_IN_BLOCK; i++) {
-      cipher_block[i] = prng.get<block>();
+void bignumers_to_blocks(std::span<const BigNumber> bns, std::span<block> out,
+                         u64 thread_num) {
+  if (out.size() != bns.size() * PAILLIER_CIPHER_SIZE_IN_BLOCK) {
+    throw std::runtime_error("bignumers_to_blocks: size mismatch");
+  }
+  // checked before the fan-out, a throw on a worker thread would terminate
+  for (const auto &bn : bns) {
+    if (bn.DwordSize() > kCipherWords) {
+      throw std::runtime_error("bignumers_to_blocks: value too long");
     }
-  } else {
-    for (auto i = 0; i < PAILLIER_CIPHER_SIZE_IN_BLOCK; i++) {
-      cipher_block[i] =
-          block(((u64(ct[4 * i + 3])) << 32) + (u64(ct[4 * i + 2])),
-                ((u64(ct[4 * i + 1])) << 32) + (u64(ct[4 * i])));
+  }
+  parallel_for(bns.size(), thread_num, [&](u64 start, u64 end) {
+    // seeded on the first short value, which is rare
+    std::optional<PRNG> prng;
+    for (u64 i = start; i < end; ++i) {
+      block *blks = out.data() + i * PAILLIER_CIPHER_SIZE_IN_BLOCK;
+      const u64 words = bns[i].DwordSize();
+      if (words < kCipherWords) {
+        if (!prng) {
+          prng.emplace(oc::sysRandomSeed());
+        }
+        prng->get(blks, PAILLIER_CIPHER_SIZE_IN_BLOCK);
+      } else {
+        // the limbs are little-endian, as the blocks
+        int size = 0;
+        bns[i].Get(reinterpret_cast<u32 *>(blks), &size);
+      }
     }
+  });
+}
+
+void blocks_to_bignumers(std::span<const block> ct, std::span<BigNumber> out,
+                         u64 thread_num, const BigNumber *nsq) {
+  if (ct.size() < out.size() * PAILLIER_CIPHER_SIZE_IN_BLOCK) {
+    throw std::runtime_error("blocks_to_bignumers: size mismatch");
   }
+  parallel_for(out.size(), thread_num, [&](u64 start, u64 end) {
+    for (u64 i = start; i < end; ++i) {
+      out[i] = BigNumber(reinterpret_cast<const u32 *>(
+                             ct.data() + i * PAILLIER_CIPHER_SIZE_IN_BLOCK),
+                         kCipherWords);
+      // only values at or above nsq pay for the division
+      if (nsq != nullptr && !(out[i] < *nsq)) {
+        out[i] = out[i] % *nsq;
+      }
+    }
+  });
+}
 
+std::vector<block> bignumer_to_block_vector(const BigNumber &bn) {
+  std::vector<block> cipher_block(PAILLIER_CIPHER_SIZE_IN_BLOCK);
+  bignumers_to_blocks(std::span(&bn, 1), cipher_block, 1);
   return cipher_block;
 }
 
 BigNumber block_vector_to_bignumer(const std::vector<block> &ct) {
-  std::vector<uint32_t> ct_u32(PAILLIER_CIPHER_SIZE_IN_BLOCK * 4, 0);
-  u32 temp[4];
-  for (auto i = 0; i < PAILLIER_CIPHER_SIZE_IN_BLOCK; i++) {
-    memcpy(temp, ct[i].data(), 16);
-
-    ct_u32[4 * i] = temp[0];
-    ct_u32[4 * i + 1] = temp[1];
-    ct_u32[4 * i + 2] = temp[2];
-    ct_u32[4 * i + 3] = temp[3];
-  }
-  BigNumber bn = BigNumber(ct_u32.data(), ct_u32.size());
-  return bn;
+  return BigNumber(reinterpret_cast<const u32 *>(ct.data()), kCipherWords);
 }
 
 std::vector<block>
 bignumers_to_block_vector(const std::vector<BigNumber> &bns) {
-  auto count = bns.size();
-  std::vector<block> cipher_block;
-  cipher_block.reserve(PAILLIER_CIPHER_SIZE_IN_BLOCK * count);
-
-  std::vector<u32> ct;
-  ct.reserve(PAILLIER_CIPHER_SIZE_IN_BLOCK * 4);
-
-  PRNG prng(oc::sysRandomSeed());
-
-  for (const auto &bn : bns) {
-    bn.num2vec(ct);
-
-    if (ct.size() < PAILLIER_CIPHER_SIZE_IN_BLOCK * 4) {
-      for (auto i = 0; i < PAILLIER_CIPHER_SIZE_IN_BLOCK; i++) {
-        cipher_block.push_back(prng.get<block>());
-      }
-    } else {
-      // notes: Little-endian BLock
-      for (auto i = 0; i < PAILLIER_CIPHER_SIZE_IN_BLOCK; i++) {
-        cipher_block.push_back(
-            block(((u64(ct[4 * i + 3])) << 32) + (u64(ct[4 * i + 2])),
-                  ((u64(ct[4 * i + 1])) << 32) + (u64(ct[4 * i]))));
-      }
-    }
-    ct.clear();
-  }
-
+  std::vector<block> cipher_block(PAILLIER_CIPHER_SIZE_IN_BLOCK * bns.size());
+  bignumers_to_blocks(bns, cipher_block, 1);
   return cipher_block;
 }
 
 std::vector<BigNumber>
-block_vector_to_bignumers(const std::vector<block> &ct, const u64 &value_size,
+block_vector_to_bignumers(std::span<const block> ct, const u64 &value_size,
                           std::shared_ptr<BigNumber> nsq) {
-  vector<BigNumber> bns;
-
-  std::vector<uint32_t> ct_u32(PAILLIER_CIPHER_SIZE_IN_BLOCK * 4, 0);
-
-  for (auto i = 0; i < value_size; i++) {
-    u32 temp[4];
-    u64 index = i * PAILLIER_CIPHER_SIZE_IN_BLOCK;
-    for (auto j = 0; j < PAILLIER_CIPHER_SIZE_IN_BLOCK; j++) {
-      memcpy(temp, ct[index + j].data(), 16);
-      ct_u32[4 * j] = temp[0];
-      ct_u32[4 * j + 1] = temp[1];
-      ct_u32[4 * j + 2] = temp[2];
-      ct_u32[4 * j + 3] = temp[3];
-    }
-
-    bns.push_back(BigNumber(ct_u32.data(), ct_u32.size()) % (*nsq));
-  }
-
+  std::vector<BigNumber> bns(value_size);
+  blocks_to_bignumers(ct, bns, 1, nsq.get());
   return bns;
 }
 
-std::vector<BigNumber> block_vector_to_bignumers(const std::vector<block> &ct,
+std::vector<BigNumber> block_vector_to_bignumers(std::span<const block> ct,
                                                  const u64 &value_size) {
-  vector<BigNumber> bns;
-
-  std::vector<uint32_t> ct_u32(PAILLIER_CIPHER_SIZE_IN_BLOCK * 4, 0);
-
-  for (auto i = 0; i < value_size; i++) {
-    u32 temp[4];
-    u64 index = i * PAILLIER_CIPHER_SIZE_IN_BLOCK;
-    for (auto j = 0; j < PAILLIER_CIPHER_SIZE_IN_BLOCK; j++) {
-      memcpy(temp, ct[index + j].data(), 16);
-      ct_u32[4 * j] = temp[0];
-      ct_u32[4 * j + 1] = temp[1];
-      ct_u32[4 * j + 2] = temp[2];
-      ct_u32[4 * j + 3] = temp[3];
-    }
-
-    bns.push_back(BigNumber(ct_u32.data(), ct_u32.size()));
-  }
-
+  std::vector<BigNumber> bns(value_size);
+  blocks_to_bignumers(ct, bns, 1);
   return bns;
 }
 
@@ -291,4 +264,4 @@ bignumers_to_blocks_vector(const std::vector<BigNumber> &bns) {
     blks_vector.push_back(bignumer_to_block_vector(bn));
   }
   return blks_vector;
-}
\ No newline at end of file
+}
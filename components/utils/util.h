@@ -1,6 +1,9 @@
 #pragma once
 
+#include <algorithm>
 #include <map>
+#include <span>
+#include <thread>
 #include <vector>
 
 #include <blake3.h>
@@ -9,6 +12,8 @@
 #include <cryptoTools/Crypto/PRNG.h>
 #include <cryptoTools/Crypto/SodiumCurve.h>
 #include <ipcl/bignum.h>
+#include <ipcl/ciphertext.hpp>
+#include <ipcl/pub_key.hpp>
 #include <spdlog/spdlog.h>
 
 #include "config.h"
@@ -59,9 +64,12 @@ public:
   }
 };
 
+// the same seed gives the same point sets, so parties in different processes
+// can sample them independently
 void sample_points(u64 dim, u64 delta, u64 sender_size, u64 recv_size,
                    u64 intersection_size, vector<pt> &sender_pts,
-                   vector<pt> &recv_pts, bool sample_flag);
+                   vector<pt> &recv_pts, bool sample_flag,
+                   const block &seed = oc::sysRandomSeed());
 
 pt cell(const pt &p, u64 dim, u64 side_len);
 pt block_(const pt &p, u64 dim, u64 delta, u64 sidelen);
@@ -71,14 +79,23 @@ u64 l_inf_dist(const pt &p1, const pt &p2, u64 dim);
 u64 get_position(const pt &cross_point, const pt &source_point, u64 dim);
 vector<pt> intersection(const pt &p, u64 dim, u64 delta, bool sigma);
 
+// ciphertexts to and from their little-endian limbs, straight into and out
+// of PAILLIER_CIPHER_SIZE_IN_BLOCK blocks each. a value shorter than a
+// ciphertext is written as random blocks; values read back are reduced mod
+// nsq when it is given
+void bignumers_to_blocks(std::span<const BigNumber> bns, std::span<block> out,
+                         u64 thread_num);
+void blocks_to_bignumers(std::span<const block> ct, std::span<BigNumber> out,
+                         u64 thread_num, const BigNumber *nsq = nullptr);
+
 std::vector<block> bignumer_to_block_vector(const BigNumber &bn);
 BigNumber block_vector_to_bignumer(const std::vector<block> &ct);
 std::vector<block> bignumers_to_block_vector(const std::vector<BigNumber> &bns);
 
 std::vector<BigNumber>
-block_vector_to_bignumers(const std::vector<block> &ct, const u64 &value_size,
+block_vector_to_bignumers(std::span<const block> ct, const u64 &value_size,
                           std::shared_ptr<BigNumber> nsq);
-std::vector<BigNumber> block_vector_to_bignumers(const std::vector<block> &ct,
+std::vector<BigNumber> block_vector_to_bignumers(std::span<const block> ct,
                                                  const u64 &value_size);
 std::vector<block>
 flattenBlocks(const std::vector<std::vector<block>> &blockData);
@@ -87,6 +104,27 @@ chunkFixedSizeBlocks(const std::vector<block> &flatData, size_t chunk_size);
 std::vector<std::vector<block>>
 bignumers_to_blocks_vector(const std::vector<BigNumber> &bns);
 
+// split [0, count) into thread_num ranges and run fn(start, end) on each
+template <typename Fn> void parallel_for(u64 count, u64 thread_num, Fn fn) {
+  thread_num = std::max<u64>(1, std::min<u64>(thread_num, count));
+  if (thread_num == 1) {
+    fn(0, count);
+    return;
+  }
+  u64 batch_size = count / thread_num;
+  vector<std::thread> thrds(thread_num);
+  for (u64 t = 0; t < thread_num; ++t) {
+    thrds[t] = std::thread([&, t]() {
+      const u64 start = t * batch_size;
+      const u64 end = (t == thread_num - 1) ? count : start + batch_size;
+      fn(start, end);
+    });
+  }
+  for (auto &thrd : thrds) {
+    thrd.join();
+  }
+}
+
 inline void padding_keys(vector<block> &keys, u64 count) {
   if (keys.size() >= count) {
     return;
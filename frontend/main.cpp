@@ -19,13 +19,58 @@ void print_usage() {
   std::cout << "      4: run_psi_nonish\n";
   std::cout << "      5: run_oprf_ish\n";
   std::cout << "      6: run_ahe_ish\n";
-  std::cout << "  --test <num>      run test (1-6):\n";
+  std::cout << "  --test <num>      run test (1-16):\n";
   std::cout << "      1: test_ecc_elgamal\n";
   std::cout << "      2: test_oprf\n";
   std::cout << "      3: test_flat_and_recovery\n";
   std::cout << "      4: test_paxos_param\n";
   std::cout << "      5: test_intersection\n";
   std::cout << "      6: test_okvs\n";
+  std::cout << "      7: test_okvs_encode\n";
+  std::cout << "      8: test_okvs_binned\n";
+  std::cout << "      9: test_net_emulator\n";
+  std::cout << "      10: test_frame\n";
+  std::cout << "      11: test_shm_channel\n";
+  std::cout << "      12: test_paillier_rand_pool\n";
+  std::cout << "      13: test_ahe\n";
+  std::cout << "      14: test_paillier_engine\n";
+  std::cout << "      15: test_paillier_packing\n";
+  std::cout << "      16: test_paillier_key_pool\n";
+  std::cout << "  --t <num>         threads of the parties (default 1)\n";
+  std::cout << "  --okvs_cache <dir> reuse setup encodings saved in dir\n";
+  std::cout << "  --real_setup      encrypt the setup values instead of "
+               "random stand-ins\n";
+  std::cout << "  --rand_pool <file> precomputed paillier randomness for the "
+               "setup,\n";
+  std::cout << "                    what is left is saved back\n";
+  std::cout << "  --keyfile <file>  paillier key of the receiver, generated "
+               "and saved\n";
+  std::cout << "                    there on the first run\n";
+  std::cout << "  --keypool <dir>   take the receiver's paillier key from dir, "
+               "which\n";
+  std::cout << "                    is refilled by a process of its own\n";
+  std::cout << "  --keypool_fill    only fill the --keypool dir, runs start "
+               "this\n";
+  std::cout << "                    themselves after taking a key\n";
+  std::cout << "  --ahe <scheme>    zero test of protocols 3, 4: paillier "
+               "(default)\n";
+  std::cout << "                    or elgamal, ec elgamal over ristretto\n";
+  std::cout << "  --role <role>     run one party over tcp, sender or "
+               "receiver\n";
+  std::cout << "                    (p1 is the receiver in protocols 5, 6),\n";
+  std::cout << "                    both processes need the same arguments\n";
+  std::cout << "  --ip <addr>       receiver address (default 127.0.0.1)\n";
+  std::cout << "  --port <num>      first port, --t ports are used (default "
+               "1212)\n";
+  std::cout << "  --seed <num>      seed of the sampled points\n";
+  std::cout << "  --net <profile>   shape the link: lan, wan or\n";
+  std::cout << "                    custom:<mbps>,<rtt ms>[,<jitter ms>],\n";
+  std::cout << "                    done by the sender with --role\n";
+  std::cout << "  --transport <t>   tcp (default), shm for shared memory "
+               "channels\n";
+  std::cout << "                    or handoff to also pass the setup "
+               "encoding\n";
+  std::cout << "                    as shared memory, parties on one host\n";
   std::cout
       << "  --log <level>    log level  (0:off, 1:info, 2:debug, 3:debug)\n";
 }
@@ -55,6 +100,11 @@ int main(int argc, char **argv) {
     spdlog::set_level(spdlog::level::info);
   }
 
+  if (cmd.isSet("keypool_fill")) {
+    run_key_pool_fill(cmd);
+    return 0;
+  }
+
   if (cmd.isSet("p")) {
     switch (cmd.getOr<u64>("p", 1)) {
     case 1:
@@ -101,6 +151,36 @@ int main(int argc, char **argv) {
     case 6:
       test_okvs(cmd);
       break;
+    case 7:
+      test_okvs_encode(cmd);
+      break;
+    case 8:
+      test_okvs_binned(cmd);
+      break;
+    case 9:
+      test_net_emulator(cmd);
+      break;
+    case 10:
+      test_frame(cmd);
+      break;
+    case 11:
+      test_shm_channel(cmd);
+      break;
+    case 12:
+      test_paillier_rand_pool(cmd);
+      break;
+    case 13:
+      test_ahe(cmd);
+      break;
+    case 14:
+      test_paillier_engine(cmd);
+      break;
+    case 15:
+      test_paillier_packing(cmd);
+      break;
+    case 16:
+      test_paillier_key_pool(cmd);
+      break;
     default:
       std::cout << "error test protocol type\n";
     }
@@ -2,6 +2,7 @@
 
 #include <cryptoTools/Common/block.h>
 #include <cryptoTools/Crypto/PRNG.h>
+#include <filesystem>
 #include <ipcl/bignum.h>
 #include <ipcl/ciphertext.hpp>
 #include <ipcl/ipcl.hpp>
@@ -16,10 +17,21 @@
 #include <cryptoTools/Common/Defines.h>
 #include <openssl/ec.h>
 #include <openssl/pem.h>
+#include <unistd.h>
 #include <vector>
 
+#include "ahe/ec_elgamal_ahe.h"
+#include "ahe/paillier_ahe.h"
 #include "config.h"
+#include "net/frame.h"
+#include "net/net_emulator.h"
+#include "net/shm_channel.h"
+#include "paillier/engine.h"
+#include "paillier/key_pool.h"
+#include "paillier/rand_pool.h"
+#include "rb_okvs/encoding_file.h"
 #include "rb_okvs/rb_okvs.h"
+#include "rb_okvs/rb_okvs_binned.h"
 #include "rr22/Oprf.h"
 #include "rr22/Paxos.h"
 #include "utils/util.h"
@@ -96,6 +108,25 @@ void test_palliar(const oc::CLP &cmd) {
   auto bns_2 =
       block_vector_to_bignumers(blks, num_count, paillier_key.pub_key.getNSQ());
 
+  // the batch path has to give the same blocks on any number of threads
+  vector<block> blks_3(blks.size());
+  bignumers_to_blocks(bns, blks_3, cmd.getOr<u64>("t", 4));
+  if (blks_3 != blks) {
+    throw RTE_LOC;
+  }
+  // a value longer than a ciphertext is an error, not a crash of a worker
+  vector<BigNumber> too_long(bns);
+  too_long.back() = too_long.back() * too_long.back();
+  bool rejected = false;
+  try {
+    bignumers_to_blocks(too_long, blks_3, cmd.getOr<u64>("t", 4));
+  } catch (const std::runtime_error &) {
+    rejected = true;
+  }
+  if (!rejected) {
+    throw RTE_LOC;
+  }
+
   auto dec_pt = paillier_key.priv_key.decrypt(
       ipcl::CipherText(paillier_key.pub_key, bns_2));
 
@@ -253,4 +284,432 @@ void test_paxos(const oc::CLP &cmd) {
       }
     }
   }
-}
\ No newline at end of file
+}
+
+void test_okvs_encode(const oc::CLP &cmd) {
+  u64 n = 1ull << cmd.getOr("n", 16);
+  u64 t = cmd.getOr("t", 4);
+
+  std::vector<block> keys(n), values(n);
+  PRNG prng(oc::sysRandomSeed());
+  prng.get(keys.data(), n);
+  prng.get(values.data(), n);
+
+  for (u64 threads : {u64(1), t}) {
+    RBOKVS okvs;
+    okvs.init(n, OKVS_EPSILON, OKVS_LAMBDA, OKVS_SEED);
+    std::vector<block> encoding(okvs.mSize);
+
+    if (okvs.encode(keys.data(), values.data(), encoding.data(), threads) !=
+        EncodeStatus::SUCCESS) {
+      throw RTE_LOC;
+    }
+
+    for (u64 i = 0; i < n; i++) {
+      if (okvs.decode(encoding.data(), keys[i]) != values[i]) {
+        throw RTE_LOC;
+      }
+    }
+    spdlog::info("okvs encode with {} threads passed", threads);
+  }
+}
+
+void test_okvs_binned(const oc::CLP &cmd) {
+  u64 n = 1ull << cmd.getOr("n", 16);
+  u64 t = cmd.getOr("t", 4);
+
+  std::vector<block> keys(n), values(n), decoded(n);
+  PRNG prng(oc::sysRandomSeed());
+  prng.get(keys.data(), n);
+  prng.get(values.data(), n);
+
+  RBOKVSBinned okvs;
+  okvs.init(n, OKVS_EPSILON, OKVS_LAMBDA, OKVS_SEED);
+  std::vector<block> encoding(okvs.mSize);
+
+  if (okvs.encode(keys.data(), values.data(), encoding.data(), t) !=
+      EncodeStatus::SUCCESS) {
+    throw RTE_LOC;
+  }
+
+  okvs.decode(encoding.data(), keys.data(), n, decoded.data(), t);
+  if (decoded != values) {
+    throw RTE_LOC;
+  }
+  spdlog::info("binned okvs passed, {} bins of {} rows, overhead {:.3f}",
+               okvs.mNumBins, okvs.mItemsPerBin, okvs.overhead());
+}
+
+void test_net_emulator(const oc::CLP &cmd) {
+  NetProfile profile;
+  if (!NetProfile::parse(cmd.getOr<std::string>("net", "custom:100,20"),
+                         profile)) {
+    throw RTE_LOC;
+  }
+  u64 port = cmd.getOr<u64>("port", 1212);
+  u64 bytes = 1ull << cmd.getOr("n", 22);
+
+  NetEmulator emulator(profile, "127.0.0.1", port, 1);
+  coproto::Socket server, client;
+  std::thread accept_thrd([&]() {
+    server = coproto::asioConnect("127.0.0.1:" + std::to_string(port), true);
+  });
+  client = coproto::asioConnect(
+      "127.0.0.1:" + std::to_string(emulator.frontPort(0)), false);
+  accept_thrd.join();
+
+  // one way with the data and back with an ack, at least an rtt plus the
+  // time to put the data on the link
+  std::vector<u8> data(bytes, 7), received;
+  u8 ack = 1;
+  tVar timer;
+  tStart(timer);
+  coproto::sync_wait(client.send(data));
+  coproto::sync_wait(client.flush());
+  coproto::sync_wait(server.recvResize(received));
+  coproto::sync_wait(server.send(ack));
+  coproto::sync_wait(server.flush());
+  coproto::sync_wait(client.recv(ack));
+  double elapsed = tEnd(timer);
+
+  double expected = profile.mRttMs;
+  if (profile.mBandwidthMbps > 0) {
+    expected += bytes * 8 / (profile.mBandwidthMbps * 1e3);
+  }
+  if (received != data || elapsed + 1 < expected) {
+    throw RTE_LOC;
+  }
+  spdlog::info("net emulator passed, {}: {} bytes in {} ms, expected {} ms",
+               profile.toString(), bytes, elapsed, expected);
+}
+
+void test_frame(const oc::CLP &cmd) {
+  u64 n = cmd.getOr("n", 1000);
+  PRNG prng(oc::sysRandomSeed());
+  std::vector<block> blks(n);
+  prng.get(blks.data(), n);
+  std::vector<u64> words(n / 2 + 1, 7);
+
+  // a header and two payloads as one message over a socket pair
+  auto sockets = coproto::LocalAsyncSocket::makePair();
+  FrameWriter writer;
+  writer.put<u64>(n).putArray(blks).putArray(words);
+  coproto::sync_wait(sockets[0].send(std::move(writer.bytes())));
+  std::vector<u8> bytes;
+  coproto::sync_wait(sockets[1].recvResize(bytes));
+
+  FrameReader reader(bytes);
+  std::vector<block> blks_out(reader.get<u64>());
+  reader.getArray<block>(blks_out);
+  auto words_out = reader.getArray<u64>();
+  if (blks_out != blks || words_out != words || !reader.done()) {
+    throw RTE_LOC;
+  }
+
+  // a frame cut short or read with the wrong size is an error, not garbage
+  bool truncated = false;
+  try {
+    FrameReader short_reader(
+        std::vector<u8>(bytes.begin(), bytes.begin() + bytes.size() / 2));
+    short_reader.get<u64>();
+    short_reader.getArray<block>(blks_out);
+  } catch (const std::runtime_error &) {
+    truncated = true;
+  }
+  bool mismatched = false;
+  try {
+    FrameReader wrong_reader(bytes);
+    wrong_reader.get<u64>();
+    std::vector<block> too_small(n / 2);
+    wrong_reader.getArray<block>(too_small);
+  } catch (const std::runtime_error &) {
+    mismatched = true;
+  }
+  if (!truncated || !mismatched) {
+    throw RTE_LOC;
+  }
+  spdlog::info("frame passed, {} bytes in one message", bytes.size());
+}
+
+void test_shm_channel(const oc::CLP &cmd) {
+  u64 n = cmd.getOr("n", 1 << 20);
+  PRNG prng(oc::sysRandomSeed());
+  std::vector<u8> data(n * sizeof(block));
+  prng.get(data.data(), data.size());
+
+  // more than the ring holds, so both sides wait on each other
+  const string name = "/ufpsi-test-" + std::to_string(getpid());
+  auto creator = ShmChannel::create(name, 1 << 16);
+  auto opener = ShmChannel::open(name);
+  std::vector<u8> data_out(data.size());
+  // checked after the join, a throw on the thread would terminate
+  bool sent = false;
+  std::thread sender([&] { sent = creator->send(data.data(), data.size()); });
+  bool received = opener->recv(data_out.data(), data_out.size());
+  sender.join();
+  if (!sent || !received || data_out != data ||
+      creator->bytesSent() != data.size()) {
+    throw RTE_LOC;
+  }
+
+  // what was sent before a close still arrives, after it recv fails
+  u8 byte = 1;
+  opener->send(&byte, 1);
+  opener->close();
+  if (!creator->recv(&byte, 1) || creator->recv(&byte, 1) ||
+      creator->send(&byte, 1)) {
+    throw RTE_LOC;
+  }
+
+  // a handed off buffer is mapped by the peer rather than copied
+  EncodingBuffer owner(n, true);
+  prng.get(owner.data().data(), n);
+  std::vector<block> expected(owner.data().begin(), owner.data().end());
+  auto shared = owner.handOff();
+  EncodingBuffer adopted(n);
+  adopted.adopt(shared, n);
+  if (!std::equal(expected.begin(), expected.end(), adopted.data().begin()) ||
+      !owner.data().empty()) {
+    throw RTE_LOC;
+  }
+  spdlog::info("shm channel passed, {} bytes through a {} byte ring",
+               data.size(), 1 << 16);
+}
+
+void test_paillier_rand_pool(const oc::CLP &cmd) {
+  PRNG prng(oc::sysRandomSeed());
+  ipcl::KeyPair key = ipcl::generateKeypair(2048, true);
+  const u64 n = 100;
+
+  PaillierRandPool pool(key.pub_key);
+  pool.fill(n, cmd.getOr<u64>("t", 4));
+  vector<u64> plains(n);
+  for (u64 i = 0; i < n; i++) {
+    plains[i] = (i % 3 == 0) ? 0 : prng.get<u64>();
+  }
+
+  // half now, the rest from the pool saved in between
+  const string path = "paillier_rand_pool_test.bin";
+  const u64 half = n / 2;
+  const u64 split = half * PAILLIER_CIPHER_SIZE_IN_BLOCK;
+  vector<block> ciphers(n * PAILLIER_CIPHER_SIZE_IN_BLOCK);
+  pool.encrypt(std::span(plains).first(half), std::span(ciphers).first(split),
+               2);
+  pool.save(path);
+  PaillierRandPool loaded(key.pub_key);
+  if (!loaded.load(path) || loaded.size() != n - half ||
+      loaded.load(path)) {
+    throw RTE_LOC;
+  }
+  loaded.encrypt(std::span(plains).subspan(half),
+                 std::span(ciphers).subspan(split), 2);
+  if (loaded.size() != 0) {
+    throw RTE_LOC;
+  }
+
+  // a pool is only loaded for the key it was made for
+  ipcl::KeyPair other = ipcl::generateKeypair(2048, true);
+  PaillierRandPool other_pool(other.pub_key);
+  pool.save(path);
+  if (other_pool.load(path)) {
+    throw RTE_LOC;
+  }
+  std::remove(path.c_str());
+
+  auto dec = key.priv_key.decrypt(ipcl::CipherText(
+      key.pub_key, block_vector_to_bignumers(ciphers, n)));
+  for (u64 i = 0; i < n; i++) {
+    auto words = dec.getElementVec(i);
+    words.resize(2, 0);
+    if ((u64(words[1]) << 32 | words[0]) != plains[i]) {
+      throw RTE_LOC;
+    }
+  }
+  spdlog::info("paillier rand pool passed, {} encryptions", n);
+}
+
+void test_ahe(const oc::CLP &cmd) {
+  PRNG prng(oc::sysRandomSeed());
+  const u64 threads = cmd.getOr<u64>("t", 4);
+  const u64 n = 64, num_addends = 3;
+
+  ipcl::KeyPair key = ipcl::generateKeypair(2048, true);
+  auto ec = std::make_shared<EcElGamalAhe>();
+  vector<std::shared_ptr<AheScheme>> schemes = {
+      std::make_shared<PaillierAhe>(key.pub_key, key.priv_key), ec};
+
+  // a sum is zero iff all of its addends are
+  vector<u64> plains(num_addends * n, 0);
+  for (u64 i = 0; i < n; i++) {
+    if (i % 3 != 0) {
+      for (u64 a = 0; a < num_addends; a++) {
+        plains[a * n + i] = 1 + prng.get<u32>() % (1 << 20);
+      }
+    }
+  }
+  for (auto &ahe : schemes) {
+    const u64 cb = ahe->cipherBlocks();
+    vector<block> ciphers(plains.size() * cb), sums(n * cb);
+    ahe->encrypt(plains, ciphers, threads);
+    ahe->add(ciphers, sums, threads);
+    auto zero = ahe->isZero(sums, threads);
+    for (u64 i = 0; i < n; i++) {
+      if (zero[i] != (i % 3 == 0)) {
+        throw RTE_LOC;
+      }
+    }
+  }
+
+  // the encoded keys decode to zeros, the others to random values, and the
+  // public key alone encodes
+  const u64 num_keys = 1 << 10;
+  vector<block> keys(2 * num_keys);
+  prng.get(keys.data(), keys.size());
+  EcElGamalAhe public_ec(ec->publicKey());
+  vector<block> encoding(EcElGamalAhe::zeroEncodingBlocks(num_keys));
+  public_ec.encodeZeros(std::span(keys).first(num_keys), encoding, threads);
+  vector<block> decoded(keys.size() * EC_CIPHER_SIZE_IN_BLOCK);
+  EcElGamalAhe::decodeZeros(encoding, num_keys, keys, decoded, threads);
+  auto zero = ec->isZero(decoded, threads);
+  for (u64 i = 0; i < keys.size(); i++) {
+    if (zero[i] != (i < num_keys)) {
+      throw RTE_LOC;
+    }
+  }
+  spdlog::info("ahe passed, paillier and ec elgamal");
+}
+
+// the engine against one ipcl call for the decryption and a ciphertext per
+// addend for the sum, the path the protocols took before
+void test_paillier_engine(const oc::CLP &cmd) {
+  PRNG prng(oc::sysRandomSeed());
+  const u64 threads = cmd.getOr<u64>("t", 4);
+  const u64 n = 1ull << cmd.getOr("n", 10);
+  const u64 dim = cmd.getOr("d", 2);
+
+  ipcl::KeyPair key = ipcl::generateKeypair(2048, true);
+  vector<vector<u32>> plains(dim, vector<u32>(n));
+  vector<vector<BigNumber>> addends(dim);
+  for (u64 j = 0; j < dim; j++) {
+    for (auto &m : plains[j]) {
+      m = prng.get<u32>() >> 4;
+    }
+    addends[j] = key.pub_key.encrypt(ipcl::PlainText(plains[j])).getTexts();
+  }
+
+  tVar timer;
+  tStart(timer);
+  auto serial_sum = ipcl::CipherText(key.pub_key, addends[0]);
+  for (u64 j = 1; j < dim; j++) {
+    serial_sum = serial_sum + ipcl::CipherText(key.pub_key, addends[j]);
+  }
+  auto serial_dec = key.priv_key.decrypt(serial_sum);
+  auto serial_time = tEnd(timer);
+
+  PaillierEngine engine(key.pub_key, threads);
+  tStart(timer);
+  auto sum = engine.add(addends);
+  auto dec = engine.decrypt(key.priv_key, sum.getTexts());
+  auto engine_time = tEnd(timer);
+
+  for (u64 i = 0; i < n; i++) {
+    u64 expected = 0;
+    for (u64 j = 0; j < dim; j++) {
+      expected += plains[j][i];
+    }
+    if (dec.getElementVec(i)[0] != expected ||
+        serial_dec.getElementVec(i)[0] != expected) {
+      throw RTE_LOC;
+    }
+  }
+  spdlog::info("paillier engine passed, {} sums of {}: serial {} ms, "
+               "engine {} ms on {} threads",
+               n, dim, serial_time, engine_time, threads);
+}
+
+void test_paillier_packing(const oc::CLP &cmd) {
+  PRNG prng(oc::sysRandomSeed());
+  const u64 threads = cmd.getOr<u64>("t", 4);
+  const u64 n = 100, dim = 3;
+  // 60 bit values and 2 guard bits for the 3 addends
+  const u64 value_bits = 60, slot_bits = value_bits + 2;
+
+  ipcl::KeyPair key = ipcl::generateKeypair(2048, true);
+  vector<vector<BigNumber>> addends(dim);
+  vector<u64> sums(n, 0);
+  for (u64 j = 0; j < dim; j++) {
+    vector<u32> words(2 * n);
+    for (u64 i = 0; i < n; i++) {
+      u64 m = (i % 4 == 0) ? 0 : prng.get<u64>() >> (64 - value_bits);
+      sums[i] += m;
+      words[2 * i] = u32(m);
+      words[2 * i + 1] = u32(m >> 32);
+    }
+    for (u64 i = 0; i < n; i++) {
+      addends[j].push_back(key.pub_key
+                               .encrypt(ipcl::PlainText(BigNumber(
+                                   words.data() + 2 * i, 2)))
+                               .getElement(0));
+    }
+  }
+
+  PaillierEngine engine(key.pub_key, threads);
+  auto packed = engine.pack(engine.add(addends).getTexts(), slot_bits);
+  const u64 slots = PaillierEngine::slotsPerCipher(slot_bits);
+  if (packed.getSize() != (n + slots - 1) / slots) {
+    throw RTE_LOC;
+  }
+  auto values = PaillierEngine::unpack(
+      engine.decrypt(key.priv_key, packed.getTexts()), n, slot_bits);
+  if (values != sums) {
+    throw RTE_LOC;
+  }
+  spdlog::info("paillier packing passed, {} sums in {} ciphertexts", n,
+               packed.getSize());
+}
+
+void test_paillier_key_pool(const oc::CLP &cmd) {
+  ipcl::KeyPair key = ipcl::generateKeypair(2048, true);
+  const vector<u32> plains = {0, 1, 0xdeadbeef};
+
+  // a saved key decrypts what the original encrypts and back
+  const string path = "paillier_key_test.bin";
+  savePaillierKey(path, key);
+  auto loaded = loadPaillierKey(path);
+  std::remove(path.c_str());
+  if (!loaded || *loaded->pub_key.getN() != *key.pub_key.getN() ||
+      loadPaillierKey(path)) {
+    throw RTE_LOC;
+  }
+  auto there = loaded->priv_key.decrypt(
+      key.pub_key.encrypt(ipcl::PlainText(plains)));
+  auto back = key.priv_key.decrypt(
+      loaded->pub_key.encrypt(ipcl::PlainText(plains)));
+  for (u64 i = 0; i < plains.size(); i++) {
+    if (there.getElementVec(i)[0] != plains[i] ||
+        back.getElementVec(i)[0] != plains[i]) {
+      throw RTE_LOC;
+    }
+  }
+
+  // every key is handed out once, an empty pool still gives one
+  const string dir = "paillier_key_pool_test";
+  PaillierKeyPool pool(dir, 2);
+  pool.fill();
+  if (pool.size() != 2) {
+    throw RTE_LOC;
+  }
+  auto first = pool.take();
+  auto second = pool.take();
+  if (pool.size() != 0 || *first.pub_key.getN() == *second.pub_key.getN()) {
+    throw RTE_LOC;
+  }
+  auto fresh = pool.take();
+  auto dec = fresh.priv_key.decrypt(
+      fresh.pub_key.encrypt(ipcl::PlainText(plains)));
+  if (dec.getElementVec(2)[0] != plains[2]) {
+    throw RTE_LOC;
+  }
+  std::filesystem::remove_all(dir);
+  spdlog::info("paillier key pool passed");
+}
@@ -21,6 +21,26 @@ void test_okvs(const oc::CLP &cmd);
 
 void test_paxos(const oc::CLP &cmd);
 
+void test_okvs_encode(const oc::CLP &cmd);
+
+void test_okvs_binned(const oc::CLP &cmd);
+
+void test_net_emulator(const oc::CLP &cmd);
+
+void test_frame(const oc::CLP &cmd);
+
+void test_shm_channel(const oc::CLP &cmd);
+
+void test_paillier_rand_pool(const oc::CLP &cmd);
+
+void test_ahe(const oc::CLP &cmd);
+
+void test_paillier_engine(const oc::CLP &cmd);
+
+void test_paillier_packing(const oc::CLP &cmd);
+
+void test_paillier_key_pool(const oc::CLP &cmd);
+
 inline auto eval(macoro::task<> &t0, macoro::task<> &t1) {
   auto r =
       macoro::sync_wait(macoro::when_all_ready(std::move(t0), std::move(t1)));
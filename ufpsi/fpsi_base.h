@@ -1,7 +1,13 @@
 #pragma once
 #include "config.h"
+#include "net/frame.h"
+#include "paillier/rand_pool.h"
+#include "rb_okvs/encoding_file.h"
 #include "utils/util.h"
+#include <algorithm>
 #include <coproto/Socket/Socket.h>
+#include <coproto/coproto.h>
+#include <span>
 #include <vector>
 
 class FPSIBase {
@@ -12,6 +18,18 @@ public:
   std::vector<std::pair<string, double>> commus;
   vector<coproto::Socket> &sockets;
 
+  // directory of saved setup encodings, empty to encode on every run
+  string okvs_cache_dir;
+  MappedEncoding cached_encoding;
+  // hand setup encodings over as shared memory, both parties on one host
+  bool encoding_handoff = false;
+  // encrypt the setup values under the paillier key instead of standing in
+  // random blocks for the ciphertexts
+  bool real_setup = false;
+  // file of precomputed paillier randomness the setup draws from, empty to
+  // compute all of it in the setup
+  string rand_pool_path;
+
   void print_time() { fpsi_timer.print(); }
 
   void merge_timer(simpleTimer &other) { fpsi_timer.merge(other); }
@@ -28,5 +46,265 @@ public:
     sockets[socket_index].mImpl->mBytesSent = 0;
   }
 
+  // frames this party sent and received in a phase, and the turns it took. a
+  // turn is a run of sends between two receives and costs the peer one
+  // latency. the ot and oprf subprotocols use the sockets directly and are not
+  // counted
+  struct RoundAudit {
+    u64 frames_sent = 0;
+    u64 frames_recvd = 0;
+    u64 turns = 0;
+  };
+  RoundAudit round_audit;
+  std::vector<std::pair<string, RoundAudit>> rounds;
+
+  void insert_rounds(const string &phase) {
+    rounds.push_back({phase, round_audit});
+    round_audit = {};
+    audit_sending = false;
+  }
+
+  void print_rounds(const string &party) const {
+    for (auto &[phase, audit] : rounds) {
+      spdlog::info("[{}] {}: {} turns, {} frames sent, {} received", party,
+                   phase, audit.turns, audit.frames_sent, audit.frames_recvd);
+    }
+  }
+
+  // the frame is handed to the socket, no flush: the peer's receive is what
+  // the next step waits for
+  coproto::task<void> send_frame(FrameWriter &frame, u64 socket_index = 0) {
+    audit_send();
+    co_await sockets[socket_index].send(std::move(frame.bytes()));
+  }
+
+  coproto::task<FrameReader> recv_frame(u64 socket_index = 0) {
+    audit_recv();
+    std::vector<u8> bytes;
+    co_await sockets[socket_index].recvResize(bytes);
+    co_return FrameReader(std::move(bytes));
+  }
+
+  // a large array whose size the peer knows, from the frame it follows in the
+  // same turn or from the protocol parameters. it goes over as it is rather
+  // than being copied into a frame, split into one contiguous stripe per
+  // socket with all stripes in flight at once, and each stripe lands in place
+  coproto::task<void> send_payload(std::span<block> payload) {
+    audit_send();
+    co_await transfer_stripes(payload, true);
+  }
+
+  coproto::task<void> recv_payload(std::span<block> payload) {
+    audit_recv();
+    co_await transfer_stripes(payload, false);
+  }
+
+  // identifies the points, protocol parameters and paillier key a setup
+  // encoding was made from
+  static block setup_tag(const vector<pt> &pts, const vector<u64> &params,
+                         const BigNumber &n) {
+    blake3_hasher hasher;
+    block hash_out;
+    blake3_hasher_init(&hasher);
+    for (auto &p : pts) {
+      hasher_update_u64s(hasher, p);
+    }
+    hasher_update_u64s(hasher, params);
+    auto n_blks = bignumer_to_block_vector(n);
+    blake3_hasher_update(&hasher, n_blks.data(), n_blks.size() * 16);
+    blake3_hasher_finalize(&hasher, hash_out.data(), 16);
+    return hash_out;
+  }
+
+  // maps the saved encoding of name into cached_encoding, false if there is
+  // none for param, value_blocks and tag
+  bool load_setup_encoding(const string &name, const RBOKVSParam &param,
+                           u64 value_blocks, const block &tag) {
+    if (okvs_cache_dir.empty()) {
+      return false;
+    }
+    return cached_encoding.open(okvs_cache_dir + "/" + name + ".okvs", param,
+                                value_blocks, tag);
+  }
+
+  void store_setup_encoding(const string &name, const RBOKVSParam &param,
+                            u64 value_blocks, const block &tag,
+                            std::span<const block> encoding) {
+    if (okvs_cache_dir.empty()) {
+      return;
+    }
+    try {
+      saveEncoding(okvs_cache_dir + "/" + name + ".okvs", param, value_blocks,
+                   tag, encoding);
+    } catch (const std::runtime_error &e) {
+      // the run goes on without the cache
+      spdlog::warn("{}", e.what());
+    }
+  }
+
+  // paillier encryptions of plains, flat. the randomness comes from the pool
+  // at rand_pool_path, what it lacks is computed here in parallel batches
+  vector<block> setup_encrypt(const ipcl::PublicKey &pk,
+                              std::span<const u64> plains, u64 thread_num) {
+    PaillierRandPool pool(pk);
+    if (!rand_pool_path.empty() && !pool.load(rand_pool_path)) {
+      spdlog::info("no paillier randomness for this key in {}",
+                   rand_pool_path);
+    }
+    if (pool.size() < plains.size()) {
+      pool.fill(plains.size() - pool.size(), thread_num);
+    }
+    vector<block> ciphers(plains.size() * PAILLIER_CIPHER_SIZE_IN_BLOCK);
+    pool.encrypt(plains, ciphers, thread_num);
+    if (!rand_pool_path.empty() && pool.size() > 0) {
+      try {
+        pool.save(rand_pool_path);
+      } catch (const std::runtime_error &e) {
+        spdlog::warn("{}", e.what());
+      }
+    }
+    return ciphers;
+  }
+
+  // send an encoding of value_blocks wide values in chunks of
+  // STREAM_CHUNK_COLUMNS columns, last columns first, so the peer can decode
+  // while the rest is on the way. the chunks take turns on the sockets, with
+  // one chunk in flight per socket
+  coproto::task<void> send_encoding_stream(std::span<block> encoding,
+                                           u64 value_blocks,
+                                           EncodingBuffer *owner = nullptr) {
+    // on a shared memory transport the peer maps the buffer itself
+    FrameWriter mode;
+    if (encoding_handoff && owner && !owner->sharedName().empty() &&
+        owner->data().data() == encoding.data() &&
+        owner->data().size() == encoding.size()) {
+      std::string name = owner->handOff();
+      mode.put<u8>(1).putArray(std::span<const char>(name));
+      co_await send_frame(mode);
+      co_return;
+    }
+    mode.put<u8>(0);
+    co_await send_frame(mode);
+    audit_send();
+    const u64 columns = encoding.size() / value_blocks;
+    const u64 num_chunks = stream_chunks(columns);
+    const u64 num_socks = std::min<u64>(sockets.size(), num_chunks);
+    std::vector<macoro::eager_task<void>> pending;
+    pending.reserve(num_chunks);
+    for (u64 k = 0; k < num_chunks; ++k) {
+      if (k >= num_socks) {
+        co_await pending[k - num_socks];
+      }
+      pending.push_back(transfer(k % num_socks,
+                                 stream_chunk(encoding, value_blocks, k),
+                                 true) |
+                        macoro::make_eager());
+    }
+    for (u64 k = num_chunks - num_socks; k < num_chunks; ++k) {
+      co_await pending[k];
+    }
+  }
+
+  // receive an encoding sent by send_encoding_stream. on_arrived(lo) runs
+  // every time the columns [lo, columns) are complete, while the sockets
+  // already receive the chunks below them. a handed off encoding replaces the
+  // mapping of buffer and arrives all at once
+  template <typename Fn>
+  coproto::task<void> recv_encoding_stream(EncodingBuffer &buffer,
+                                           u64 value_blocks, Fn on_arrived) {
+    auto mode = co_await recv_frame();
+    if (mode.get<u8>() == 1) {
+      auto name = mode.getArray<char>();
+      buffer.adopt(string(name.begin(), name.end()), buffer.data().size());
+      on_arrived(0);
+      co_return;
+    }
+    audit_recv();
+    std::span<block> encoding = buffer.data();
+    const u64 columns = encoding.size() / value_blocks;
+    const u64 num_chunks = stream_chunks(columns);
+    const u64 num_socks = std::min<u64>(sockets.size(), num_chunks);
+    std::vector<macoro::eager_task<void>> pending;
+    pending.reserve(num_chunks);
+    for (u64 k = 0; k < num_socks; ++k) {
+      pending.push_back(
+          transfer(k, stream_chunk(encoding, value_blocks, k), false) |
+          macoro::make_eager());
+    }
+    for (u64 k = 0; k < num_chunks; ++k) {
+      co_await pending[k];
+      // the socket of chunk k goes on with its next chunk during the decode
+      if (k + num_socks < num_chunks) {
+        pending.push_back(
+            transfer(k % num_socks,
+                     stream_chunk(encoding, value_blocks, k + num_socks),
+                     false) |
+            macoro::make_eager());
+      }
+      on_arrived(columns - std::min(columns, (k + 1) * STREAM_CHUNK_COLUMNS));
+    }
+  }
+
   virtual ~FPSIBase() = default;
+
+private:
+  bool audit_sending = false;
+
+  void audit_send() {
+    round_audit.frames_sent++;
+    if (!audit_sending) {
+      round_audit.turns++;
+      audit_sending = true;
+    }
+  }
+
+  void audit_recv() {
+    round_audit.frames_recvd++;
+    audit_sending = false;
+  }
+
+  static u64 stream_chunks(u64 columns) {
+    return (columns + STREAM_CHUNK_COLUMNS - 1) / STREAM_CHUNK_COLUMNS;
+  }
+
+  // chunk k of a stream, counted from the last columns
+  static std::span<block> stream_chunk(std::span<block> encoding,
+                                       u64 value_blocks, u64 k) {
+    const u64 columns = encoding.size() / value_blocks;
+    const u64 hi = columns - k * STREAM_CHUNK_COLUMNS;
+    const u64 lo = hi > STREAM_CHUNK_COLUMNS ? hi - STREAM_CHUNK_COLUMNS : 0;
+    return encoding.subspan(lo * value_blocks, (hi - lo) * value_blocks);
+  }
+
+  coproto::task<void> transfer(u64 s, std::span<block> data, bool sending) {
+    if (sending) {
+      co_await sockets[s].send(data);
+    } else {
+      co_await sockets[s].recv(data);
+    }
+  }
+
+  // one contiguous stripe of data per socket, all of them started before the
+  // first is awaited
+  coproto::task<void> transfer_stripes(std::span<block> data, bool sending) {
+    const u64 num_socks = data.size() < STRIPE_MIN_BLOCKS ? 1 : sockets.size();
+    const u64 stripe_size = (data.size() + num_socks - 1) / num_socks;
+    std::vector<macoro::eager_task<void>> pending;
+    for (u64 s = 0; s < num_socks; ++s) {
+      const u64 start = std::min<u64>(data.size(), s * stripe_size);
+      const u64 end = std::min<u64>(data.size(), start + stripe_size);
+      pending.push_back(transfer(s, data.subspan(start, end - start), sending) |
+                        macoro::make_eager());
+    }
+    for (auto &stripe : pending) {
+      co_await stripe;
+    }
+  }
+
+  static void hasher_update_u64s(blake3_hasher &hasher,
+                                 const vector<u64> &vals) {
+    u64 size = vals.size();
+    blake3_hasher_update(&hasher, &size, sizeof(size));
+    blake3_hasher_update(&hasher, vals.data(), size * sizeof(u64));
+  }
 };
\ No newline at end of file
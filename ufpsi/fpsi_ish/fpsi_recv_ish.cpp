@@ -1,6 +1,8 @@
 #include "fpsi_recv_ish.h"
+#include "ahe/ec_elgamal_ahe.h"
 #include "config.h"
 #include "rb_okvs/rb_okvs.h"
+#include "rb_okvs/rb_okvs_fixed.h"
 #include "rr22/Oprf.h"
 #include "rr22/Paxos.h"
 #include "utils/util.h"
@@ -95,7 +97,7 @@ void PsiRecvISH::offline_hash() {
   }
 }
 
-void PsiRecvISH::online_hash() {
+coproto::task<void> PsiRecvISH::online_hash() {
 
   // PSV sender offline
   vector<block> psv_r(DIM);
@@ -109,7 +111,7 @@ void PsiRecvISH::online_hash() {
 
   /// PSV sender Step 1
   volePSI::RsOprfSender oprfSender;
-  coproto::sync_wait(oprfSender.send(OTHER_PTS_NUM * DIM, prng, sockets[0]));
+  co_await oprfSender.send(OTHER_PTS_NUM * DIM, prng, sockets[0], THREAD_NUM);
 
   /// PSV sender Step 2
   vector<vector<block>> okvr_keys(DIM);
@@ -123,7 +125,7 @@ void PsiRecvISH::online_hash() {
 
   for (u64 i = 0; i < DIM; i++) {
     oprf_eval_values[i].resize(shash_keys_blocks[i].size());
-    oprfSender.eval(shash_keys_blocks[i], oprf_eval_values[i]);
+    oprfSender.eval(shash_keys_blocks[i], oprf_eval_values[i], THREAD_NUM);
   }
 
   vector<vector<block>> okvr_values(DIM);
@@ -139,30 +141,36 @@ void PsiRecvISH::online_hash() {
     padding_keys(okvr_keys[i], PTS_NUM * (2 * DELTA + 1));
   }
 
+  // the DIM encodes have the same size and reuse one arena
+  RowArena okvs_arena;
   vector<RBOKVS> rb_okvs_vec;
   rb_okvs_vec.resize(DIM);
   for (u64 i = 0; i < DIM; i++) {
     rb_okvs_vec[i].init(PTS_NUM * (2 * DELTA + 1), OKVS_EPSILON, OKVS_LAMBDA,
                         OKVS_SEED);
+    rb_okvs_vec[i].mArena = &okvs_arena;
   }
 
   // encode
   auto okvr_mSize = rb_okvs_vec[0].mSize;
   vector<vector<block>> encodings(DIM, vector<block>(okvr_mSize, ZeroBlock));
 
-  for (u64 i = 0; i < DIM; i++) {
-    rb_okvs_vec[i].encode(okvr_keys[i].data(), okvr_values[i].data(),
-                          encodings[i].data());
-  }
+  FrameWriter okvr_header;
+  okvr_header.put<u64>(okvr_mSize);
+  co_await send_frame(okvr_header);
 
-  coproto::sync_wait(sockets[0].send(okvr_mSize));
-  coproto::sync_wait(sockets[0].flush());
-
-  auto tmp_com = sockets[0].mImpl->mBytesSent;
+  // each dim is on its way while the next one encodes
+  std::vector<macoro::eager_task<void>> sending;
+  sending.reserve(DIM);
   for (u64 i = 0; i < DIM; i++) {
-    coproto::sync_wait(sockets[0].send(encodings[i]));
+    rb_okvs_vec[i].encode(okvr_keys[i].data(), okvr_values[i].data(),
+                          encodings[i].data(), THREAD_NUM);
+    if (i > 0) {
+      co_await sending[i - 1];
+    }
+    sending.push_back(send_payload(encodings[i]) | macoro::make_eager());
   }
-  coproto::sync_wait(sockets[0].flush());
+  co_await sending.back();
 
   shash_keys.clear();
   shash_keys_blocks.clear();
@@ -174,53 +182,57 @@ void PsiRecvISH::online_hash() {
 
 void PsiRecvISH::setup() {
   u64 okvr_size = PTS_NUM * DIM * (2 * DELTA + 1);
-  // note: random gen
-  // ipcl::initializeContext("QAT");
-  // ipcl::setHybridMode(ipcl::HybridMode::OPTIMAL);
-
-  // vector<u32> zero_vec(2 * DELTA + 1, 0);
-  // ipcl::PlainText zero_plain = ipcl::PlainText(zero_vec);
-  // ipcl::CipherText zero_ciphers = palliar_pk.encrypt(zero_plain);
-  // auto zero_ciphers_blks =
-  // bignumers_to_blocks_vector(zero_ciphers.getTexts());
-
-  // ipcl::terminateContext();
-
-  // vector<block> keys(okvr_size);
-  // vector<vector<block>> values(okvr_size);
-
-  // u64 tmplen2 = 2 * DELTA + 1;
-  // u64 tmplen1 = DIM * (2 * DELTA + 1);
-
-  // for (u64 i = 0; i < PTS_NUM; i++) {
-  //   for (u64 j = 0; j < DIM; j++) {
-  //     auto start = pts[i][j] - DELTA;
-  //     auto end = pts[i][j] + DELTA;
-  //     u64 count = 0;
-  //     for (u64 ii = start; ii <= end; ii++) {
-  //       auto tmp = i * tmplen1 + j * tmplen2 + count;
-  //       keys[tmp] = get_key_from_sum_dim_x(H1_sums[i], j, ii);
-  //       values[tmp] = zero_ciphers_blks[count];
-  //       count++;
-  //     }
-  //   }
-  // }
-
-  // RBOKVS rb_okvs;
-  // rb_okvs.init(okvr_size, OKVS_EPSILON, OKVS_LAMBDA, OKVS_SEED);
-
-  // setup_encoding.resize(rb_okvs.mSize,
-  //                       vector<block>(PAILLIER_CIPHER_SIZE_IN_BLOCK));
-  // rb_okvs.encode(keys, values, PAILLIER_CIPHER_SIZE_IN_BLOCK,
-  // setup_encoding);
+  // a fresh encryption of zero under every x within DELTA of a point
+  auto zero_keys = [&]() {
+    vector<block> keys(okvr_size);
+    const u64 span_len = 2 * DELTA + 1;
+    parallel_for(PTS_NUM, THREAD_NUM, [&](u64 start, u64 end) {
+      for (u64 i = start; i < end; i++) {
+        for (u64 j = 0; j < DIM; j++) {
+          for (u64 x = 0; x < span_len; x++) {
+            keys[(i * DIM + j) * span_len + x] =
+                get_key_from_sum_dim_x(H1_sums[i], j, pts[i][j] - DELTA + x);
+          }
+        }
+      }
+    });
+    return keys;
+  };
 
-  RBOKVS rb_okvs;
-  rb_okvs.init(okvr_size, OKVS_EPSILON, OKVS_LAMBDA, OKVS_SEED);
+  if (ahe->kind() == AheKind::EcElGamal) {
+    // always real, random bytes would not decode to points
+    setup_encoding.allocate(EcElGamalAhe::zeroEncodingBlocks(okvr_size),
+                            encoding_handoff);
+    setup_view = setup_encoding.data();
+    auto &ec = static_cast<const EcElGamalAhe &>(*ahe);
+    ec.encodeZeros(zero_keys(), setup_view, THREAD_NUM);
+    H1_sums.clear();
+    H1_sums.shrink_to_fit();
+    return;
+  }
 
-  setup_encoding.resize(rb_okvs.mSize,
-                        vector<block>(PAILLIER_CIPHER_SIZE_IN_BLOCK));
-  for (auto tmp : setup_encoding) {
-    prng.get<block>(tmp.data(), PAILLIER_CIPHER_SIZE_IN_BLOCK);
+  RBOKVS_Fixed<PAILLIER_CIPHER_SIZE_IN_BLOCK> rb_okvs;
+  auto param = rb_okvs.getParams(okvr_size, OKVS_EPSILON, OKVS_LAMBDA,
+                                 OKVS_SEED);
+  rb_okvs.init(param);
+
+  auto tag = setup_tag(pts, {DIM, DELTA, real_setup}, *palliar_pk.getN());
+  const string cache_name = "recv_ish";
+  if (load_setup_encoding(cache_name, param, PAILLIER_CIPHER_SIZE_IN_BLOCK,
+                          tag)) {
+    setup_view = cached_encoding.data();
+  } else {
+    setup_encoding.allocate(rb_okvs.encodingSize(), encoding_handoff);
+    setup_view = setup_encoding.data();
+    if (real_setup) {
+      vector<u64> zeros(okvr_size, 0);
+      auto values = setup_encrypt(palliar_pk, zeros, THREAD_NUM);
+      rb_okvs.encode(zero_keys(), values, setup_view);
+    } else {
+      prng.get<block>(setup_view.data(), setup_view.size());
+    }
+    store_setup_encoding(cache_name, param, PAILLIER_CIPHER_SIZE_IN_BLOCK,
+                         tag, setup_view);
   }
 
   H1_sums.clear();
@@ -232,66 +244,41 @@ void PsiRecvISH::offline() {
   setup();
 }
 
-void PsiRecvISH::online() {
-  online_hash();
+coproto::task<void> PsiRecvISH::online() {
+  co_await online_hash();
 
   u64 setup_mN = PTS_NUM * DIM * (2 * DELTA + 1);
-  coproto::sync_wait(sockets[0].send(setup_mN));
-  coproto::sync_wait(sockets[0].send(setup_encoding.size()));
-  coproto::sync_wait(sockets[0].flush());
-
-  auto flat_encode_blocks = flattenBlocks(setup_encoding);
+  const u64 cipher_blocks = ahe->cipherBlocks();
+  u64 setup_mSize = setup_view.size() / cipher_blocks;
+  FrameWriter setup_header;
+  setup_header.put<u64>(setup_mN).put<u64>(setup_mSize);
+  co_await send_frame(setup_header);
 
   auto tmp_com = sockets[0].bytesSent();
 
-  auto flat_size = flat_encode_blocks.size();
-  auto deal = flat_size / COM_CHUNK_SIZE;
-  auto remainder = flat_size % COM_CHUNK_SIZE;
+  co_await send_encoding_stream(setup_view, cipher_blocks, &setup_encoding);
 
-  for (u64 i = 0; i < deal; i++) {
-    std::span<block> view(flat_encode_blocks.data() + i * COM_CHUNK_SIZE,
-                          COM_CHUNK_SIZE);
-    coproto::sync_wait(sockets[0].send(view));
-  }
+  auto sum_frame = co_await recv_frame();
+  u64 sum_size = sum_frame.get<u64>();
+  vector<block> sum_blks(sum_size * cipher_blocks);
+  co_await recv_payload(sum_blks);
 
-  std::span<block> view(flat_encode_blocks.data() + deal * COM_CHUNK_SIZE,
-                        remainder);
-  coproto::sync_wait(sockets[0].send(view));
-  coproto::sync_wait(sockets[0].flush());
-
-  u64 sum_size;
-  coproto::sync_wait(sockets[0].recv(sum_size));
-  coproto::sync_wait(sockets[0].flush());
-  vector<block> sum_blks(sum_size * PAILLIER_CIPHER_SIZE_IN_BLOCK);
-  coproto::sync_wait(sockets[0].recvResize(sum_blks));
-  coproto::sync_wait(sockets[0].flush());
-
-  setup_encoding.clear();
-  setup_encoding.shrink_to_fit();
-
-  auto sum_bns = block_vector_to_bignumers(sum_blks, sum_size);
-  auto sum_dec = palliar_sk.decrypt(ipcl::CipherText(palliar_pk, sum_bns));
+  // the base ots do not depend on the sums and run while they are tested
+  osuCrypto::DefaultBaseOT baseOTs;
+  vector<array<block, 2>> baseSend(128);
+  prng.get((u8 *)baseSend.data()->data(), sizeof(block) * 2 * baseSend.size());
+  auto base_ots =
+      baseOTs.send(baseSend, prng, sockets[0]) | macoro::make_eager();
 
-  vector<u64> sum(sum_size);
-  for (u64 i = 0; i < sum_size; i++) {
-    auto tmp = sum_dec.getElementVec(i);
-    sum[i] = tmp[0];
-  }
+  setup_encoding.release();
+  setup_view = {};
+  cached_encoding.close();
 
-  for (auto tmp : sum) {
-    if (tmp == 0) {
-      psi_ca_result = psi_ca_result + 1;
-    }
-  }
+  auto sum_zero = ahe->isZero(sum_blks, THREAD_NUM);
+  psi_ca_result += std::count(sum_zero.begin(), sum_zero.end(), 1);
 
   u64 numOTs = OTHER_PTS_NUM * DIM;
-  // baseOT send
-  osuCrypto::DefaultBaseOT baseOTs;
-  vector<array<block, 2>> baseSend(128);
-  prng.get((u8 *)baseSend.data()->data(), sizeof(block) * 2 * baseSend.size());
-  auto p = baseOTs.send(baseSend, prng, sockets[0]);
-  auto r = macoro::sync_wait(macoro::when_all_ready(std::move(p)));
-  std::get<0>(r).result();
+  co_await base_ots;
 
   // iknp recv
   IknpOtExtReceiver recv;
@@ -302,21 +289,20 @@ void PsiRecvISH::online() {
 
   BitVector s0(numOTs);
   for (u64 i = 0; i < OTHER_PTS_NUM; i++) {
-    if (sum[i] == 0) {
+    if (sum_zero[i]) {
       for (u64 j = 0; j < DIM; j++) {
         s0[i * DIM + j] = 1;
       }
     }
   }
 
-  auto proto = recv.receive(s0, recvMsg, prng, sockets[0]);
-  auto result = macoro::sync_wait(macoro::when_all_ready(std::move(proto)));
-  std::get<0>(result).result();
+  co_await recv.receive(s0, recvMsg, prng, sockets[0]);
 
   vector<block> mask_msg_0(numOTs);
   vector<block> mask_msg_1(numOTs);
-  coproto::sync_wait(sockets[0].recv(mask_msg_0));
-  coproto::sync_wait(sockets[0].recv(mask_msg_1));
+  auto mask_frame = co_await recv_frame();
+  mask_frame.getArray<block>(mask_msg_0);
+  mask_frame.getArray<block>(mask_msg_1);
 
   for (u64 i = 0; i < numOTs; i++) {
     recvMsg[i] =
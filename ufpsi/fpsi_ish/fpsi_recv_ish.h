@@ -2,6 +2,7 @@
 #include <coproto/Socket/Socket.h>
 #include <cryptoTools/Common/Defines.h>
 #include <cryptoTools/Common/block.h>
+#include <memory>
 #include <vector>
 
 #include <ipcl/bignum.h>
@@ -10,6 +11,7 @@
 #include <ipcl/pri_key.hpp>
 #include <ipcl/pub_key.hpp>
 
+#include "ahe/paillier_ahe.h"
 #include "config.h"
 #include "fpsi_base.h"
 #include "rb_okvs/rb_okvs.h"
@@ -26,6 +28,8 @@ public:
   vector<pt> &pts;
   const ipcl::PublicKey palliar_pk;
   const ipcl::PrivateKey palliar_sk;
+  // the scheme of the zero test, paillier under the keys above by default
+  std::shared_ptr<AheScheme> ahe;
 
   // shash datas
   vector<vector<u64>> shash_keys;
@@ -35,7 +39,9 @@ public:
   vector<block> H1_sums;
 
   //
-  vector<vector<block>> setup_encoding;
+  EncodingBuffer setup_encoding;
+  // what online() sends, setup_encoding or the mapping of a saved encoding
+  std::span<block> setup_view;
 
   u64 psi_ca_result = 0;
 
@@ -54,12 +60,13 @@ public:
         THREAD_NUM(thread_num), palliar_pk(pk), palliar_sk(sk), pts(pts),
         FPSIBase(sockets) {
     prng.SetSeed(oc::sysRandomSeed());
+    ahe = std::make_shared<PaillierAhe>(pk, sk);
   };
 
   void offline_hash();
   void setup();
 
-  void online_hash();
+  coproto::task<void> online_hash();
   void offline();
-  void online();
+  coproto::task<void> online();
 };
\ No newline at end of file
@@ -1,6 +1,8 @@
 #include "fpsi_sender_ish.h"
+#include "ahe/ec_elgamal_ahe.h"
 #include "config.h"
 #include "rb_okvs/rb_okvs.h"
+#include "rb_okvs/rb_okvs_stream.h"
 #include "rr22/Oprf.h"
 #include "utils/util.h"
 
@@ -29,39 +31,47 @@ void PsiSenderISH::offline_hash() {
   }
 }
 
-void PsiSenderISH::online_hash() {
+coproto::task<void> PsiSenderISH::online_hash() {
 
   /// PSV Recv Step 1
 
   vector<block> oprf_vals(PTS_NUM * DIM);
 
   volePSI::RsOprfReceiver oprfRecv;
-  coproto::sync_wait(oprfRecv.receive(oprf_keys, oprf_vals, prng, sockets[0]));
+  co_await oprfRecv.receive(oprf_keys, oprf_vals, prng, sockets[0], THREAD_NUM);
 
   spdlog::debug("P2 Step 1 oprf finished");
 
   /// PSV Recv Step 3 and Step 4
   u64 mN = OTHER_PTS_NUM * (2 * DELTA + 1);
-  u64 mSize;
-  coproto::sync_wait(sockets[0].recv(mSize));
-  coproto::sync_wait(sockets[0].flush());
+  u64 mSize = (co_await recv_frame()).get<u64>();
 
   vector<vector<block>> encodings(DIM, vector<block>(mSize));
-
-  for (u64 i = 0; i < DIM; i++) {
-    coproto::sync_wait(sockets[0].recvResize(encodings[i]));
-  }
-  coproto::sync_wait(sockets[0].flush());
+  // dim j is decoded while the next one is received
+  std::vector<macoro::eager_task<void>> receiving;
+  receiving.reserve(DIM);
+  receiving.push_back(recv_payload(encodings[0]) | macoro::make_eager());
 
   RBOKVS rb_okvs;
   rb_okvs.init(mN, OKVS_EPSILON, OKVS_LAMBDA, OKVS_SEED);
 
   H2_sums.resize(PTS_NUM, ZeroBlock);
 
-  for (u64 i = 0; i < PTS_NUM; i++) {
-    for (u64 j = 0; j < DIM; j++) {
-      auto tmp = rb_okvs.decode(encodings[j].data(), block(pts[i][j], j));
-      H2_sums[i] = H2_sums[i] ^ tmp ^ oprf_vals[i * DIM + j];
+  vector<block> decode_keys(PTS_NUM);
+  vector<block> decode_vals(PTS_NUM);
+  for (u64 j = 0; j < DIM; j++) {
+    for (u64 i = 0; i < PTS_NUM; i++) {
+      decode_keys[i] = block(pts[i][j], j);
+    }
+    co_await receiving[j];
+    if (j + 1 < DIM) {
+      receiving.push_back(recv_payload(encodings[j + 1]) |
+                          macoro::make_eager());
+    }
+    rb_okvs.decode(encodings[j].data(), decode_keys.data(), PTS_NUM,
+                   decode_vals.data(), THREAD_NUM);
+    for (u64 i = 0; i < PTS_NUM; i++) {
+      H2_sums[i] = H2_sums[i] ^ decode_vals[i] ^ oprf_vals[i * DIM + j];
     }
   }
 
@@ -71,62 +81,55 @@ void PsiSenderISH::online_hash() {
 
 void PsiSenderISH::offline() { offline_hash(); }
 
-void PsiSenderISH::online() {
-  online_hash();
-
-  u64 setup_mN;
-  u64 setup_mSize;
-  coproto::sync_wait(sockets[0].recv(setup_mN));
-  coproto::sync_wait(sockets[0].recv(setup_mSize));
-  coproto::sync_wait(sockets[0].flush());
-
-  auto flat_encoding = setup_mSize * PAILLIER_CIPHER_SIZE_IN_BLOCK;
-  auto deal = flat_encoding / COM_CHUNK_SIZE;
-  auto remainder = flat_encoding % COM_CHUNK_SIZE;
-
-  vector<block> setup_encoding_flat;
-  setup_encoding_flat.reserve(setup_mSize * PAILLIER_CIPHER_SIZE_IN_BLOCK);
-
-  for (u64 i = 0; i < deal; i++) {
-    vector<block> tmp_block(COM_CHUNK_SIZE);
-    coproto::sync_wait(sockets[0].recvResize(tmp_block));
-    setup_encoding_flat.insert(setup_encoding_flat.end(), tmp_block.begin(),
-                               tmp_block.end());
-  }
-  vector<block> last_blocks(remainder);
-  coproto::sync_wait(sockets[0].recvResize(last_blocks));
-  setup_encoding_flat.insert(setup_encoding_flat.end(), last_blocks.begin(),
-                             last_blocks.end());
-
-  vector<vector<block>> setup_encoding =
-      chunkFixedSizeBlocks(setup_encoding_flat, PAILLIER_CIPHER_SIZE_IN_BLOCK);
-
-  RBOKVS decode_okvs;
-  decode_okvs.init(setup_mN, OKVS_EPSILON, OKVS_LAMBDA, OKVS_SEED);
-
-  vector<vector<BigNumber>> decode_bns(DIM);
-
-  for (u64 i = 0; i < PTS_NUM; i++) {
-    for (u64 j = 0; j < DIM; j++) {
-      auto tmp_key = get_key_from_sum_dim_x(H2_sums[i], j, pts[i][j]);
-      auto tmp_res = decode_okvs.decode(setup_encoding, tmp_key,
-                                        PAILLIER_CIPHER_SIZE_IN_BLOCK);
-      decode_bns[j].push_back(block_vector_to_bignumer(tmp_res));
+coproto::task<void> PsiSenderISH::online() {
+  co_await online_hash();
+
+  auto setup_header = co_await recv_frame();
+  u64 setup_mN = setup_header.get<u64>();
+  u64 setup_mSize = setup_header.get<u64>();
+
+  // the keys of every dim are known before the encoding arrives
+  vector<block> decode_keys(DIM * PTS_NUM);
+  parallel_for(PTS_NUM, THREAD_NUM, [&](u64 start, u64 end) {
+    for (u64 i = start; i < end; i++) {
+      for (u64 j = 0; j < DIM; j++) {
+        decode_keys[j * PTS_NUM + i] =
+            get_key_from_sum_dim_x(H2_sums[i], j, pts[i][j]);
+      }
     }
+  });
+  const u64 cipher_blocks = ahe->cipherBlocks();
+  vector<block> decode_blks(DIM * PTS_NUM * cipher_blocks);
+
+  // the chunks land in place and are decoded there, the encoding is the only
+  // copy and is unmapped once every key is decoded
+  EncodingBuffer setup_encoding(setup_mSize * cipher_blocks);
+  if (ahe->kind() == AheKind::Paillier) {
+    // each key is decoded as soon as the columns of its band are in
+    RBOKVS decode_okvs;
+    decode_okvs.init(setup_mN, OKVS_EPSILON, OKVS_LAMBDA, OKVS_SEED);
+    RBOKVSStreamDecoder decoder(decode_okvs, decode_keys, cipher_blocks,
+                                decode_blks, THREAD_NUM);
+    co_await recv_encoding_stream(
+        setup_encoding, cipher_blocks,
+        [&](u64 lo) { decoder.advance(setup_encoding.data().data(), lo); });
+  } else {
+    // a ristretto encoding is decoded once all of it is in
+    co_await recv_encoding_stream(setup_encoding, cipher_blocks, [](u64) {});
+    EcElGamalAhe::decodeZeros(setup_encoding.data(), setup_mN, decode_keys,
+                              decode_blks, THREAD_NUM);
   }
+  setup_encoding.release();
 
-  auto dim0 = ipcl::CipherText(palliar_pk, decode_bns[0]);
-  for (u64 i = 1; i < DIM; i++) {
-    auto tmp = ipcl::CipherText(palliar_pk, decode_bns[i]);
-    dim0 = dim0 + tmp;
-  }
-
-  auto add_cipher_blks = bignumers_to_block_vector(dim0.getTexts());
-  coproto::sync_wait(sockets[0].send(dim0.getSize()));
-  coproto::sync_wait(sockets[0].flush());
+  vector<block> sum_blks(PTS_NUM * cipher_blocks);
+  ahe->add(decode_blks, sum_blks, THREAD_NUM);
+  decode_blks.clear();
+  decode_blks.shrink_to_fit();
 
-  coproto::sync_wait(sockets[0].send(add_cipher_blks));
-  coproto::sync_wait(sockets[0].flush());
+  FrameWriter sum_frame;
+  sum_frame.put<u64>(PTS_NUM);
+  co_await send_frame(sum_frame);
+  co_await send_payload(sum_blks);
 
   const u64 numOTs = PTS_NUM * DIM;
   // baseOT recv
@@ -135,9 +138,7 @@ void PsiSenderISH::online() {
   BitVector baseChoice(128);
   baseChoice.randomize(prng);
 
-  auto p = baseOTs.receive(baseChoice, baseRecv, prng, sockets[0]);
-  auto r = macoro::sync_wait(macoro::when_all_ready(std::move(p)));
-  std::get<0>(r).result();
+  co_await baseOTs.receive(baseChoice, baseRecv, prng, sockets[0]);
 
   // iknp sender
   IknpOtExtSender sender;
@@ -146,9 +147,7 @@ void PsiSenderISH::online() {
   vector<block> half_sendMsg_0(numOTs);
   vector<block> half_sendMsg_1(numOTs);
 
-  auto proto = sender.send(sendMsg, prng, sockets[0]);
-  auto result = macoro::sync_wait(macoro::when_all_ready(std::move(proto)));
-  std::get<0>(result).result();
+  co_await sender.send(sendMsg, prng, sockets[0]);
 
   // random OT -> OT
   for (u64 i = 0; i < PTS_NUM; i++) {
@@ -157,6 +156,7 @@ void PsiSenderISH::online() {
       half_sendMsg_1[i * DIM + j] = block(pts[i][j]) ^ sendMsg[i][1];
     }
   }
-  coproto::sync_wait(sockets[0].send(half_sendMsg_0));
-  coproto::sync_wait(sockets[0].send(half_sendMsg_1));
+  FrameWriter mask_frame;
+  mask_frame.putArray(half_sendMsg_0).putArray(half_sendMsg_1);
+  co_await send_frame(mask_frame);
 }
\ No newline at end of file
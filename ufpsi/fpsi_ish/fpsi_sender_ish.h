@@ -1,5 +1,6 @@
 #pragma once
 #include <coproto/Socket/Socket.h>
+#include <memory>
 #include <vector>
 
 #include <cryptoTools/Common/block.h>
@@ -8,6 +9,7 @@
 #include <ipcl/ipcl.hpp>
 #include <ipcl/pri_key.hpp>
 
+#include "ahe/paillier_ahe.h"
 #include "config.h"
 #include "fpsi_base.h"
 #include "utils/util.h"
@@ -24,6 +26,8 @@ public:
 
   const ipcl::PublicKey palliar_pk;
   const ipcl::PrivateKey palliar_sk;
+  // the scheme of the zero test, paillier under the keys above by default
+  std::shared_ptr<AheScheme> ahe;
 
   // shash datas
   PRNG prng;
@@ -53,11 +57,12 @@ public:
         FPSIBase(sockets) {
 
     prng.SetSeed(oc::sysRandomSeed());
+    ahe = std::make_shared<PaillierAhe>(pk, sk);
   };
 
   void offline_hash();
   void offline();
 
-  void online_hash();
-  void online();
+  coproto::task<void> online_hash();
+  coproto::task<void> online();
 };
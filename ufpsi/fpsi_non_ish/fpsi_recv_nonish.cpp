@@ -1,9 +1,12 @@
 #include "fpsi_recv_nonish.h"
+#include "ahe/ec_elgamal_ahe.h"
 #include "config.h"
 #include "rb_okvs/rb_okvs.h"
+#include "rb_okvs/rb_okvs_fixed.h"
 #include "rr22/Paxos.h"
 #include "utils/util.h"
 
+#include <algorithm>
 #include <ipcl/utils/context.hpp>
 #include <libOTe/Base/BaseOT.h>
 #include <libOTe/TwoChooseOne/Iknp/IknpOtExtReceiver.h>
@@ -19,66 +22,71 @@
 
 void PsiRecvNonISH::non_isp_offline() {
   H1_sums.resize(PTS_NUM);
-  for (u64 i = 0; i < H1_sums.size(); i++) {
-    auto cells = intersection(pts[i], DIM, DELTA, SIGMA);
-    for (auto cell : cells) {
-      H1_sums[i].push_back(get_key_from_point(cell));
+  parallel_for(PTS_NUM, THREAD_NUM, [&](u64 start, u64 end) {
+    for (u64 i = start; i < end; i++) {
+      auto cells = intersection(pts[i], DIM, DELTA, SIGMA);
+      for (auto cell : cells) {
+        H1_sums[i].push_back(get_key_from_point(cell));
+      }
     }
-  }
+  });
 }
 
 void PsiRecvNonISH::setup() {
   u64 okvr_size = PTS_NUM * DIM * (2 * DELTA + 1) * BLK_CELLS;
+  // a fresh encryption of zero under every x within DELTA of a point, for
+  // each cell of its block
+  auto zero_keys = [&]() {
+    vector<block> keys(okvr_size);
+    const u64 span_len = 2 * DELTA + 1;
+    parallel_for(PTS_NUM, THREAD_NUM, [&](u64 start, u64 end) {
+      for (u64 i = start; i < end; i++) {
+        u64 k = i * DIM * span_len * BLK_CELLS;
+        for (u64 j = 0; j < DIM; j++) {
+          for (u64 x = pts[i][j] - DELTA; x <= pts[i][j] + DELTA; x++) {
+            for (u64 c = 0; c < BLK_CELLS; c++) {
+              keys[k++] = get_key_from_sum_dim_x(H1_sums[i][c], j, x);
+            }
+          }
+        }
+      }
+    });
+    return keys;
+  };
+
+  if (ahe->kind() == AheKind::EcElGamal) {
+    // always real, random bytes would not decode to points
+    setup_encoding.allocate(EcElGamalAhe::zeroEncodingBlocks(okvr_size),
+                            encoding_handoff);
+    setup_view = setup_encoding.data();
+    auto &ec = static_cast<const EcElGamalAhe &>(*ahe);
+    ec.encodeZeros(zero_keys(), setup_view, THREAD_NUM);
+    return;
+  }
 
-  // note: random gen
-  // ipcl::initializeContext("QAT");
-  // ipcl::setHybridMode(ipcl::HybridMode::OPTIMAL);
-
-  // vector<u32> zero_vec(2 * DELTA + 1, 0);
-  // ipcl::PlainText zero_plain = ipcl::PlainText(zero_vec);
-  // ipcl::CipherText zero_ciphers = palliar_pk.encrypt(zero_plain);
-  // auto zero_ciphers_blks =
-  // bignumers_to_blocks_vector(zero_ciphers.getTexts());
-
-  // ipcl::terminateContext();
-
-  // vector<block> keys;
-  // vector<vector<block>> values;
-
-  // keys.reserve(okvr_size);
-  // values.reserve(okvr_size);
-
-  // for (u64 i = 0; i < PTS_NUM; i++) {
-  //   for (u64 j = 0; j < DIM; j++) {
-  //     auto start = pts[i][j] - DELTA;
-  //     auto end = pts[i][j] + DELTA;
-  //     u64 count = 0;
-  //     for (u64 ii = start; ii <= end; ii++) {
-  //       for (auto tmpsum : H1_sums[i]) {
-  //         keys.push_back(get_key_from_sum_dim_x(tmpsum, j, ii));
-  //         values.push_back(zero_ciphers_blks[count]);
-  //       }
-  //       count++;
-  //     }
-  //   }
-  // }
-
-  // RBOKVS rb_okvs;
-  // rb_okvs.init(okvr_size, OKVS_EPSILON, OKVS_LAMBDA, OKVS_SEED);
-
-  // setup_encoding.resize(rb_okvs.mSize,
-  //                       vector<block>(PAILLIER_CIPHER_SIZE_IN_BLOCK));
-  // rb_okvs.encode(keys, values, PAILLIER_CIPHER_SIZE_IN_BLOCK,
-  // setup_encoding);
-
-  RBOKVS rb_okvs;
-  rb_okvs.init(okvr_size, OKVS_EPSILON, OKVS_LAMBDA, OKVS_SEED);
-
-  setup_encoding.resize(rb_okvs.mSize,
-                        vector<block>(PAILLIER_CIPHER_SIZE_IN_BLOCK));
-
-  for (auto tmp : setup_encoding) {
-    prng.get<block>(tmp.data(), PAILLIER_CIPHER_SIZE_IN_BLOCK);
+  RBOKVS_Fixed<PAILLIER_CIPHER_SIZE_IN_BLOCK> rb_okvs;
+  auto param = rb_okvs.getParams(okvr_size, OKVS_EPSILON, OKVS_LAMBDA,
+                                 OKVS_SEED);
+  rb_okvs.init(param);
+
+  auto tag = setup_tag(pts, {DIM, DELTA, SIGMA, real_setup},
+                       *palliar_pk.getN());
+  const string cache_name = "recv_nonish";
+  if (load_setup_encoding(cache_name, param, PAILLIER_CIPHER_SIZE_IN_BLOCK,
+                          tag)) {
+    setup_view = cached_encoding.data();
+  } else {
+    setup_encoding.allocate(rb_okvs.encodingSize(), encoding_handoff);
+    setup_view = setup_encoding.data();
+    if (real_setup) {
+      vector<u64> zeros(okvr_size, 0);
+      auto values = setup_encrypt(palliar_pk, zeros, THREAD_NUM);
+      rb_okvs.encode(zero_keys(), values, setup_view);
+    } else {
+      prng.get<block>(setup_view.data(), setup_view.size());
+    }
+    store_setup_encoding(cache_name, param, PAILLIER_CIPHER_SIZE_IN_BLOCK,
+                         tag, setup_view);
   }
 
   for (auto tmp : H1_sums) {
@@ -92,68 +100,42 @@ void PsiRecvNonISH::offline() {
   setup();
 }
 
-void PsiRecvNonISH::online() {
+coproto::task<void> PsiRecvNonISH::online() {
 
   auto setup_mN = DIM * PTS_NUM * BLK_CELLS * (2 * DELTA + 1);
-  coproto::sync_wait(sockets[0].send(setup_mN));
-  coproto::sync_wait(sockets[0].send(setup_encoding.size()));
-  coproto::sync_wait(sockets[0].flush());
-
-  auto flat_encode_blocks = flattenBlocks(setup_encoding);
+  const u64 cipher_blocks = ahe->cipherBlocks();
+  u64 setup_mSize = setup_view.size() / cipher_blocks;
+  FrameWriter setup_header;
+  setup_header.put<u64>(setup_mN).put<u64>(setup_mSize);
+  co_await send_frame(setup_header);
 
   auto tmp_com = sockets[0].bytesSent();
 
-  auto flat_size = flat_encode_blocks.size();
-  auto deal = flat_size / COM_CHUNK_SIZE;
-  auto remainder = flat_size % COM_CHUNK_SIZE;
-
-  for (u64 i = 0; i < deal; i++) {
-    std::span<block> view(flat_encode_blocks.data() + i * COM_CHUNK_SIZE,
-                          COM_CHUNK_SIZE);
-    coproto::sync_wait(sockets[0].send(view));
-  }
-
-  std::span<block> view(flat_encode_blocks.data() + deal * COM_CHUNK_SIZE,
-                        remainder);
-  coproto::sync_wait(sockets[0].send(view));
-  coproto::sync_wait(sockets[0].flush());
+  co_await send_encoding_stream(setup_view, cipher_blocks, &setup_encoding);
 
-  setup_encoding.clear();
-  setup_encoding.shrink_to_fit();
+  setup_encoding.release();
+  setup_view = {};
+  cached_encoding.close();
 
-  u64 sum_size;
-  coproto::sync_wait(sockets[0].recv(sum_size));
-  coproto::sync_wait(sockets[0].flush());
-  vector<block> sum_blks(sum_size * PAILLIER_CIPHER_SIZE_IN_BLOCK);
-  coproto::sync_wait(sockets[0].recvResize(sum_blks));
-  coproto::sync_wait(sockets[0].flush());
+  auto sum_frame = co_await recv_frame();
+  u64 sum_size = sum_frame.get<u64>();
+  vector<block> sum_blks(sum_size * cipher_blocks);
+  co_await recv_payload(sum_blks);
 
-  setup_encoding.clear();
-  setup_encoding.shrink_to_fit();
-
-  auto sum_bns = block_vector_to_bignumers(sum_blks, sum_size);
-  auto sum_dec = palliar_sk.decrypt(ipcl::CipherText(palliar_pk, sum_bns));
+  // the base ots do not depend on the sums and run while they are tested
+  osuCrypto::DefaultBaseOT baseOTs;
+  vector<array<block, 2>> baseSend(128);
+  prng.get((u8 *)baseSend.data()->data(), sizeof(block) * 2 * baseSend.size());
+  auto base_ots =
+      baseOTs.send(baseSend, prng, sockets[0]) | macoro::make_eager();
 
-  vector<u64> sum(sum_size);
-  for (u64 i = 0; i < sum_size; i++) {
-    auto tmp = sum_dec.getElementVec(i);
-    sum[i] = tmp[0];
-  }
+  setup_encoding.release();
 
-  for (auto tmp : sum) {
-    if (tmp == 0) {
-      psi_ca_result = psi_ca_result + 1;
-    }
-  }
+  auto sum_zero = ahe->isZero(sum_blks, THREAD_NUM);
+  psi_ca_result += std::count(sum_zero.begin(), sum_zero.end(), 1);
 
   u64 numOTs = OTHER_PTS_NUM * DIM;
-  // baseOT send
-  osuCrypto::DefaultBaseOT baseOTs;
-  vector<array<block, 2>> baseSend(128);
-  prng.get((u8 *)baseSend.data()->data(), sizeof(block) * 2 * baseSend.size());
-  auto p = baseOTs.send(baseSend, prng, sockets[0]);
-  auto r = macoro::sync_wait(macoro::when_all_ready(std::move(p)));
-  std::get<0>(r).result();
+  co_await base_ots;
 
   // iknp recv
   IknpOtExtReceiver recv;
@@ -164,21 +146,20 @@ void PsiRecvNonISH::online() {
 
   BitVector s0(numOTs);
   for (u64 i = 0; i < OTHER_PTS_NUM; i++) {
-    if (sum[i] == 0) {
+    if (sum_zero[i]) {
       for (u64 j = 0; j < DIM; j++) {
         s0[i * DIM + j] = 1;
       }
     }
   }
 
-  auto proto = recv.receive(s0, recvMsg, prng, sockets[0]);
-  auto result = macoro::sync_wait(macoro::when_all_ready(std::move(proto)));
-  std::get<0>(result).result();
+  co_await recv.receive(s0, recvMsg, prng, sockets[0]);
 
   vector<block> mask_msg_0(numOTs);
   vector<block> mask_msg_1(numOTs);
-  coproto::sync_wait(sockets[0].recv(mask_msg_0));
-  coproto::sync_wait(sockets[0].recv(mask_msg_1));
+  auto mask_frame = co_await recv_frame();
+  mask_frame.getArray<block>(mask_msg_0);
+  mask_frame.getArray<block>(mask_msg_1);
 
   for (u64 i = 0; i < numOTs; i++) {
     recvMsg[i] =
@@ -2,6 +2,7 @@
 #include <coproto/Socket/Socket.h>
 #include <cryptoTools/Common/Defines.h>
 #include <cryptoTools/Common/block.h>
+#include <memory>
 #include <vector>
 
 #include <ipcl/bignum.h>
@@ -10,6 +11,7 @@
 #include <ipcl/pri_key.hpp>
 #include <ipcl/pub_key.hpp>
 
+#include "ahe/paillier_ahe.h"
 #include "config.h"
 #include "fpsi_base.h"
 #include "rb_okvs/rb_okvs.h"
@@ -30,6 +32,8 @@ public:
   vector<pt> &pts;
   const ipcl::PublicKey palliar_pk;
   const ipcl::PrivateKey palliar_sk;
+  // the scheme of the zero test, paillier under the keys above by default
+  std::shared_ptr<AheScheme> ahe;
 
   // shash datas
   vector<vector<u64>> shash_keys;
@@ -39,7 +43,9 @@ public:
   vector<vector<block>> H1_sums;
 
   //
-  vector<vector<block>> setup_encoding;
+  EncodingBuffer setup_encoding;
+  // what online() sends, setup_encoding or the mapping of a saved encoding
+  std::span<block> setup_view;
 
   u64 psi_ca_result = 0;
 
@@ -58,6 +64,7 @@ public:
         THREAD_NUM(thread_num), palliar_pk(pk), palliar_sk(sk), pts(pts),
         SIGMA(sigma), FPSIBase(sockets) {
     prng.SetSeed(oc::sysRandomSeed());
+    ahe = std::make_shared<PaillierAhe>(pk, sk);
 
     SIDE_LEN = (sigma) ? 4 * delta : delta;
     BLK_CELLS = (sigma) ? (1 << dim) : (std::pow(3, dim));
@@ -67,5 +74,5 @@ public:
   void setup();
 
   void offline();
-  void online();
+  coproto::task<void> online();
 };
\ No newline at end of file
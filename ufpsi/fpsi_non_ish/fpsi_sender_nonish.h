@@ -1,5 +1,6 @@
 #pragma once
 #include <coproto/Socket/Socket.h>
+#include <memory>
 #include <vector>
 
 #include <cryptoTools/Common/block.h>
@@ -8,6 +9,7 @@
 #include <ipcl/ipcl.hpp>
 #include <ipcl/pri_key.hpp>
 
+#include "ahe/paillier_ahe.h"
 #include "config.h"
 #include "fpsi_base.h"
 #include "utils/util.h"
@@ -28,6 +30,8 @@ public:
 
   const ipcl::PublicKey palliar_pk;
   const ipcl::PrivateKey palliar_sk;
+  // the scheme of the zero test, paillier under the keys above by default
+  std::shared_ptr<AheScheme> ahe;
 
   // shash datas
   PRNG prng;
@@ -56,6 +60,7 @@ public:
         THREAD_NUM(thread_num), palliar_pk(pk), palliar_sk(sk), pts(pts),
         SIGMA(sigma), FPSIBase(sockets) {
     prng.SetSeed(oc::sysRandomSeed());
+    ahe = std::make_shared<PaillierAhe>(pk, sk);
 
     SIDE_LEN = (sigma) ? 4 * delta : delta;
     BLK_CELLS = (sigma) ? (1 << dim) : (std::pow(3, dim));
@@ -66,5 +71,5 @@ public:
   void fuzzy_matching_offline();
   void offline();
 
-  void online();
+  coproto::task<void> online();
 };
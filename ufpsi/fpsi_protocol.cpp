@@ -1,11 +1,24 @@
 #include "fpsi_protocol.h"
 
+#include <exception>
+#include <filesystem>
+#include <optional>
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <unistd.h>
+
 #include <coproto/Socket/AsioSocket.h>
 #include <coproto/Socket/LocalAsyncSock.h>
 #include <cryptoTools/Common/Defines.h>
 #include <cryptoTools/Crypto/RCurve.h>
+#include <macoro/sync_wait.h>
+#include <macoro/thread_pool.h>
+#include <macoro/when_all.h>
 #include <spdlog/spdlog.h>
 
+#include "ahe/ec_elgamal_ahe.h"
+#include "ahe/paillier_ahe.h"
 #include "config.h"
 #include "fpsi_ish/fpsi_recv_ish.h"
 #include "fpsi_ish/fpsi_sender_ish.h"
@@ -15,16 +28,447 @@
 #include "fpsi_sp_ish/fpsi_sp_oprf_sender.h"
 #include "fpsi_sp_non_ish/fpsi_sp_recv_nonish.h"
 #include "fpsi_sp_non_ish/fpsi_sp_sender_nonish.h"
+#include "net/net_emulator.h"
+#include "net/shm_socket.h"
+#include "paillier/key_pool.h"
 #include "shash_ahe/shash_ahe_p1.h"
 #include "shash_ahe/shash_ahe_p2.h"
 #include "shash_oprf/shash_oprf_p1.h"
 #include "shash_oprf/shash_oprf_p2.h"
 #include "utils/util.h"
 
+namespace {
+
+// bytes each direction of a shared memory channel buffers
+const u64 SHM_CAPACITY = u64(64) << 20;
+// keys a --keypool directory is refilled to
+const u64 KEY_POOL_SIZE = 4;
+
+// the parties of a run, both in this process on a local socket pair or, with
+// --role, only one of them talking over tcp to a peer process running the
+// other
+struct PartyNet {
+  bool remote = false;
+  Role role = Role::Recv;
+  // with --net the sender's connections go through it, declared before the
+  // sockets so it outlives them
+  std::unique_ptr<NetEmulator> emulator;
+  // sockets of the receiver and of the sender, in remote mode only those of
+  // the party run here
+  vector<coproto::Socket> recv_socks, send_socks;
+  // with --transport handoff the setup encoding changes hands as shared
+  // memory instead of going through the sockets
+  bool handoff = false;
+
+  bool runs(Role r) const { return !remote || role == r; }
+  // what both parties sent over all their sockets
+  u64 bytes_sent() {
+    u64 bytes = 0;
+    for (auto *socks : {&recv_socks, &send_socks}) {
+      for (auto &sock : *socks) {
+        bytes += sock.bytesSent();
+      }
+    }
+    return bytes;
+  }
+  vector<coproto::Socket> &socks() {
+    return role == Role::Recv ? recv_socks : send_socks;
+  }
+};
+
+bool open_net(const oc::CLP &cmd, u64 thread_num, PartyNet &net) {
+  NetProfile profile;
+  if (cmd.isSet("net") &&
+      !NetProfile::parse(cmd.getOr<string>("net", ""), profile)) {
+    spdlog::error("net should be lan, wan or custom:<mbps>,<rtt ms>[,<jitter "
+                  "ms>]");
+    return false;
+  }
+  const string transport = cmd.getOr<string>("transport", "tcp");
+  if (transport != "tcp" && transport != "shm" && transport != "handoff") {
+    spdlog::error("transport should be tcp, shm or handoff");
+    return false;
+  }
+  if (transport != "tcp" && cmd.isSet("net")) {
+    spdlog::error("--net emulates a tcp link, it needs --transport tcp");
+    return false;
+  }
+  net.handoff = transport == "handoff";
+  // one socket per thread, large arrays are striped across them
+  const u64 num_socks = std::max<u64>(thread_num, 1);
+  if (!cmd.isSet("role") && !cmd.isSet("net") && transport == "tcp") {
+    for (u64 i = 0; i < num_socks; ++i) {
+      auto pair_sock = coproto::LocalAsyncSocket::makePair();
+      net.recv_socks.push_back(pair_sock[0]);
+      net.send_socks.push_back(pair_sock[1]);
+    }
+    return true;
+  }
+
+  const string role = cmd.getOr<string>("role", "");
+  if (role == "sender") {
+    net.role = Role::Sender;
+  } else if (role != "receiver" && !role.empty()) {
+    spdlog::error("role should be sender or receiver");
+    return false;
+  }
+  net.remote = !role.empty();
+
+  // connections on port, port + 1, ..., the receiver listens
+  const string IP = cmd.getOr<string>("ip", "127.0.0.1");
+  const u64 PORT = cmd.getOr<u64>("port", 1212);
+  if (transport != "tcp") {
+    // a channel per socket named after the port, the receiver creates them
+    // and the sender maps them, so the two must run on the same host
+    auto shm_name = [&](u64 i) {
+      return "/ufpsi-" + std::to_string(PORT) + "-" + std::to_string(i);
+    };
+    for (u64 i = 0; i < num_socks; ++i) {
+      if (net.runs(Role::Recv)) {
+        net.recv_socks.push_back(
+            makeShmSocket(ShmChannel::create(shm_name(i), SHM_CAPACITY)));
+      }
+      if (net.runs(Role::Sender)) {
+        net.send_socks.push_back(makeShmSocket(ShmChannel::open(shm_name(i))));
+      }
+    }
+    if (net.remote) {
+      spdlog::info("{} attached to {} shared memory channels", role,
+                   net.socks().size());
+    }
+    return true;
+  }
+  auto connect_recv = [&]() {
+    for (u64 i = 0; i < num_socks; ++i) {
+      auto addr = IP + ":" + std::to_string(PORT + i);
+      net.recv_socks.push_back(coproto::asioConnect(addr, true));
+    }
+  };
+  auto connect_send = [&]() {
+    for (u64 i = 0; i < num_socks; ++i) {
+      auto addr = IP + ":" + std::to_string(PORT + i);
+      if (net.emulator) {
+        addr = "127.0.0.1:" + std::to_string(net.emulator->frontPort(i));
+      }
+      net.send_socks.push_back(coproto::asioConnect(addr, false));
+    }
+  };
+  if (cmd.isSet("net") && net.runs(Role::Sender)) {
+    net.emulator = std::make_unique<NetEmulator>(profile, IP, PORT, num_socks);
+    spdlog::info("emulated network: {}", profile.toString());
+  }
+
+  if (!net.remote) {
+    // both parties in this process over loopback tcp
+    std::thread recv_thread(connect_recv);
+    connect_send();
+    recv_thread.join();
+    return true;
+  }
+  if (net.role == Role::Recv) {
+    connect_recv();
+  } else {
+    connect_send();
+  }
+  spdlog::info("{} connected to {}:{}, {} sockets", role, IP, PORT,
+               net.socks().size());
+  return true;
+}
+
+// closes phase in the round audits of both parties of an in-process run
+void close_rounds(const string &phase, FPSIBase &recv_party,
+                  FPSIBase &send_party) {
+  recv_party.insert_rounds(phase);
+  send_party.insert_rounds(phase);
+}
+
+// options of the party that builds the setup encoding
+void setup_options(const oc::CLP &cmd, const PartyNet &net, FPSIBase &party) {
+  party.okvs_cache_dir = cmd.getOr<string>("okvs_cache", "");
+  party.encoding_handoff = net.handoff;
+  party.real_setup = cmd.isSet("real_setup");
+  party.rand_pool_path = cmd.getOr<string>("rand_pool", "");
+}
+
+// a party's online task, started on a thread of pool. should it fail, every
+// socket of the run is closed so the other party fails too instead of waiting
+// on it forever
+coproto::task<void> close_on_failure(PartyNet &net, macoro::thread_pool &pool,
+                                     coproto::task<void> task) {
+  co_await pool.schedule();
+  std::exception_ptr failure;
+  try {
+    co_await std::move(task);
+  } catch (...) {
+    failure = std::current_exception();
+  }
+  if (failure) {
+    for (auto *socks : {&net.recv_socks, &net.send_socks}) {
+      for (auto &sock : *socks) {
+        sock.close();
+      }
+    }
+    std::rethrow_exception(failure);
+  }
+}
+
+// the online tasks of both parties of an in-process run, each started on a
+// thread of its own so the online time is that of the slower party rather
+// than the sum of both. the first failure is rethrown once both are done
+void run_online(PartyNet &net, coproto::task<void> first,
+                coproto::task<void> second) {
+  macoro::thread_pool pool;
+  auto work = pool.make_work();
+  pool.create_threads(2);
+  auto results = macoro::sync_wait(
+      macoro::when_all_ready(close_on_failure(net, pool, std::move(first)),
+                             close_on_failure(net, pool, std::move(second))));
+  std::get<0>(results).result();
+  std::get<1>(results).result();
+}
+
+// online time, communication and rounds of a run with both parties in this
+// process. over an emulated network the time is measured, otherwise the
+// transfer time at 100 and 10 Mbps is added to it
+void report_run(const PartyNet &net, double offline_time, double online_time,
+                u64 com, const FPSIBase &recv_party,
+                const FPSIBase &send_party) {
+  recv_party.print_rounds("receiver");
+  send_party.print_rounds("sender");
+  if (net.emulator) {
+    spdlog::info("offline time: {} s , online time: {} s; com: {} bytes, {} MB",
+                 offline_time / 1000.0, online_time / 1000.0, com,
+                 com / 1024.0 / 1024.0);
+    return;
+  }
+
+  auto online_time_s_100 = online_time / 1000.0 + com / 1024.0 / 1024.0 / 11;
+  auto online_time_s_10 = online_time / 1000.0 + com / 1024.0 / 1024.0 / 1.1;
+
+  spdlog::info("offline time: {} s , online time: {} s; com: {} bytes, {} MB",
+               offline_time / 1000.0, online_time_s_100, com,
+               com / 1024.0 / 1024.0);
+  spdlog::info("offline time: {} s , online time: {} s; com: {} bytes, {} MB",
+               offline_time / 1000.0, online_time_s_10, com,
+               com / 1024.0 / 1024.0);
+}
+
+// both processes sample all points, they agree on them through the seed
+block pts_seed(const oc::CLP &cmd) {
+  if (cmd.isSet("seed") || cmd.isSet("role")) {
+    return oc::toBlock(cmd.getOr<u64>("seed", 0));
+  }
+  return oc::sysRandomSeed();
+}
+
+void send_bignumber(coproto::Socket &sock, const BigNumber &bn) {
+  vector<u32> words;
+  bn.num2vec(words);
+  coproto::sync_wait(sock.send(words));
+  coproto::sync_wait(sock.flush());
+}
+
+BigNumber recv_bignumber(coproto::Socket &sock) {
+  vector<u32> words;
+  coproto::sync_wait(sock.recvResize(words));
+  return BigNumber(words.data(), words.size());
+}
+
+// tops the pool in dir up in a process of its own, this program again with
+// --keypool_fill, which outlives the run so its exit never waits for a prime
+// search
+void spawn_key_pool_fill(const string &dir) {
+  std::error_code ec;
+  const string self =
+      std::filesystem::read_symlink("/proc/self/exe", ec).string();
+  if (ec) {
+    spdlog::warn("cannot refill the key pool: {}", ec.message());
+    return;
+  }
+  vector<string> args = {self, "--keypool", dir, "--keypool_fill", "--log",
+                         "0"};
+  vector<char *> argv;
+  for (auto &arg : args) {
+    argv.push_back(arg.data());
+  }
+  argv.push_back(nullptr);
+
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null",
+                                   O_WRONLY, 0);
+  posix_spawnattr_t attr;
+  posix_spawnattr_init(&attr);
+  // a session of its own, a ctrl-c of the run does not reach it
+  posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSID);
+  pid_t pid;
+  if (posix_spawn(&pid, self.c_str(), &actions, &attr, argv.data(),
+                  environ) != 0) {
+    spdlog::warn("cannot refill the key pool in {}", dir);
+  }
+  posix_spawnattr_destroy(&attr);
+  posix_spawn_file_actions_destroy(&actions);
+}
+
+// the paillier key pair of the receiver. it loads it from --keyfile, saved
+// there on the first run, takes one from the pool in --keypool, which another
+// process then refills, or generates a new one. in remote mode the sender
+// gets the modulus N only, except in the protocols where it decrypts too,
+// sender_decrypts, which share the whole key pair as they did in one process
+ipcl::KeyPair psi_keypair(const oc::CLP &cmd, PartyNet &net,
+                          bool sender_decrypts) {
+  if (net.runs(Role::Recv)) {
+    ipcl::initializeContext("QAT");
+    const string key_file = cmd.getOr<string>("keyfile", "");
+    const string pool_dir = cmd.getOr<string>("keypool", "");
+    if (!key_file.empty() && !pool_dir.empty()) {
+      spdlog::warn("--keypool is not used with --keyfile");
+    }
+    std::optional<ipcl::KeyPair> loaded;
+    if (!key_file.empty()) {
+      loaded = loadPaillierKey(key_file);
+      if (!loaded && std::filesystem::exists(key_file)) {
+        spdlog::warn("{} is not a paillier key, a new one is not saved",
+                     key_file);
+      }
+    } else if (!pool_dir.empty()) {
+      loaded = PaillierKeyPool(pool_dir, KEY_POOL_SIZE).take();
+      spawn_key_pool_fill(pool_dir);
+    }
+    if (!loaded) {
+      loaded = ipcl::generateKeypair(PAILLIER_KEY_SIZE_IN_BIT, true);
+      if (!key_file.empty() && !std::filesystem::exists(key_file)) {
+        try {
+          savePaillierKey(key_file, *loaded);
+        } catch (const std::runtime_error &e) {
+          spdlog::warn("{}", e.what());
+        }
+      }
+    }
+    ipcl::terminateContext();
+    ipcl::KeyPair psi_key = *loaded;
+    if (net.remote) {
+      send_bignumber(net.recv_socks[0], *psi_key.pub_key.getN());
+      if (sender_decrypts) {
+        spdlog::warn("sending the paillier private key to the sender, which "
+                     "decrypts in this protocol");
+        send_bignumber(net.recv_socks[0], *psi_key.priv_key.getP());
+        send_bignumber(net.recv_socks[0], *psi_key.priv_key.getQ());
+      }
+    }
+    return psi_key;
+  }
+
+  BigNumber n = recv_bignumber(net.send_socks[0]);
+  ipcl::PublicKey pk(n, PAILLIER_KEY_SIZE_IN_BIT, true);
+  if (!sender_decrypts) {
+    return {pk, ipcl::PrivateKey()};
+  }
+  BigNumber p = recv_bignumber(net.send_socks[0]);
+  BigNumber q = recv_bignumber(net.send_socks[0]);
+  if (p * q != n) {
+    throw std::runtime_error("psi key: p and q do not match N");
+  }
+  ipcl::PrivateKey sk(pk, p, q);
+  return {pk, sk};
+}
+
+// the schemes of the zero test of both parties. with --ahe elgamal that is
+// ec elgamal under a key the receiver generates, in remote mode it sends the
+// public key to the sender, otherwise paillier under the psi key pair
+bool zero_test_ahe(const oc::CLP &cmd, PartyNet &net,
+                   const ipcl::KeyPair &psi_key,
+                   std::shared_ptr<AheScheme> &recv_ahe,
+                   std::shared_ptr<AheScheme> &send_ahe) {
+  const string name = cmd.getOr<string>("ahe", "paillier");
+  if (name == "paillier") {
+    recv_ahe =
+        std::make_shared<PaillierAhe>(psi_key.pub_key, psi_key.priv_key);
+    send_ahe = recv_ahe;
+    return true;
+  }
+  if (name != "elgamal") {
+    spdlog::error("ahe should be paillier or elgamal");
+    return false;
+  }
+
+  vector<u8> pk_bytes(POINT_LENGTH_IN_BYTE);
+  if (net.runs(Role::Recv)) {
+    auto ec = std::make_shared<EcElGamalAhe>();
+    recv_ahe = ec;
+    ec->publicKey().toBytes(pk_bytes.data());
+    if (net.remote) {
+      coproto::sync_wait(net.recv_socks[0].send(pk_bytes));
+      coproto::sync_wait(net.recv_socks[0].flush());
+      return true;
+    }
+  } else {
+    coproto::sync_wait(net.send_socks[0].recv(pk_bytes));
+  }
+  Rist25519_point pk;
+  pk.fromBytes(pk_bytes.data());
+  send_ahe = std::make_shared<EcElGamalAhe>(pk);
+  return true;
+}
+
+// the protocols that decrypt values, not only test them for zero
+bool paillier_only(const oc::CLP &cmd) {
+  if (cmd.getOr<string>("ahe", "paillier") != "paillier") {
+    spdlog::error("only psi_ish and psi_nonish run on another ahe");
+    return false;
+  }
+  return true;
+}
+
+// offline and online of the party run here, online returning the party's
+// online task. the online clock starts once both parties are through offline,
+// and stops when this party is done, so it includes the real network and
+// nothing of the peer's cpu time
+template <typename Offline, typename Online>
+void run_party(PartyNet &net, FPSIBase &party, Offline offline,
+               Online online) {
+  auto &socks = net.socks();
+
+  tVar timer;
+  tStart(timer);
+  offline();
+  auto offline_time = tEnd(timer);
+  party.insert_rounds("offline");
+
+  u8 ready = 1;
+  coproto::sync_wait(socks[0].send(ready));
+  coproto::sync_wait(socks[0].flush());
+  coproto::sync_wait(socks[0].recv(ready));
+  u64 com = 0;
+  for (auto &sock : socks) {
+    com -= sock.bytesSent();
+  }
+
+  tStart(timer);
+  coproto::sync_wait(online());
+  for (auto &sock : socks) {
+    coproto::sync_wait(sock.flush());
+  }
+  auto online_time = tEnd(timer);
+  party.insert_rounds("online");
+  for (auto &sock : socks) {
+    com += sock.bytesSent();
+  }
+
+  const string name = net.role == Role::Recv ? "receiver" : "sender";
+  spdlog::info("[{}] offline time: {} s , online time: {} s; sent: {} bytes, "
+               "{} MB",
+               name, offline_time / 1000.0, online_time / 1000.0, com,
+               com / 1024.0 / 1024.0);
+  party.print_rounds(name);
+}
+
+} // namespace
+
 void run_psi_sp_ishash(const oc::CLP &cmd) {
   const u64 DIM = cmd.getOr("d", 2);
   const u64 DELTA = cmd.getOr("delta", 10);
-  const u64 THREAD_NUM = 1;
+  const u64 THREAD_NUM = cmd.getOr<u64>("t", 1);
   const u64 num_s = 1ull << cmd.getOr("s", 18);
   const u64 num_s_log = cmd.getOr("s", 18);
   const u64 num_r = 1ull << cmd.getOr("r", 5);
@@ -32,90 +476,79 @@ void run_psi_sp_ishash(const oc::CLP &cmd) {
   const u64 intersection_size = cmd.getOr("i", 12);
   const bool sample_flag = cmd.isSet("sample");
 
-  const string IP = cmd.getOr<string>("ip", "127.0.0.1");
-  const u64 PORT = cmd.getOr<u64>("port", 1212);
-
   if ((intersection_size > num_s) | (intersection_size > num_r)) {
     spdlog::error("intersection_size should not be greater than set_size");
     return;
   }
+  if (!paillier_only(cmd)) {
+    return;
+  }
 
   spdlog::info("[psi_sp_ish] dim: {}, delta: {}, n_s: {}-{}, n_r: {}-{} ", DIM,
                DELTA, num_s_log, num_s, num_r_log, num_r);
 
+  PartyNet net;
+  if (!open_net(cmd, THREAD_NUM, net)) {
+    return;
+  }
+
   vector<pt> send_pts(num_s, vector<u64>(DIM, 0));
   vector<pt> recv_pts(num_r, vector<u64>(DIM, 0));
 
   sample_points(DIM, DELTA, num_s, num_r, intersection_size, send_pts, recv_pts,
-                sample_flag);
-
-  ipcl::initializeContext("QAT");
-  ipcl::KeyPair psi_key = ipcl::generateKeypair(2048, true);
-  ipcl::terminateContext();
-
-  vector<coproto::Socket> socketPair0, socketPair1;
-  // auto init_socks = [&](Role role) {
-  //   for (u64 i = 0; i < THREAD_NUM; ++i) {
-  //     auto port_temp = PORT + i;
-  //     auto addr = IP + ":" + std::to_string(port_temp);
-  //     if (role == Role::Sender) {
-  //       socketPair0.push_back(coproto::asioConnect(addr, true));
-  //     } else {
-  //       socketPair1.push_back(coproto::asioConnect(addr, false));
-  //     }
-  //   }
-  // };
-  // std::thread recv_socks(init_socks, Role::Recv);
-  // std::thread sender_socks(init_socks, Role::Sender);
-
-  // recv_socks.join();
-  // sender_socks.join();
-
-  coproto::LocalAsyncSocket local_socket;
-  auto pair_sock = local_socket.makePair();
-  socketPair0.push_back(pair_sock[0]);
-  socketPair1.push_back(pair_sock[1]);
+                sample_flag, pts_seed(cmd));
+
+  ipcl::KeyPair psi_key = psi_keypair(cmd, net, true);
+
+  if (net.remote) {
+    if (net.role == Role::Recv) {
+      PsiSpRecvISH recv_party(DIM, DELTA, num_r, num_s, THREAD_NUM,
+                              psi_key.pub_key, psi_key.priv_key, recv_pts,
+                              net.recv_socks);
+      run_party(net, recv_party, [&] { recv_party.offline(); },
+                [&] { return recv_party.online(); });
+      spdlog::debug("count: {}", recv_party.psi_ca_result);
+    } else {
+      PsiSpSenderISH sender_party(DIM, DELTA, num_s, num_r, THREAD_NUM,
+                                  psi_key.pub_key, psi_key.priv_key, send_pts,
+                                  net.send_socks);
+      setup_options(cmd, net, sender_party);
+      run_party(net, sender_party, [&] { sender_party.offline(); },
+                [&] { return sender_party.online(); });
+    }
+    return;
+  }
 
   tVar timer;
   tStart(timer);
 
   PsiSpRecvISH recv_party(DIM, DELTA, num_r, num_s, THREAD_NUM, psi_key.pub_key,
-                          psi_key.priv_key, recv_pts, socketPair0);
+                          psi_key.priv_key, recv_pts, net.recv_socks);
   PsiSpSenderISH sender_party(DIM, DELTA, num_s, num_r, THREAD_NUM,
                               psi_key.pub_key, psi_key.priv_key, send_pts,
-                              socketPair1);
+                              net.send_socks);
+  setup_options(cmd, net, sender_party);
 
   recv_party.offline();
   sender_party.offline();
 
   auto offline_time = tEnd(timer);
+  close_rounds("offline", recv_party, sender_party);
 
   tStart(timer);
-  std::thread recv_hash_online(std::bind(&PsiSpRecvISH::online, &recv_party));
-  std::thread sender_hash_online(
-      std::bind(&PsiSpSenderISH::online, &sender_party));
-
-  recv_hash_online.join();
-  sender_hash_online.join();
+  run_online(net, recv_party.online(), sender_party.online());
   auto online_time = tEnd(timer);
-  auto com = socketPair0[0].bytesSent() + socketPair1[0].bytesSent();
+  close_rounds("online", recv_party, sender_party);
+  auto com = net.bytes_sent();
 
   spdlog::debug("count: {}", recv_party.psi_ca_result);
-  auto online_time_s_100 = online_time / 1000.0 + com / 1024.0 / 1024.0 / 11;
-  auto online_time_s_10 = online_time / 1000.0 + com / 1024.0 / 1024.0 / 1.1;
-
-  spdlog::info("offline time: {} s , online time: {} s; com: {} bytes, {} MB",
-               offline_time / 1000.0, online_time_s_100, com,
-               com / 1024.0 / 1024.0);
-  spdlog::info("offline time: {} s , online time: {} s; com: {} bytes, {} MB",
-               offline_time / 1000.0, online_time_s_10, com,
-               com / 1024.0 / 1024.0);
+  report_run(net, offline_time, online_time, com, recv_party, sender_party);
 }
 
 void run_psi_sp_nonish(const oc::CLP &cmd) {
   const u64 DIM = cmd.getOr("d", 2);
   const u64 DELTA = cmd.getOr("delta", 10);
-  const u64 THREAD_NUM = 1;
+  const u64 THREAD_NUM = cmd.getOr<u64>("t", 1);
   const u64 num_s = 1ull << cmd.getOr("s", 18);
   const u64 num_s_log = cmd.getOr("s", 18);
   const u64 num_r = 1ull << cmd.getOr("r", 5);
@@ -124,92 +557,80 @@ void run_psi_sp_nonish(const oc::CLP &cmd) {
   const bool sample_flag = cmd.isSet("sample");
   const bool sigma_flag = cmd.isSet("sigma");
 
-  const string IP = cmd.getOr<string>("ip", "127.0.0.1");
-  const u64 PORT = cmd.getOr<u64>("port", 1212);
-
   if ((intersection_size > num_s) | (intersection_size > num_r)) {
     spdlog::error("intersection_size should not be greater than set_size");
     return;
   }
+  if (!paillier_only(cmd)) {
+    return;
+  }
 
   spdlog::info("[psi_sp_nonish] dim: {}, delta: {}, n_s: {}-{}, n_r: {}-{} ",
                DIM, DELTA, num_s_log, num_s, num_r_log, num_r);
 
+  PartyNet net;
+  if (!open_net(cmd, THREAD_NUM, net)) {
+    return;
+  }
+
   vector<pt> send_pts(num_s, vector<u64>(DIM, 0));
   vector<pt> recv_pts(num_r, vector<u64>(DIM, 0));
 
   sample_points(DIM, DELTA, num_s, num_r, intersection_size, send_pts, recv_pts,
-                sample_flag);
-
-  ipcl::initializeContext("QAT");
-  ipcl::KeyPair psi_key = ipcl::generateKeypair(2048, true);
-  ipcl::terminateContext();
-
-  vector<coproto::Socket> socketPair0, socketPair1;
-  // auto init_socks = [&](Role role) {
-  //   for (u64 i = 0; i < THREAD_NUM; ++i) {
-  //     auto port_temp = PORT + i;
-  //     auto addr = IP + ":" + std::to_string(port_temp);
-  //     if (role == Role::Sender) {
-  //       socketPair0.push_back(coproto::asioConnect(addr, true));
-  //     } else {
-  //       socketPair1.push_back(coproto::asioConnect(addr, false));
-  //     }
-  //   }
-  // };
-  // std::thread recv_socks(init_socks, Role::Recv);
-  // std::thread sender_socks(init_socks, Role::Sender);
-
-  // recv_socks.join();
-  // sender_socks.join();
-
-  coproto::LocalAsyncSocket local_socket;
-  auto pair_sock = local_socket.makePair();
-  socketPair0.push_back(pair_sock[0]);
-  socketPair1.push_back(pair_sock[1]);
+                sample_flag, pts_seed(cmd));
+
+  ipcl::KeyPair psi_key = psi_keypair(cmd, net, true);
+
+  if (net.remote) {
+    if (net.role == Role::Recv) {
+      PsiSpRecvNonISH recv_party(DIM, DELTA, num_r, num_s, THREAD_NUM,
+                                 psi_key.pub_key, psi_key.priv_key, recv_pts,
+                                 sigma_flag, net.recv_socks);
+      run_party(net, recv_party, [&] { recv_party.offline(); },
+                [&] { return recv_party.online(); });
+      spdlog::debug("count: {}", recv_party.psi_ca_result);
+    } else {
+      PsiSpSenderNonISH sender_party(DIM, DELTA, num_s, num_r, THREAD_NUM,
+                                     psi_key.pub_key, psi_key.priv_key,
+                                     send_pts, sigma_flag, net.send_socks);
+      setup_options(cmd, net, sender_party);
+      run_party(net, sender_party, [&] { sender_party.offline(); },
+                [&] { return sender_party.online(); });
+    }
+    return;
+  }
 
   tVar timer;
   tStart(timer);
 
   PsiSpRecvNonISH recv_party(DIM, DELTA, num_r, num_s, THREAD_NUM,
                              psi_key.pub_key, psi_key.priv_key, recv_pts,
-                             sigma_flag, socketPair0);
+                             sigma_flag, net.recv_socks);
   PsiSpSenderNonISH sender_party(DIM, DELTA, num_s, num_r, THREAD_NUM,
                                  psi_key.pub_key, psi_key.priv_key, send_pts,
-                                 sigma_flag, socketPair1);
+                                 sigma_flag, net.send_socks);
+  setup_options(cmd, net, sender_party);
 
   recv_party.offline();
   sender_party.offline();
   auto offline_time = tEnd(timer);
+  close_rounds("offline", recv_party, sender_party);
 
   tStart(timer);
-  std::thread recv_hash_online(
-      std::bind(&PsiSpRecvNonISH::online, &recv_party));
-  std::thread sender_hash_online(
-      std::bind(&PsiSpSenderNonISH::online, &sender_party));
-
-  recv_hash_online.join();
-  sender_hash_online.join();
+  run_online(net, recv_party.online(), sender_party.online());
   auto online_time = tEnd(timer);
-  auto com = socketPair0[0].bytesSent() + socketPair1[0].bytesSent();
+  close_rounds("online", recv_party, sender_party);
+  auto com = net.bytes_sent();
 
   spdlog::debug("count: {}", recv_party.psi_ca_result);
 
-  auto online_time_s_100 = online_time / 1000.0 + com / 1024.0 / 1024.0 / 11;
-  auto online_time_s_10 = online_time / 1000.0 + com / 1024.0 / 1024.0 / 1.1;
-
-  spdlog::info("offline time: {} s , online time: {} s; com: {} bytes, {} MB",
-               offline_time / 1000.0, online_time_s_100, com,
-               com / 1024.0 / 1024.0);
-  spdlog::info("offline time: {} s , online time: {} s; com: {} bytes, {} MB",
-               offline_time / 1000.0, online_time_s_10, com,
-               com / 1024.0 / 1024.0);
+  report_run(net, offline_time, online_time, com, recv_party, sender_party);
 }
 
 void run_psi_ishash(const oc::CLP &cmd) {
   const u64 DIM = cmd.getOr("d", 2);
   const u64 DELTA = cmd.getOr("delta", 10);
-  const u64 THREAD_NUM = 1;
+  const u64 THREAD_NUM = cmd.getOr<u64>("t", 1);
   const u64 num_s = 1ull << cmd.getOr("s", 5);
   const u64 num_s_log = cmd.getOr("s", 5);
   const u64 num_r = 1ull << cmd.getOr("r", 18);
@@ -218,9 +639,6 @@ void run_psi_ishash(const oc::CLP &cmd) {
   const bool sample_flag = cmd.isSet("sample");
   const bool sigma_flag = cmd.isSet("sigma");
 
-  const string IP = cmd.getOr<string>("ip", "127.0.0.1");
-  const u64 PORT = cmd.getOr<u64>("port", 1212);
-
   if ((intersection_size > num_s) | (intersection_size > num_r)) {
     spdlog::error("intersection_size should not be greater than set_size");
     return;
@@ -229,81 +647,79 @@ void run_psi_ishash(const oc::CLP &cmd) {
   spdlog::info("[psi_ish] dim: {}, delta: {}, n_s: {}-{}, n_r: {}-{} ", DIM,
                DELTA, num_s_log, num_s, num_r_log, num_r);
 
+  PartyNet net;
+  if (!open_net(cmd, THREAD_NUM, net)) {
+    return;
+  }
+
   vector<pt> send_pts(num_s, vector<u64>(DIM, 0));
   vector<pt> recv_pts(num_r, vector<u64>(DIM, 0));
 
   sample_points(DIM, DELTA, num_s, num_r, intersection_size, send_pts, recv_pts,
-                sample_flag);
-
-  ipcl::initializeContext("QAT");
-  ipcl::KeyPair psi_key = ipcl::generateKeypair(2048, true);
-  ipcl::terminateContext();
-
-  vector<coproto::Socket> socketPair0, socketPair1;
-  // auto init_socks = [&](Role role) {
-  //   for (u64 i = 0; i < THREAD_NUM; ++i) {
-  //     auto port_temp = PORT + i;
-  //     auto addr = IP + ":" + std::to_string(port_temp);
-  //     if (role == Role::Sender) {
-  //       socketPair0.push_back(coproto::asioConnect(addr, true));
-  //     } else {
-  //       socketPair1.push_back(coproto::asioConnect(addr, false));
-  //     }
-  //   }
-  // };
-  // std::thread recv_socks(init_socks, Role::Recv);
-  // std::thread sender_socks(init_socks, Role::Sender);
-
-  // recv_socks.join();
-  // sender_socks.join();
-
-  coproto::LocalAsyncSocket local_socket;
-  auto pair_sock = local_socket.makePair();
-  socketPair0.push_back(pair_sock[0]);
-  socketPair1.push_back(pair_sock[1]);
+                sample_flag, pts_seed(cmd));
+
+  ipcl::KeyPair psi_key = psi_keypair(cmd, net, false);
+  std::shared_ptr<AheScheme> recv_ahe, send_ahe;
+  if (!zero_test_ahe(cmd, net, psi_key, recv_ahe, send_ahe)) {
+    return;
+  }
+
+  if (net.remote) {
+    if (net.role == Role::Recv) {
+      PsiRecvISH recv_party(DIM, DELTA, num_r, num_s, THREAD_NUM,
+                            psi_key.pub_key, psi_key.priv_key, recv_pts,
+                            net.recv_socks);
+      setup_options(cmd, net, recv_party);
+      recv_party.ahe = recv_ahe;
+      run_party(net, recv_party, [&] { recv_party.offline(); },
+                [&] { return recv_party.online(); });
+      spdlog::debug("count: {}", recv_party.psi_ca_result);
+    } else {
+      PsiSenderISH sender_party(DIM, DELTA, num_s, num_r, THREAD_NUM,
+                                psi_key.pub_key, psi_key.priv_key, send_pts,
+                                net.send_socks);
+      sender_party.ahe = send_ahe;
+      run_party(net, sender_party, [&] { sender_party.offline(); },
+                [&] { return sender_party.online(); });
+    }
+    return;
+  }
 
   tVar timer;
   tStart(timer);
 
   PsiRecvISH recv_party(DIM, DELTA, num_r, num_s, THREAD_NUM, psi_key.pub_key,
-                        psi_key.priv_key, recv_pts, socketPair1);
+                        psi_key.priv_key, recv_pts, net.recv_socks);
 
   PsiSenderISH sender_party(DIM, DELTA, num_s, num_r, THREAD_NUM,
                             psi_key.pub_key, psi_key.priv_key, send_pts,
-                            socketPair0);
+                            net.send_socks);
+  setup_options(cmd, net, recv_party);
+  recv_party.ahe = recv_ahe;
+  sender_party.ahe = send_ahe;
 
   recv_party.offline();
   sender_party.offline();
 
   auto offline_time = tEnd(timer);
+  close_rounds("offline", recv_party, sender_party);
 
   tStart(timer);
-  std::thread recv_online(std::bind(&PsiRecvISH::online, &recv_party));
-  std::thread sender_online(std::bind(&PsiSenderISH::online, &sender_party));
-
-  recv_online.join();
-  sender_online.join();
+  run_online(net, recv_party.online(), sender_party.online());
 
   auto online_time = tEnd(timer);
-  auto com = socketPair0[0].bytesSent() + socketPair1[0].bytesSent();
+  close_rounds("online", recv_party, sender_party);
+  auto com = net.bytes_sent();
 
   spdlog::debug("count: {}", recv_party.psi_ca_result);
 
-  auto online_time_s_100 = online_time / 1000.0 + com / 1024.0 / 1024.0 / 11;
-  auto online_time_s_10 = online_time / 1000.0 + com / 1024.0 / 1024.0 / 1.1;
-
-  spdlog::info("offline time: {} s , online time: {} s; com: {} bytes, {} MB",
-               offline_time / 1000.0, online_time_s_100, com,
-               com / 1024.0 / 1024.0);
-  spdlog::info("offline time: {} s , online time: {} s; com: {} bytes, {} MB",
-               offline_time / 1000.0, online_time_s_10, com,
-               com / 1024.0 / 1024.0);
+  report_run(net, offline_time, online_time, com, recv_party, sender_party);
 }
 
 void run_psi_nonish(const oc::CLP &cmd) {
   const u64 DIM = cmd.getOr("d", 2);
   const u64 DELTA = cmd.getOr("delta", 10);
-  const u64 THREAD_NUM = 1;
+  const u64 THREAD_NUM = cmd.getOr<u64>("t", 1);
   const u64 num_s = 1ull << cmd.getOr("s", 5);
   const u64 num_s_log = cmd.getOr("s", 5);
   const u64 num_r = 1ull << cmd.getOr("r", 18);
@@ -312,9 +728,6 @@ void run_psi_nonish(const oc::CLP &cmd) {
   const bool sample_flag = cmd.isSet("sample");
   const bool sigma_flag = cmd.isSet("sigma");
 
-  const string IP = cmd.getOr<string>("ip", "127.0.0.1");
-  const u64 PORT = cmd.getOr<u64>("port", 1212);
-
   if ((intersection_size > num_s) | (intersection_size > num_r)) {
     spdlog::error("intersection_size should not be greater than set_size");
     return;
@@ -323,245 +736,241 @@ void run_psi_nonish(const oc::CLP &cmd) {
   spdlog::info("[psi_nonish] dim: {}, delta: {}, n_s: {}-{}, n_r: {}-{} ", DIM,
                DELTA, num_s_log, num_s, num_r_log, num_r);
 
+  PartyNet net;
+  if (!open_net(cmd, THREAD_NUM, net)) {
+    return;
+  }
+
   vector<pt> send_pts(num_s, vector<u64>(DIM, 0));
   vector<pt> recv_pts(num_r, vector<u64>(DIM, 0));
 
   sample_points(DIM, DELTA, num_s, num_r, intersection_size, send_pts, recv_pts,
-                sample_flag);
-
-  ipcl::initializeContext("QAT");
-  ipcl::KeyPair psi_key = ipcl::generateKeypair(2048, true);
-  ipcl::terminateContext();
-
-  vector<coproto::Socket> socketPair0, socketPair1;
-  // auto init_socks = [&](Role role) {
-  //   for (u64 i = 0; i < THREAD_NUM; ++i) {
-  //     auto port_temp = PORT + i;
-  //     auto addr = IP + ":" + std::to_string(port_temp);
-  //     if (role == Role::Sender) {
-  //       socketPair0.push_back(coproto::asioConnect(addr, true));
-  //     } else {
-  //       socketPair1.push_back(coproto::asioConnect(addr, false));
-  //     }
-  //   }
-  // };
-  // std::thread recv_socks(init_socks, Role::Recv);
-  // std::thread sender_socks(init_socks, Role::Sender);
-
-  // recv_socks.join();
-  // sender_socks.join();
-
-  coproto::LocalAsyncSocket local_socket;
-  auto pair_sock = local_socket.makePair();
-  socketPair0.push_back(pair_sock[0]);
-  socketPair1.push_back(pair_sock[1]);
+                sample_flag, pts_seed(cmd));
+
+  ipcl::KeyPair psi_key = psi_keypair(cmd, net, false);
+  std::shared_ptr<AheScheme> recv_ahe, send_ahe;
+  if (!zero_test_ahe(cmd, net, psi_key, recv_ahe, send_ahe)) {
+    return;
+  }
+
+  if (net.remote) {
+    if (net.role == Role::Recv) {
+      PsiRecvNonISH recv_party(DIM, DELTA, num_r, num_s, THREAD_NUM,
+                               psi_key.pub_key, psi_key.priv_key, recv_pts,
+                               sigma_flag, net.recv_socks);
+      setup_options(cmd, net, recv_party);
+      recv_party.ahe = recv_ahe;
+      run_party(net, recv_party, [&] { recv_party.offline(); },
+                [&] { return recv_party.online(); });
+      spdlog::debug("count: {}", recv_party.psi_ca_result);
+    } else {
+      PsiSenderNonISH sender_party(DIM, DELTA, num_s, num_r, THREAD_NUM,
+                                   psi_key.pub_key, psi_key.priv_key, send_pts,
+                                   sigma_flag, net.send_socks);
+      sender_party.ahe = send_ahe;
+      run_party(net, sender_party, [&] { sender_party.offline(); },
+                [&] { return sender_party.online(); });
+    }
+    return;
+  }
 
   tVar timer;
   tStart(timer);
 
   PsiSenderNonISH sender_party(DIM, DELTA, num_s, num_r, THREAD_NUM,
                                psi_key.pub_key, psi_key.priv_key, send_pts,
-                               sigma_flag, socketPair0);
+                               sigma_flag, net.send_socks);
   PsiRecvNonISH recv_party(DIM, DELTA, num_r, num_s, THREAD_NUM,
                            psi_key.pub_key, psi_key.priv_key, recv_pts,
-                           sigma_flag, socketPair1);
+                           sigma_flag, net.recv_socks);
+  setup_options(cmd, net, recv_party);
+  recv_party.ahe = recv_ahe;
+  sender_party.ahe = send_ahe;
 
   sender_party.offline();
   recv_party.offline();
   auto offline_time = tEnd(timer);
+  close_rounds("offline", recv_party, sender_party);
 
   tStart(timer);
-  std::thread sender_online(std::bind(&PsiSenderNonISH::online, &sender_party));
-  std::thread recv_online(std::bind(&PsiRecvNonISH::online, &recv_party));
-
-  sender_online.join();
-  recv_online.join();
+  run_online(net, sender_party.online(), recv_party.online());
   auto online_time = tEnd(timer);
-  auto com = socketPair0[0].bytesSent() + socketPair1[0].bytesSent();
+  close_rounds("online", recv_party, sender_party);
+  auto com = net.bytes_sent();
 
   spdlog::debug("count: {}", recv_party.psi_ca_result);
 
-  auto online_time_s_100 = online_time / 1000.0 + com / 1024.0 / 1024.0 / 11;
-  auto online_time_s_10 = online_time / 1000.0 + com / 1024.0 / 1024.0 / 1.1;
-
-  spdlog::info("offline time: {} s , online time: {} s; com: {} bytes, {} MB",
-               offline_time / 1000.0, online_time_s_100, com,
-               com / 1024.0 / 1024.0);
-  spdlog::info("offline time: {} s , online time: {} s; com: {} bytes, {} MB",
-               offline_time / 1000.0, online_time_s_10, com,
-               com / 1024.0 / 1024.0);
+  report_run(net, offline_time, online_time, com, recv_party, sender_party);
 }
 
 void run_oprf_ish(const oc::CLP &cmd) {
   const u64 DIM = cmd.getOr("d", 2);
   const u64 DELTA = cmd.getOr("delta", 10);
-  const u64 THREAD_NUM = 1;
+  const u64 THREAD_NUM = cmd.getOr<u64>("t", 1);
   const u64 num_p1 = 1ull << cmd.getOr("p1", 18);
   const u64 num_p2 = 1ull << cmd.getOr("p2", 5);
   const u64 intersection_size = cmd.getOr("i", 12);
   const bool sample_flag = cmd.isSet("sample");
 
-  const string IP = cmd.getOr<string>("ip", "127.0.0.1");
-  const u64 PORT = cmd.getOr<u64>("port", 1212);
-
   if ((intersection_size > num_p1) | (intersection_size > num_p2)) {
     spdlog::error("intersection_size should not be greater than set_size");
     return;
   }
 
+  PartyNet net;
+  if (!open_net(cmd, THREAD_NUM, net)) {
+    return;
+  }
+
   vector<pt> send_pts(num_p1, vector<u64>(DIM, 0));
   vector<pt> recv_pts(num_p2, vector<u64>(DIM, 0));
 
   sample_points(DIM, DELTA, num_p1, num_p2, intersection_size, send_pts,
-                recv_pts, sample_flag);
-
-  vector<coproto::Socket> socketPair0, socketPair1;
-  // auto init_socks = [&](Role role) {
-  //   for (u64 i = 0; i < THREAD_NUM; ++i) {
-  //     auto port_temp = PORT + i;
-  //     auto addr = IP + ":" + std::to_string(port_temp);
-  //     if (role == Role::Sender) {
-  //       socketPair0.push_back(coproto::asioConnect(addr, true));
-  //     } else {
-  //       socketPair1.push_back(coproto::asioConnect(addr, false));
-  //     }
-  //   }
-  // };
-
-  // std::thread recv_socks(init_socks, Role::Recv);
-  // std::thread sender_socks(init_socks, Role::Sender);
-
-  // recv_socks.join();
-  // sender_socks.join();
-
-  coproto::LocalAsyncSocket local_socket;
-  auto pair_sock = local_socket.makePair();
-  socketPair0.push_back(pair_sock[0]);
-  socketPair1.push_back(pair_sock[1]);
+                recv_pts, sample_flag, pts_seed(cmd));
 
   spdlog::info("[oprf ish] dim: {}, delta: {}, num_p1: {}, num_p2: {}", DIM,
                DELTA, num_p1, num_p2);
 
+  // p1 runs as the receiver, p2 as the sender
+  if (net.remote) {
+    if (net.role == Role::Recv) {
+      ShashOprfP1 p1_party(DIM, DELTA, num_p1, num_p2, THREAD_NUM, recv_pts,
+                           net.recv_socks);
+      run_party(net, p1_party, [&] { p1_party.offline_hash(); },
+                [&] { return p1_party.online_hash(); });
+    } else {
+      ShashOprfP2 p2_party(DIM, DELTA, num_p2, num_p1, THREAD_NUM, send_pts,
+                           net.send_socks);
+      run_party(net, p2_party, [&] { p2_party.offline_hash(); },
+                [&] { return p2_party.online_hash(); });
+    }
+    return;
+  }
+
   tVar timer;
   tStart(timer);
 
   ShashOprfP1 p1_party(DIM, DELTA, num_p1, num_p2, THREAD_NUM, recv_pts,
-                       socketPair0);
+                       net.recv_socks);
   ShashOprfP2 p2_party(DIM, DELTA, num_p2, num_p1, THREAD_NUM, send_pts,
-                       socketPair1);
+                       net.send_socks);
 
   p1_party.offline_hash();
   p2_party.offline_hash();
 
   auto offline_time = tEnd(timer);
+  close_rounds("offline", p1_party, p2_party);
 
   tStart(timer);
-  std::thread p2_hash_online(std::bind(&ShashOprfP2::online_hash, &p2_party));
-  std::thread p1_hash_online(std::bind(&ShashOprfP1::online_hash, &p1_party));
-
-  p2_hash_online.join();
-  p1_hash_online.join();
+  run_online(net, p2_party.online_hash(), p1_party.online_hash());
   auto online_time = tEnd(timer);
-  auto com = socketPair0[0].bytesSent() + socketPair1[0].bytesSent();
+  close_rounds("online", p1_party, p2_party);
+  auto com = net.bytes_sent();
 
-  auto online_time_s_100 = online_time / 1000.0 + com / 1024.0 / 1024.0 / 11;
-  auto online_time_s_10 = online_time / 1000.0 + com / 1024.0 / 1024.0 / 1.1;
-
-  spdlog::info("offline time: {} s , online time: {} s; com: {} bytes, {} MB",
-               offline_time / 1000.0, online_time_s_100, com,
-               com / 1024.0 / 1024.0);
-  spdlog::info("offline time: {} s , online time: {} s; com: {} bytes, {} MB",
-               offline_time / 1000.0, online_time_s_10, com,
-               com / 1024.0 / 1024.0);
+  report_run(net, offline_time, online_time, com, p1_party, p2_party);
 }
 
 void run_ahe_ish(const oc::CLP &cmd) {
   const u64 DIM = cmd.getOr("d", 2);
   const u64 DELTA = cmd.getOr("delta", 10);
-  const u64 THREAD_NUM = 1;
+  const u64 THREAD_NUM = cmd.getOr<u64>("t", 1);
   const u64 num_p1 = 1ull << cmd.getOr("p1", 18);
   const u64 num_p2 = 1ull << cmd.getOr("p2", 5);
   const u64 intersection_size = cmd.getOr("i", 12);
   const bool sample_flag = cmd.isSet("sample");
 
-  const string IP = cmd.getOr<string>("ip", "127.0.0.1");
-  const u64 PORT = cmd.getOr<u64>("port", 1212);
-
   if ((intersection_size > num_p1) | (intersection_size > num_p2)) {
     spdlog::error("intersection_size should not be greater than set_size");
     return;
   }
+  if (!paillier_only(cmd)) {
+    return;
+  }
+
+  PartyNet net;
+  if (!open_net(cmd, THREAD_NUM, net)) {
+    return;
+  }
 
   vector<pt> send_pts(num_p1, vector<u64>(DIM, 0));
   vector<pt> recv_pts(num_p2, vector<u64>(DIM, 0));
 
   sample_points(DIM, DELTA, num_p1, num_p2, intersection_size, send_pts,
-                recv_pts, sample_flag);
-
-  ipcl::initializeContext("QAT");
-  ipcl::KeyPair psi_key = ipcl::generateKeypair(2048, true);
-  ipcl::terminateContext();
-
-  vector<coproto::Socket> socketPair0, socketPair1;
-  // auto init_socks = [&](Role role) {
-  //   for (u64 i = 0; i < THREAD_NUM; ++i) {
-  //     auto port_temp = PORT + i;
-  //     auto addr = IP + ":" + std::to_string(port_temp);
-  //     if (role == Role::Sender) {
-  //       socketPair0.push_back(coproto::asioConnect(addr, true));
-  //     } else {
-  //       socketPair1.push_back(coproto::asioConnect(addr, false));
-  //     }
-  //   }
-  // };
-
-  // std::thread recv_socks(init_socks, Role::Recv);
-  // std::thread sender_socks(init_socks, Role::Sender);
-
-  // recv_socks.join();
-  // sender_socks.join();
-
-  coproto::LocalAsyncSocket local_socket;
-  auto pair_sock = local_socket.makePair();
-  socketPair0.push_back(pair_sock[0]);
-  socketPair1.push_back(pair_sock[1]);
+                recv_pts, sample_flag, pts_seed(cmd));
+
+  ipcl::KeyPair psi_key = psi_keypair(cmd, net, false);
 
   spdlog::info("[ahe ish] dim: {}, delta: {}, num_p1: {}, num_p2: {}", DIM,
                DELTA, num_p1, num_p2);
 
-  vector<vector<vector<block>>> shash_encodings;
+  // p1 runs as the receiver, p2 as the sender
+  if (net.remote) {
+    vector<vector<block>> shash_encodings;
+    if (net.role == Role::Recv) {
+      ShashAheP1 p1_party(DIM, DELTA, num_p1, num_p2, THREAD_NUM,
+                          psi_key.pub_key, psi_key.priv_key, send_pts,
+                          net.recv_socks);
+      setup_options(cmd, net, p1_party);
+      // in one process p2 reads p1's offline encodings, here they go over
+      // the wire before the online clock starts
+      auto offline = [&] {
+        p1_party.offline(shash_encodings);
+        for (auto &encoding : shash_encodings) {
+          coproto::sync_wait(net.recv_socks[0].send(encoding));
+        }
+        coproto::sync_wait(net.recv_socks[0].flush());
+      };
+      run_party(net, p1_party, offline,
+                [&] { return p1_party.online(shash_encodings); });
+    } else {
+      ShashAheP2 p2_party(DIM, DELTA, num_p2, num_p1, THREAD_NUM,
+                          psi_key.pub_key, psi_key.priv_key, recv_pts,
+                          net.send_socks);
+      auto offline = [&] {
+        p2_party.offline();
+        shash_encodings.resize(DIM);
+        for (auto &encoding : shash_encodings) {
+          coproto::sync_wait(net.send_socks[0].recvResize(encoding));
+        }
+      };
+      run_party(net, p2_party, offline,
+                [&] { return p2_party.online(shash_encodings); });
+    }
+    return;
+  }
+
+  vector<vector<block>> shash_encodings;
 
   tVar timer;
   tStart(timer);
 
   ShashAheP1 p1_party(DIM, DELTA, num_p1, num_p2, THREAD_NUM, psi_key.pub_key,
-                      psi_key.priv_key, send_pts, socketPair0);
+                      psi_key.priv_key, send_pts, net.recv_socks);
   ShashAheP2 p2_party(DIM, DELTA, num_p2, num_p1, THREAD_NUM, psi_key.pub_key,
-                      psi_key.priv_key, recv_pts, socketPair1);
+                      psi_key.priv_key, recv_pts, net.send_socks);
+  setup_options(cmd, net, p1_party);
 
   p1_party.offline(shash_encodings);
   p2_party.offline();
 
   auto offline_time = tEnd(timer);
+  close_rounds("offline", p1_party, p2_party);
 
   tStart(timer);
-  std::thread p1_online(
-      std::bind(&ShashAheP1::online, &p1_party, shash_encodings));
-  std::thread p2_online(
-      std::bind(&ShashAheP2::online, &p2_party, shash_encodings));
-
-  p1_online.join();
-  p2_online.join();
+  run_online(net, p1_party.online(shash_encodings),
+             p2_party.online(shash_encodings));
   auto online_time = tEnd(timer);
-  auto com = socketPair0[0].bytesSent() + socketPair1[0].bytesSent();
+  close_rounds("online", p1_party, p2_party);
+  auto com = net.bytes_sent();
 
-  auto online_time_s_100 = online_time / 1000.0 + com / 1024.0 / 1024.0 / 11;
-  auto online_time_s_10 = online_time / 1000.0 + com / 1024.0 / 1024.0 / 1.1;
+  report_run(net, offline_time, online_time, com, p1_party, p2_party);
+}
 
-  spdlog::info("offline time: {} s , online time: {} s; com: {} bytes, {} MB",
-               offline_time / 1000.0, online_time_s_100, com,
-               com / 1024.0 / 1024.0);
-  spdlog::info("offline time: {} s , online time: {} s; com: {} bytes, {} MB",
-               offline_time / 1000.0, online_time_s_10, com,
-               com / 1024.0 / 1024.0);
-}
\ No newline at end of file
+void run_key_pool_fill(const oc::CLP &cmd) {
+  const string dir = cmd.getOr<string>("keypool", "");
+  if (dir.empty()) {
+    spdlog::error("--keypool_fill needs --keypool <dir>");
+    return;
+  }
+  PaillierKeyPool(dir, KEY_POOL_SIZE).fill();
+}
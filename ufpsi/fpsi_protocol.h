@@ -17,4 +17,7 @@ void run_psi_nonish(const oc::CLP &cmd);
 
 void run_oprf_ish(const oc::CLP &cmd);
 
-void run_ahe_ish(const oc::CLP &cmd);
\ No newline at end of file
+void run_ahe_ish(const oc::CLP &cmd);
+
+// generates keys into the --keypool directory until it is full
+void run_key_pool_fill(const oc::CLP &cmd);
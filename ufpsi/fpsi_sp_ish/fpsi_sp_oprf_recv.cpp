@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cmath>
 #include <ipcl/plaintext.hpp>
 #include <ipcl/utils/context.hpp>
@@ -12,7 +13,10 @@
 
 #include "config.h"
 #include "fpsi_sp_oprf_recv.h"
+#include "paillier/engine.h"
 #include "rb_okvs/rb_okvs.h"
+#include "rb_okvs/rb_okvs_fixed.h"
+#include "rb_okvs/rb_okvs_stream.h"
 #include "rr22/Oprf.h"
 #include "utils/util.h"
 
@@ -54,47 +58,58 @@ void PsiSpRecvISH::fuzzy_matching_offline() {
   rb_okvs.init(PTS_NUM * DIM * (2 * DELTA + 1), OKVS_EPSILON, OKVS_LAMBDA,
                OKVS_SEED);
 
-  fmatch_values.resize((PTS_NUM * DIM * (2 * DELTA + 1)));
+  fmatch_values.resize(PTS_NUM * DIM * (2 * DELTA + 1) *
+                       PAILLIER_CIPHER_SIZE_IN_BLOCK);
   for (u64 i = 0; i < PTS_NUM * DIM; i++) {
     for (u64 j = 0; j < 2 * DELTA + 1; j++) {
-      fmatch_values[i * (2 * DELTA + 1) + j] = zero_ciphers_blks[j];
+      std::copy(zero_ciphers_blks[j].begin(), zero_ciphers_blks[j].end(),
+                fmatch_values.begin() +
+                    (i * (2 * DELTA + 1) + j) * PAILLIER_CIPHER_SIZE_IN_BLOCK);
     }
   }
 }
 
-void PsiSpRecvISH::online_hash() {
+coproto::task<void> PsiSpRecvISH::online_hash() {
 
   /// PSV Recv Step 1
 
   vector<block> oprf_vals(PTS_NUM * DIM);
 
   volePSI::RsOprfReceiver oprfRecv;
-  coproto::sync_wait(oprfRecv.receive(oprf_keys, oprf_vals, prng, sockets[0]));
+  co_await oprfRecv.receive(oprf_keys, oprf_vals, prng, sockets[0], THREAD_NUM);
 
   spdlog::debug("P2 Step 1 oprf finished");
 
   /// PSV Recv Step 3 and Step 4
   u64 mN = OTHER_PTS_NUM * (2 * DELTA + 1);
-  u64 mSize;
-  coproto::sync_wait(sockets[0].recv(mSize));
-  coproto::sync_wait(sockets[0].flush());
+  u64 mSize = (co_await recv_frame()).get<u64>();
 
   vector<vector<block>> encodings(DIM, vector<block>(mSize));
-
-  for (u64 i = 0; i < DIM; i++) {
-    coproto::sync_wait(sockets[0].recvResize(encodings[i]));
-  }
-  coproto::sync_wait(sockets[0].flush());
+  // dim j is decoded while the next one is received
+  std::vector<macoro::eager_task<void>> receiving;
+  receiving.reserve(DIM);
+  receiving.push_back(recv_payload(encodings[0]) | macoro::make_eager());
 
   RBOKVS rb_okvs;
   rb_okvs.init(mN, OKVS_EPSILON, OKVS_LAMBDA, OKVS_SEED);
 
   H2_sums.resize(PTS_NUM, ZeroBlock);
 
-  for (u64 i = 0; i < PTS_NUM; i++) {
-    for (u64 j = 0; j < DIM; j++) {
-      auto tmp = rb_okvs.decode(encodings[j].data(), block(pts[i][j], j));
-      H2_sums[i] = H2_sums[i] ^ tmp ^ oprf_vals[i * DIM + j];
+  vector<block> decode_keys(PTS_NUM);
+  vector<block> decode_vals(PTS_NUM);
+  for (u64 j = 0; j < DIM; j++) {
+    for (u64 i = 0; i < PTS_NUM; i++) {
+      decode_keys[i] = block(pts[i][j], j);
+    }
+    co_await receiving[j];
+    if (j + 1 < DIM) {
+      receiving.push_back(recv_payload(encodings[j + 1]) |
+                          macoro::make_eager());
+    }
+    rb_okvs.decode(encodings[j].data(), decode_keys.data(), PTS_NUM,
+                   decode_vals.data(), THREAD_NUM);
+    for (u64 i = 0; i < PTS_NUM; i++) {
+      H2_sums[i] = H2_sums[i] ^ decode_vals[i] ^ oprf_vals[i * DIM + j];
     }
   }
 
@@ -108,87 +123,98 @@ void PsiSpRecvISH::offline() {
   fuzzy_matching_offline();
 }
 
-void PsiSpRecvISH::online() {
-  online_hash();
+coproto::task<void> PsiSpRecvISH::online() {
+  co_await online_hash();
 
-  u64 setup_mN;
-  u64 setup_mSize;
-  coproto::sync_wait(sockets[0].recv(setup_mN));
-  coproto::sync_wait(sockets[0].recv(setup_mSize));
-  coproto::sync_wait(sockets[0].flush());
-
-  vector<vector<block>> setup_encoding;
-  vector<block> setup_encoding_flat(setup_mSize *
-                                    PAILLIER_CIPHER_SIZE_IN_BLOCK);
-  coproto::sync_wait(sockets[0].recvResize(setup_encoding_flat));
-  coproto::sync_wait(sockets[0].flush());
-
-  setup_encoding =
-      chunkFixedSizeBlocks(setup_encoding_flat, PAILLIER_CIPHER_SIZE_IN_BLOCK);
+  auto setup_header = co_await recv_frame();
+  u64 setup_mN = setup_header.get<u64>();
+  u64 setup_mSize = setup_header.get<u64>();
 
   RBOKVS decode_okvs;
   decode_okvs.init(setup_mN, OKVS_EPSILON, OKVS_LAMBDA, OKVS_SEED);
 
-  vector<BigNumber> decode_bns(PTS_NUM * DIM);
-  for (u64 i = 0; i < PTS_NUM; i++) {
-    for (u64 j = 0; j < DIM; j++) {
-      decode_bns[i * DIM + j] = block_vector_to_bignumer(decode_okvs.decode(
-          setup_encoding, get_key_from_sum_dim(H2_sums[i], j),
-          PAILLIER_CIPHER_SIZE_IN_BLOCK));
+  // each key is decoded as soon as the columns of its band are in
+  vector<block> decode_keys(PTS_NUM * DIM);
+  parallel_for(PTS_NUM, THREAD_NUM, [&](u64 start, u64 end) {
+    for (u64 i = start; i < end; i++) {
+      for (u64 j = 0; j < DIM; j++) {
+        decode_keys[i * DIM + j] = get_key_from_sum_dim(H2_sums[i], j);
+      }
     }
-  }
-
-  auto sum_ciphers = ipcl::CipherText(palliar_pk, decode_bns) + masks_ciphers;
-
-  auto sum_ciphers_blks = bignumers_to_block_vector(sum_ciphers.getTexts());
-  coproto::sync_wait(sockets[0].send(sum_ciphers.getSize()));
-  coproto::sync_wait(sockets[0].flush());
-
-  coproto::sync_wait(sockets[0].send(sum_ciphers_blks));
-  coproto::sync_wait(sockets[0].flush());
+  });
+  vector<block> decode_blks(PTS_NUM * DIM * PAILLIER_CIPHER_SIZE_IN_BLOCK);
+  RBOKVSStreamDecoder decoder(decode_okvs, decode_keys,
+                              PAILLIER_CIPHER_SIZE_IN_BLOCK, decode_blks,
+                              THREAD_NUM);
+
+  // the chunks land in place and are decoded there, the encoding is the only
+  // copy and is unmapped once every key is decoded
+  EncodingBuffer setup_encoding(setup_mSize * PAILLIER_CIPHER_SIZE_IN_BLOCK);
+  co_await recv_encoding_stream(
+      setup_encoding, PAILLIER_CIPHER_SIZE_IN_BLOCK,
+      [&](u64 lo) { decoder.advance(setup_encoding.data().data(), lo); });
+  setup_encoding.release();
+  vector<BigNumber> decode_bns(PTS_NUM * DIM);
+  blocks_to_bignumers(decode_blks, decode_bns, THREAD_NUM);
+  decode_blks.clear();
+  decode_blks.shrink_to_fit();
+
+  auto sum_ciphers = PaillierEngine(palliar_pk, THREAD_NUM)
+                         .add({decode_bns, masks_ciphers.getTexts()});
+
+  vector<block> sum_ciphers_blks(sum_ciphers.getSize() *
+                                 PAILLIER_CIPHER_SIZE_IN_BLOCK);
+  bignumers_to_blocks(sum_ciphers.getTexts(), sum_ciphers_blks, THREAD_NUM);
+  FrameWriter sum_frame;
+  sum_frame.put<u64>(sum_ciphers.getSize());
+  co_await send_frame(sum_frame);
+  // the sums are on their way while the fmatch encoding is built
+  auto sending_sums = send_payload(sum_ciphers_blks) | macoro::make_eager();
 
-  vector<block> fmatch_keys;
-  fmatch_keys.reserve(PTS_NUM * DIM * (2 * (DELTA + 1)));
   // Fmatch
-  for (u64 i = 0; i < PTS_NUM; i++) {
-    for (u64 j = 0; j < DIM; j++) {
-      auto tmp = pts[i][j] + masks[i * DIM + j];
-      for (u64 i = tmp - DELTA; i <= tmp + DELTA; i++) {
-        fmatch_keys.push_back(get_key_from_pt_dim(i, j));
+  const u64 interval_len = 2 * DELTA + 1;
+  vector<block> fmatch_keys(PTS_NUM * DIM * interval_len);
+  parallel_for(PTS_NUM, THREAD_NUM, [&](u64 start, u64 end) {
+    for (u64 i = start; i < end; i++) {
+      for (u64 j = 0; j < DIM; j++) {
+        auto tmp = pts[i][j] + masks[i * DIM + j];
+        auto *out = fmatch_keys.data() + (i * DIM + j) * interval_len;
+        for (u64 x = 0; x < interval_len; x++) {
+          out[x] = get_key_from_pt_dim(tmp - DELTA + x, j);
+        }
       }
     }
-  }
+  });
 
   std::unordered_set<block> fmatch_keys_set(fmatch_keys.begin(),
                                             fmatch_keys.end());
   std::vector<block> fmatch_keys_re(fmatch_keys_set.begin(),
                                     fmatch_keys_set.end());
 
-  padding_keys(fmatch_keys_re, fmatch_values.size());
+  padding_keys(fmatch_keys_re,
+               fmatch_values.size() / PAILLIER_CIPHER_SIZE_IN_BLOCK);
 
-  RBOKVS fmatch_okvr;
+  RBOKVS_Fixed<PAILLIER_CIPHER_SIZE_IN_BLOCK> fmatch_okvr;
   fmatch_okvr.init(fmatch_keys_re.size(), OKVS_EPSILON, OKVS_LAMBDA, OKVS_SEED);
-  vector<vector<block>> fmatch_encoding(
-      fmatch_okvr.mSize, vector<block>(PAILLIER_CIPHER_SIZE_IN_BLOCK));
-  fmatch_okvr.encode(fmatch_keys_re, fmatch_values,
-                     PAILLIER_CIPHER_SIZE_IN_BLOCK, fmatch_encoding);
-
-  auto flat_fmatch_encoding = flattenBlocks(fmatch_encoding);
+  vector<block> fmatch_encoding(fmatch_okvr.encodingSize());
+  fmatch_okvr.encodeDeferred(fmatch_keys_re, fmatch_values, fmatch_encoding);
 
-  coproto::sync_wait(sockets[0].send(fmatch_okvr.mN));
-  coproto::sync_wait(sockets[0].send(fmatch_okvr.mSize));
-  coproto::sync_wait(sockets[0].flush());
-  coproto::sync_wait(sockets[0].send(flat_fmatch_encoding));
-  coproto::sync_wait(sockets[0].flush());
+  co_await sending_sums;
+  FrameWriter fmatch_header;
+  fmatch_header.put<u64>(fmatch_okvr.mN).put<u64>(fmatch_okvr.mSize);
+  co_await send_frame(fmatch_header);
+  co_await send_payload(fmatch_encoding);
 
-  vector<block> add_cipher_blks;
-  coproto::sync_wait(sockets[0].recvResize(add_cipher_blks));
-  coproto::sync_wait(sockets[0].flush());
+  auto add_header = co_await recv_frame();
+  vector<block> add_cipher_blks(add_header.get<u64>() *
+                                PAILLIER_CIPHER_SIZE_IN_BLOCK);
+  co_await recv_payload(add_cipher_blks);
 
-  auto add_cipher_bns = block_vector_to_bignumers(add_cipher_blks, PTS_NUM);
+  vector<BigNumber> add_cipher_bns(PTS_NUM);
+  blocks_to_bignumers(add_cipher_blks, add_cipher_bns, THREAD_NUM);
 
-  auto fmatch_res_pt =
-      palliar_sk.decrypt(ipcl::CipherText(palliar_pk, add_cipher_bns));
+  PaillierEngine paillier(palliar_pk, THREAD_NUM);
+  auto fmatch_res_pt = paillier.decrypt(palliar_sk, add_cipher_bns);
 
   vector<u64> fmatch_res(PTS_NUM);
   for (u64 i = 0; i < PTS_NUM; i++) {
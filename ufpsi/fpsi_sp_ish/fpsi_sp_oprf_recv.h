@@ -35,7 +35,7 @@ public:
   ipcl::CipherText masks_ciphers;
 
   //
-  vector<vector<block>> fmatch_values;
+  vector<block> fmatch_values;
 
   u64 psi_ca_result = 0;
 
@@ -63,6 +63,6 @@ public:
   void fuzzy_matching_offline();
   void offline();
 
-  void online_hash();
-  void online();
+  coproto::task<void> online_hash();
+  coproto::task<void> online();
 };
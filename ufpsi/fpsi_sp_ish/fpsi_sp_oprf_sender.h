@@ -35,7 +35,9 @@ public:
   vector<block> H1_sums;
 
   //
-  vector<vector<block>> setup_encoding;
+  EncodingBuffer setup_encoding;
+  // what online() sends, setup_encoding or the mapping of a saved encoding
+  std::span<block> setup_view;
 
   void clear() {
     for (auto socket : sockets) {
@@ -57,7 +59,7 @@ public:
   void offline_hash();
   void setup();
 
-  void online_hash();
+  coproto::task<void> online_hash();
   void offline();
-  void online();
+  coproto::task<void> online();
 };
\ No newline at end of file
@@ -39,7 +39,7 @@ public:
   ipcl::CipherText masks_ciphers;
 
   //
-  vector<vector<block>> fmatch_values;
+  vector<block> fmatch_values;
 
   u64 psi_ca_result = 0;
 
@@ -69,5 +69,5 @@ public:
   void fuzzy_matching_offline();
   void offline();
 
-  void online();
+  coproto::task<void> online();
 };
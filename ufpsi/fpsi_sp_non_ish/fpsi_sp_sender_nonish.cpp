@@ -14,70 +14,73 @@
 
 #include "config.h"
 #include "fpsi_sp_sender_nonish.h"
+#include "paillier/engine.h"
 #include "rb_okvs/rb_okvs.h"
+#include "rb_okvs/rb_okvs_fixed.h"
 #include "rr22/Oprf.h"
 #include "utils/util.h"
 
 void PsiSpSenderNonISH::non_isp_offline() {
   H1_sums.resize(PTS_NUM);
-  for (u64 i = 0; i < H1_sums.size(); i++) {
-    auto cells = intersection(pts[i], DIM, DELTA, SIGMA);
-    for (auto cell : cells) {
-      H1_sums[i].push_back(get_key_from_point(cell));
+  parallel_for(PTS_NUM, THREAD_NUM, [&](u64 start, u64 end) {
+    for (u64 i = start; i < end; i++) {
+      auto cells = intersection(pts[i], DIM, DELTA, SIGMA);
+      for (auto cell : cells) {
+        H1_sums[i].push_back(get_key_from_point(cell));
+      }
     }
-  }
+  });
 }
 
 void PsiSpSenderNonISH::setup() {
   u64 okvr_size = PTS_NUM * DIM * BLK_CELLS;
-  // note: random gen
-  // ipcl::initializeContext("QAT");
-  // ipcl::setHybridMode(ipcl::HybridMode::OPTIMAL);
-
-  // vector<BigNumber> enc_bns(okvr_size);
-
-  // for (u64 i = 0; i < PTS_NUM; i++) {
-  //   for (u64 j = 0; j < DIM; j++) {
-  //     enc_bns[i * DIM + j] =
-  //         BigNumber(reinterpret_cast<Ipp32u *>(&pts[i][j]), 2);
-  //   }
-  // }
-
-  // ipcl::PlainText pt_plains = ipcl::PlainText(enc_bns);
-  // ipcl::CipherText pt_ciphers = palliar_pk.encrypt(pt_plains);
-  // auto pt_ciphers_blks = bignumers_to_blocks_vector(pt_ciphers.getTexts());
-  // ipcl::terminateContext();
-
-  // vector<block> keys;
-  // vector<vector<block>> values;
-  // keys.reserve(okvr_size);
-  // values.reserve(okvr_size);
-
-  // for (u64 i = 0; i < PTS_NUM; i++) {
-  //   for (u64 j = 0; j < DIM; j++) {
-  //     for (u64 index = 0; index < BLK_CELLS; index++) {
-  //       keys.push_back(get_key_from_sum_dim(H1_sums[i][index], j));
-  //       values.push_back(pt_ciphers_blks[i * DIM + j]);
-  //     }
-  //   }
-  // }
-
-  // RBOKVS rb_okvs;
-  // rb_okvs.init(okvr_size, OKVS_EPSILON, OKVS_LAMBDA, OKVS_SEED);
-
-  // setup_encoding.resize(rb_okvs.mSize,
-  //                       vector<block>(PAILLIER_CIPHER_SIZE_IN_BLOCK));
-  // rb_okvs.encode(keys, values, PAILLIER_CIPHER_SIZE_IN_BLOCK,
-  // setup_encoding);
-
-  RBOKVS rb_okvs;
-  rb_okvs.init(okvr_size, OKVS_EPSILON, OKVS_LAMBDA, OKVS_SEED);
-
-  setup_encoding.resize(rb_okvs.mSize,
-                        vector<block>(PAILLIER_CIPHER_SIZE_IN_BLOCK));
-
-  for (auto tmp : setup_encoding) {
-    prng.get<block>(tmp.data(), PAILLIER_CIPHER_SIZE_IN_BLOCK);
+  RBOKVS_Fixed<PAILLIER_CIPHER_SIZE_IN_BLOCK> rb_okvs;
+  auto param = rb_okvs.getParams(okvr_size, OKVS_EPSILON, OKVS_LAMBDA,
+                                 OKVS_SEED);
+  rb_okvs.init(param);
+
+  auto tag = setup_tag(pts, {DIM, DELTA, SIGMA, real_setup},
+                       *palliar_pk.getN());
+  const string cache_name = "sp_sender_nonish";
+  if (load_setup_encoding(cache_name, param, PAILLIER_CIPHER_SIZE_IN_BLOCK,
+                          tag)) {
+    setup_view = cached_encoding.data();
+  } else {
+    setup_encoding.allocate(rb_okvs.encodingSize(), encoding_handoff);
+    setup_view = setup_encoding.data();
+    if (real_setup) {
+      // the encrypted coordinates of each point, under the keys of every
+      // cell of its block
+      vector<u64> coords(PTS_NUM * DIM);
+      for (u64 i = 0; i < PTS_NUM; i++) {
+        for (u64 j = 0; j < DIM; j++) {
+          coords[i * DIM + j] = pts[i][j];
+        }
+      }
+      auto ciphers = setup_encrypt(palliar_pk, coords, THREAD_NUM);
+
+      vector<block> keys(okvr_size);
+      vector<block> values(okvr_size * PAILLIER_CIPHER_SIZE_IN_BLOCK);
+      parallel_for(PTS_NUM, THREAD_NUM, [&](u64 start, u64 end) {
+        for (u64 i = start; i < end; i++) {
+          for (u64 j = 0; j < DIM; j++) {
+            auto cipher = ciphers.begin() +
+                          (i * DIM + j) * PAILLIER_CIPHER_SIZE_IN_BLOCK;
+            for (u64 c = 0; c < BLK_CELLS; c++) {
+              u64 k = (i * DIM + j) * BLK_CELLS + c;
+              keys[k] = get_key_from_sum_dim(H1_sums[i][c], j);
+              std::copy(cipher, cipher + PAILLIER_CIPHER_SIZE_IN_BLOCK,
+                        values.begin() + k * PAILLIER_CIPHER_SIZE_IN_BLOCK);
+            }
+          }
+        }
+      });
+      rb_okvs.encode(keys, values, setup_view);
+    } else {
+      prng.get<block>(setup_view.data(), setup_view.size());
+    }
+    store_setup_encoding(cache_name, param, PAILLIER_CIPHER_SIZE_IN_BLOCK,
+                         tag, setup_view);
   }
 
   H1_sums.clear();
@@ -89,44 +92,32 @@ void PsiSpSenderNonISH::offline() {
   setup();
 }
 
-void PsiSpSenderNonISH::online() {
+coproto::task<void> PsiSpSenderNonISH::online() {
 
   auto setup_mN = DIM * PTS_NUM * BLK_CELLS;
-  coproto::sync_wait(sockets[0].send(setup_mN));
-  coproto::sync_wait(sockets[0].send(setup_encoding.size()));
-  coproto::sync_wait(sockets[0].flush());
-
-  auto flat_encode_blocks = flattenBlocks(setup_encoding);
+  u64 setup_mSize = setup_view.size() / PAILLIER_CIPHER_SIZE_IN_BLOCK;
+  FrameWriter setup_header;
+  setup_header.put<u64>(setup_mN).put<u64>(setup_mSize);
+  co_await send_frame(setup_header);
 
   auto tmp_com = sockets[0].bytesSent();
 
-  auto flat_size = flat_encode_blocks.size();
-  auto deal = flat_size / COM_CHUNK_SIZE;
-  auto remainder = flat_size % COM_CHUNK_SIZE;
-
-  for (u64 i = 0; i < deal; i++) {
-    std::span<block> view(flat_encode_blocks.data() + i * COM_CHUNK_SIZE,
-                          COM_CHUNK_SIZE);
-    coproto::sync_wait(sockets[0].send(view));
-  }
+  co_await send_encoding_stream(setup_view, PAILLIER_CIPHER_SIZE_IN_BLOCK,
+                                &setup_encoding);
 
-  std::span<block> view(flat_encode_blocks.data() + deal * COM_CHUNK_SIZE,
-                        remainder);
-  coproto::sync_wait(sockets[0].send(view));
-  coproto::sync_wait(sockets[0].flush());
+  setup_encoding.release();
+  setup_view = {};
+  cached_encoding.close();
 
-  setup_encoding.clear();
-  setup_encoding.shrink_to_fit();
-
-  u64 sum_size;
-  coproto::sync_wait(sockets[0].recv(sum_size));
-  coproto::sync_wait(sockets[0].flush());
+  auto sum_frame = co_await recv_frame();
+  u64 sum_size = sum_frame.get<u64>();
   vector<block> sum_blks(sum_size * PAILLIER_CIPHER_SIZE_IN_BLOCK);
-  coproto::sync_wait(sockets[0].recvResize(sum_blks));
-  coproto::sync_wait(sockets[0].flush());
+  co_await recv_payload(sum_blks);
 
-  auto sum_bns = block_vector_to_bignumers(sum_blks, sum_size);
-  auto sum_dec = palliar_sk.decrypt(ipcl::CipherText(palliar_pk, sum_bns));
+  vector<BigNumber> sum_bns(sum_size);
+  blocks_to_bignumers(sum_blks, sum_bns, THREAD_NUM);
+  auto sum_dec =
+      PaillierEngine(palliar_pk, THREAD_NUM).decrypt(palliar_sk, sum_bns);
 
   vector<u64> sum(sum_size);
   for (u64 i = 0; i < sum_size; i++) {
@@ -134,39 +125,40 @@ void PsiSpSenderNonISH::online() {
     sum[i] = ((u64)tmp[1] << 32) | tmp[0];
   }
 
-  u64 mN_fmatch, mSize_fmatch;
-  coproto::sync_wait(sockets[0].recv(mN_fmatch));
-  coproto::sync_wait(sockets[0].recv(mSize_fmatch));
-  coproto::sync_wait(sockets[0].flush());
+  auto fmatch_header = co_await recv_frame();
+  u64 mN_fmatch = fmatch_header.get<u64>();
+  u64 mSize_fmatch = fmatch_header.get<u64>();
 
   vector<block> flat_fmatch_encoding(mSize_fmatch *
                                      PAILLIER_CIPHER_SIZE_IN_BLOCK);
-  coproto::sync_wait(sockets[0].recvResize(flat_fmatch_encoding));
-  coproto::sync_wait(sockets[0].flush());
-
-  auto fmatch_encoding =
-      chunkFixedSizeBlocks(flat_fmatch_encoding, PAILLIER_CIPHER_SIZE_IN_BLOCK);
+  co_await recv_payload(flat_fmatch_encoding);
 
   RBOKVS rb_okvs_fmatch;
   rb_okvs_fmatch.init(mN_fmatch, OKVS_EPSILON, OKVS_LAMBDA, OKVS_SEED);
 
   vector<vector<BigNumber>> fmatch_bns(DIM);
-  for (u64 i = 0; i < OTHER_PTS_NUM; i++) {
-    for (u64 j = 0; j < DIM; j++) {
-      auto tmp = rb_okvs_fmatch.decode(fmatch_encoding,
-                                       get_key_from_pt_dim(sum[i * DIM + j], j),
-                                       PAILLIER_CIPHER_SIZE_IN_BLOCK);
-      fmatch_bns[j].push_back(block_vector_to_bignumer(tmp));
-    }
+  vector<block> fmatch_keys(OTHER_PTS_NUM);
+  vector<block> fmatch_blks(OTHER_PTS_NUM * PAILLIER_CIPHER_SIZE_IN_BLOCK);
+  for (u64 j = 0; j < DIM; j++) {
+    parallel_for(OTHER_PTS_NUM, THREAD_NUM, [&](u64 start, u64 end) {
+      for (u64 i = start; i < end; i++) {
+        fmatch_keys[i] = get_key_from_pt_dim(sum[i * DIM + j], j);
+      }
+    });
+    rb_okvs_fmatch.decode(flat_fmatch_encoding, fmatch_keys,
+                          PAILLIER_CIPHER_SIZE_IN_BLOCK, fmatch_blks,
+                          THREAD_NUM);
+    fmatch_bns[j].resize(OTHER_PTS_NUM);
+    blocks_to_bignumers(fmatch_blks, fmatch_bns[j], THREAD_NUM);
   }
 
-  auto dim0 = ipcl::CipherText(palliar_pk, fmatch_bns[0]);
-  for (u64 i = 1; i < DIM; i++) {
-    auto tmp = ipcl::CipherText(palliar_pk, fmatch_bns[i]);
-    dim0 = dim0 + tmp;
-  }
+  auto dim0 = PaillierEngine(palliar_pk, THREAD_NUM).add(fmatch_bns);
 
-  auto add_cipher_blks = bignumers_to_block_vector(dim0.getTexts());
-  coproto::sync_wait(sockets[0].send(add_cipher_blks));
-  coproto::sync_wait(sockets[0].flush());
+  vector<block> add_cipher_blks(dim0.getSize() *
+                                PAILLIER_CIPHER_SIZE_IN_BLOCK);
+  bignumers_to_blocks(dim0.getTexts(), add_cipher_blks, THREAD_NUM);
+  FrameWriter add_header;
+  add_header.put<u64>(dim0.getSize());
+  co_await send_frame(add_header);
+  co_await send_payload(add_cipher_blks);
 }
\ No newline at end of file
@@ -39,7 +39,9 @@ public:
   vector<vector<block>> H1_sums;
 
   //
-  vector<vector<block>> setup_encoding;
+  EncodingBuffer setup_encoding;
+  // what online() sends, setup_encoding or the mapping of a saved encoding
+  std::span<block> setup_view;
 
   void clear() {
     for (auto socket : sockets) {
@@ -66,5 +68,5 @@ public:
   void setup();
 
   void offline();
-  void online();
+  coproto::task<void> online();
 };
\ No newline at end of file
@@ -14,12 +14,14 @@
 #include <spdlog/spdlog.h>
 
 #include "config.h"
+#include "paillier/engine.h"
 #include "rb_okvs/rb_okvs.h"
+#include "rb_okvs/rb_okvs_fixed.h"
 #include "rr22/Oprf.h"
 #include "shash_ahe_p1.h"
 #include "utils/util.h"
 
-void ShashAheP1::offline(vector<vector<vector<block>>> &shash_encodings) {
+void ShashAheP1::offline(vector<vector<block>> &shash_encodings) {
 
   vector<vector<pair<u64, u64>>> intervals(DIM);
 
@@ -27,13 +29,10 @@ void ShashAheP1::offline(vector<vector<vector<block>>> &shash_encodings) {
   shash_values.resize(DIM);
 
   vector<u64> random_values(PTS_NUM * DIM);
-  vector<BigNumber> random_bns(PTS_NUM * DIM);
 
   for (u64 i = 0; i < PTS_NUM; i++) {
     for (u64 j = 0; j < DIM; j++) {
       random_values[i * DIM + j] = prng.get<u64>() >> DIM;
-      random_bns[i * DIM + j] =
-          BigNumber(reinterpret_cast<Ipp32u *>(&random_values[i * DIM + j]), 2);
     }
   }
 
@@ -82,83 +81,72 @@ void ShashAheP1::offline(vector<vector<vector<block>>> &shash_encodings) {
     }
   }
 
-  // for (u64 i = 0; i < 5; i++) {
-  //   std::cout << "i " << i << " " << sums[i] << endl;
-  // }
-
-  // ipcl::initializeContext("QAT");
-  // ipcl::setHybridMode(ipcl::HybridMode::OPTIMAL);
-  // ipcl::PlainText random_plains = ipcl::PlainText(random_bns);
-  // ipcl::CipherText pt_ciphers = palliar_pk.encrypt(random_plains);
-  // auto random_blks = bignumers_to_blocks_vector(pt_ciphers.getTexts());
-  // ipcl::terminateContext();
-
-  // for (u64 dim_index = 0; dim_index < DIM; dim_index++) {
-  //   shash_keys[dim_index].reserve(PTS_NUM * (2 * DELTA + 1));
-  //   shash_values[dim_index].reserve(PTS_NUM * (2 * DELTA + 1));
-  //   for (u64 i = 0; i < intervals[dim_index].size(); i++) {
-  //     for (u64 j = intervals[dim_index][i].first;
-  //          j <= intervals[dim_index][i].second; j++) {
-  //       shash_keys[dim_index].push_back(get_key_from_pt_dim(j, dim_index));
-  //       shash_values[dim_index].push_back(random_blks[dim_index * PTS_NUM +
-  //       i]);
-  //     }
-  //   }
-  // }
-
-  // for (u64 i = 0; i < DIM; i++) {
-  //   padding_keys(shash_keys[i], PTS_NUM * (2 * DELTA + 1));
-  //   padding_values(shash_values[i], PTS_NUM * (2 * DELTA + 1),
-  //                  PAILLIER_CIPHER_SIZE_IN_BLOCK);
-  // }
-
-  // RBOKVS rb_okvs;
-  // rb_okvs.init(PTS_NUM * (2 * DELTA + 1), OKVS_EPSILON, OKVS_LAMBDA,
-  // OKVS_SEED); auto okvr_mSize = rb_okvs.mSize;
-
-  // shash_encodings.resize(DIM);
-  // for (u64 i = 0; i < DIM; i++) {
-  //   shash_encodings[i].resize(
-  //       rb_okvs.mSize, vector<block>(PAILLIER_CIPHER_SIZE_IN_BLOCK,
-  //       ZeroBlock));
-  //   rb_okvs.encode(shash_keys[i], shash_values[i],
-  //                  PAILLIER_CIPHER_SIZE_IN_BLOCK, shash_encodings[i]);
-  // }
-
   auto okvr_mN = PTS_NUM * (2 * DELTA + 1);
-  RBOKVS rb_okvs_1;
+  RBOKVS_Fixed<PAILLIER_CIPHER_SIZE_IN_BLOCK> rb_okvs_1;
   rb_okvs_1.init(PTS_NUM * (2 * DELTA + 1), OKVS_EPSILON, OKVS_LAMBDA,
                  OKVS_SEED);
   shash_encodings.resize(DIM);
-  for (u64 i = 0; i < DIM; i++) {
-    shash_encodings[i].resize(
-        rb_okvs_1.mSize,
-        vector<block>(PAILLIER_CIPHER_SIZE_IN_BLOCK, ZeroBlock));
-    for (auto j = 0; j < rb_okvs_1.mSize; j++) {
-      prng.get(shash_encodings[i][j].data(), PAILLIER_CIPHER_SIZE_IN_BLOCK);
+  if (!real_setup) {
+    for (u64 i = 0; i < DIM; i++) {
+      shash_encodings[i].resize(rb_okvs_1.encodingSize());
+      prng.get(shash_encodings[i].data(), shash_encodings[i].size());
+    }
+    return;
+  }
+
+  // every x of an interval maps to the encrypted random value of the
+  // interval. only the values of actual intervals are encrypted
+  vector<u64> interval_values;
+  for (u64 dim_index = 0; dim_index < DIM; dim_index++) {
+    for (u64 i = 0; i < intervals[dim_index].size(); i++) {
+      interval_values.push_back(random_values[dim_index * PTS_NUM + i]);
+    }
+  }
+  auto interval_ciphers =
+      setup_encrypt(palliar_pk, interval_values, THREAD_NUM);
+
+  u64 cipher_index = 0;
+  for (u64 dim_index = 0; dim_index < DIM; dim_index++) {
+    vector<block> keys;
+    keys.reserve(okvr_mN);
+    // rows past the intervals are padding and keep random values
+    vector<block> values(okvr_mN * PAILLIER_CIPHER_SIZE_IN_BLOCK);
+    prng.get(values.data(), values.size());
+    for (auto [start, end] : intervals[dim_index]) {
+      auto cipher = interval_ciphers.begin() +
+                    cipher_index * PAILLIER_CIPHER_SIZE_IN_BLOCK;
+      for (u64 x = start; x <= end; x++) {
+        std::copy(cipher, cipher + PAILLIER_CIPHER_SIZE_IN_BLOCK,
+                  values.begin() + keys.size() * PAILLIER_CIPHER_SIZE_IN_BLOCK);
+        keys.push_back(get_key_from_pt_dim(x, dim_index));
+      }
+      cipher_index++;
     }
+    padding_keys(keys, okvr_mN);
+
+    shash_encodings[dim_index].resize(rb_okvs_1.encodingSize());
+    rb_okvs_1.encode(keys, values, shash_encodings[dim_index]);
   }
 }
 
-void ShashAheP1::online(vector<vector<vector<block>>> &shash_encodings) {
+coproto::task<void> ShashAheP1::online(vector<vector<block>> &shash_encodings) {
   u64 shash_encodings_mN = PTS_NUM * (2 * DELTA + 1);
   RBOKVS rbokvs;
   rbokvs.init(shash_encodings_mN, OKVS_EPSILON, OKVS_LAMBDA, OKVS_SEED);
-  coproto::sync_wait(sockets[0].send(shash_encodings_mN));
-  coproto::sync_wait(sockets[0].send(rbokvs.mSize));
-  coproto::sync_wait(sockets[0].flush());
+  FrameWriter shash_header;
+  shash_header.put<u64>(shash_encodings_mN).put<u64>(rbokvs.mSize);
+  co_await send_frame(shash_header);
 
   u64 sum_blk_size = OTHER_PTS_NUM * PAILLIER_CIPHER_SIZE_IN_BLOCK;
   vector<block> sums_blks(sum_blk_size);
 
-  coproto::sync_wait(sockets[0].recvResize(sums_blks));
-  coproto::sync_wait(sockets[0].flush());
-
-  auto sum_bns = block_vector_to_bignumers(sums_blks, OTHER_PTS_NUM);
+  co_await recv_payload(sums_blks);
 
-  auto sum_cipher = ipcl::CipherText(palliar_pk, sum_bns);
+  vector<BigNumber> sum_bns(OTHER_PTS_NUM);
+  blocks_to_bignumers(sums_blks, sum_bns, THREAD_NUM);
 
-  auto sum_plains = palliar_sk.decrypt(sum_cipher);
+  auto sum_plains =
+      PaillierEngine(palliar_pk, THREAD_NUM).decrypt(palliar_sk, sum_bns);
 
   vector<u64> res(OTHER_PTS_NUM);
   for (u64 i = 0; i < OTHER_PTS_NUM; i++) {
@@ -166,6 +154,7 @@ void ShashAheP1::online(vector<vector<vector<block>>> &shash_encodings) {
     res[i] = ((u64)tmp[1] << 32) | tmp[0];
   }
 
-  coproto::sync_wait(sockets[0].send(res));
-  coproto::sync_wait(sockets[0].flush());
+  FrameWriter res_frame;
+  res_frame.putArray(res);
+  co_await send_frame(res_frame);
 }
\ No newline at end of file
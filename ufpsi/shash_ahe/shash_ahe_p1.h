@@ -54,7 +54,7 @@ public:
     prng.SetSeed(oc::sysRandomSeed());
   };
 
-  void offline(vector<vector<vector<block>>> &shash_encodings);
+  void offline(vector<vector<block>> &shash_encodings);
 
-  void online(vector<vector<vector<block>>> &shash_encodings);
+  coproto::task<void> online(vector<vector<block>> &shash_encodings);
 };
\ No newline at end of file
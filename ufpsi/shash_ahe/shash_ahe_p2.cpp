@@ -11,6 +11,7 @@
 #include <vector>
 
 #include "config.h"
+#include "paillier/engine.h"
 #include "rb_okvs/rb_okvs.h"
 #include "shash_ahe_p2.h"
 #include "utils/util.h"
@@ -28,46 +29,42 @@ void ShashAheP2::offline() {
   masks_cipher = palliar_pk.encrypt(masks_pts);
 }
 
-void ShashAheP2::online(vector<vector<vector<block>>> &shash_encodings) {
-  u64 shash_mN;
-  u64 shash_mSize;
-  coproto::sync_wait(sockets[0].recv(shash_mN));
-  coproto::sync_wait(sockets[0].recv(shash_mSize));
-  coproto::sync_wait(sockets[0].flush());
+coproto::task<void> ShashAheP2::online(vector<vector<block>> &shash_encodings) {
+  auto shash_header = co_await recv_frame();
+  u64 shash_mN = shash_header.get<u64>();
+  u64 shash_mSize = shash_header.get<u64>();
 
   RBOKVS rb_okvs;
   rb_okvs.init(shash_mN, OKVS_EPSILON, OKVS_LAMBDA, OKVS_SEED);
 
-  vector<vector<BigNumber>> sum_bns(DIM, vector<BigNumber>(PTS_NUM));
-  for (u64 i = 0; i < PTS_NUM; i++) {
-    for (u64 j = 0; j < DIM; j++) {
-      sum_bns[j][i] = block_vector_to_bignumer(
-          rb_okvs.decode(shash_encodings[j], get_key_from_pt_dim(pts[i][j], j),
-                         PAILLIER_CIPHER_SIZE_IN_BLOCK));
-    }
+  vector<vector<BigNumber>> sum_bns(DIM);
+  vector<block> decode_keys(PTS_NUM);
+  vector<block> decode_blks(PTS_NUM * PAILLIER_CIPHER_SIZE_IN_BLOCK);
+  for (u64 j = 0; j < DIM; j++) {
+    parallel_for(PTS_NUM, THREAD_NUM, [&](u64 start, u64 end) {
+      for (u64 i = start; i < end; i++) {
+        decode_keys[i] = get_key_from_pt_dim(pts[i][j], j);
+      }
+    });
+    rb_okvs.decode(shash_encodings[j], decode_keys,
+                   PAILLIER_CIPHER_SIZE_IN_BLOCK, decode_blks, THREAD_NUM);
+    sum_bns[j].resize(PTS_NUM);
+    blocks_to_bignumers(decode_blks, sum_bns[j], THREAD_NUM);
   }
 
   shash_encodings.clear();
   shash_encodings.shrink_to_fit();
 
-  vector<ipcl::CipherText> sum_ciphers(DIM);
-  for (u64 i = 0; i < DIM; i++) {
-    sum_ciphers[i] = ipcl::CipherText(palliar_pk, sum_bns[i]);
-  }
-  for (u64 i = 1; i < DIM; i++) {
-    sum_ciphers[0] = sum_ciphers[0] + sum_ciphers[i];
-  }
-
-  sum_ciphers[0] = sum_ciphers[0] + masks_cipher;
+  sum_bns.push_back(masks_cipher.getTexts());
+  auto sum_cipher = PaillierEngine(palliar_pk, THREAD_NUM).add(sum_bns);
 
-  auto sum_blks = bignumers_to_block_vector(sum_ciphers[0].getTexts());
+  vector<block> sum_blks(sum_cipher.getSize() * PAILLIER_CIPHER_SIZE_IN_BLOCK);
+  bignumers_to_blocks(sum_cipher.getTexts(), sum_blks, THREAD_NUM);
 
-  coproto::sync_wait(sockets[0].send(sum_blks));
-  coproto::sync_wait(sockets[0].flush());
+  co_await send_payload(sum_blks);
 
   vector<u64> res(PTS_NUM);
-  coproto::sync_wait(sockets[0].recvResize(res));
-  coproto::sync_wait(sockets[0].flush());
+  (co_await recv_frame()).getArray<u64>(res);
 
   // for (u64 i = 0; i < 5; i++) {
   //   std::cout << "i " << i << " " << res[i] - masks[i] << endl;
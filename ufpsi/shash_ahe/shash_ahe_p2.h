@@ -51,5 +51,5 @@ public:
   };
 
   void offline();
-  void online(vector<vector<vector<block>>> &shash_encodings);
+  coproto::task<void> online(vector<vector<block>> &shash_encodings);
 };
@@ -95,7 +95,7 @@ void ShashOprfP1::offline_hash() {
   }
 }
 
-void ShashOprfP1::online_hash() {
+coproto::task<void> ShashOprfP1::online_hash() {
   // PSV sender offline
   vector<block> psv_r(DIM);
   prng.get<block>(psv_r.data(), psv_r.size());
@@ -108,7 +108,7 @@ void ShashOprfP1::online_hash() {
 
   /// PSV sender Step 1
   volePSI::RsOprfSender oprfSender;
-  coproto::sync_wait(oprfSender.send(OTHER_PTS_NUM * DIM, prng, sockets[0]));
+  co_await oprfSender.send(OTHER_PTS_NUM * DIM, prng, sockets[0], THREAD_NUM);
 
   /// PSV sender Step 2
   vector<vector<block>> okvr_keys(DIM);
@@ -122,7 +122,7 @@ void ShashOprfP1::online_hash() {
 
   for (u64 i = 0; i < DIM; i++) {
     oprf_eval_values[i].resize(shash_keys_blocks[i].size());
-    oprfSender.eval(shash_keys_blocks[i], oprf_eval_values[i]);
+    oprfSender.eval(shash_keys_blocks[i], oprf_eval_values[i], THREAD_NUM);
   }
 
   vector<vector<block>> okvr_values(DIM);
@@ -138,29 +138,36 @@ void ShashOprfP1::online_hash() {
     padding_keys(okvr_keys[i], PTS_NUM * (2 * DELTA + 1));
   }
 
+  // the DIM encodes have the same size and reuse one arena
+  RowArena okvs_arena;
   vector<RBOKVS> rb_okvs_vec;
   rb_okvs_vec.resize(DIM);
   for (u64 i = 0; i < DIM; i++) {
     rb_okvs_vec[i].init(PTS_NUM * (2 * DELTA + 1), OKVS_EPSILON, OKVS_LAMBDA,
                         OKVS_SEED);
+    rb_okvs_vec[i].mArena = &okvs_arena;
   }
 
   // encode
   auto okvr_size = rb_okvs_vec[0].mSize;
   vector<vector<block>> encodings(DIM, vector<block>(okvr_size, ZeroBlock));
 
-  for (u64 i = 0; i < DIM; i++) {
-    rb_okvs_vec[i].encode(okvr_keys[i].data(), okvr_values[i].data(),
-                          encodings[i].data());
-  }
+  FrameWriter okvr_header;
+  okvr_header.put<u64>(okvr_size);
+  co_await send_frame(okvr_header);
 
-  auto tmp_com = sockets[0].mImpl->mBytesSent;
-  coproto::sync_wait(sockets[0].send(okvr_size));
-  coproto::sync_wait(sockets[0].flush());
+  // each dim is on its way while the next one encodes
+  std::vector<macoro::eager_task<void>> sending;
+  sending.reserve(DIM);
   for (u64 i = 0; i < DIM; i++) {
-    coproto::sync_wait(sockets[0].send(encodings[i]));
+    rb_okvs_vec[i].encode(okvr_keys[i].data(), okvr_values[i].data(),
+                          encodings[i].data(), THREAD_NUM);
+    if (i > 0) {
+      co_await sending[i - 1];
+    }
+    sending.push_back(send_payload(encodings[i]) | macoro::make_eager());
   }
-  coproto::sync_wait(sockets[0].flush());
+  co_await sending.back();
 
   shash_keys.clear();
   shash_keys_blocks.clear();
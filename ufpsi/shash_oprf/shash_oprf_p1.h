@@ -52,5 +52,5 @@ public:
 
   void offline_hash();
 
-  void online_hash();
+  coproto::task<void> online_hash();
 };
\ No newline at end of file
@@ -23,41 +23,47 @@ void ShashOprfP2::offline_hash() {
   }
 }
 
-void ShashOprfP2::online_hash() {
+coproto::task<void> ShashOprfP2::online_hash() {
 
   /// PSV Recv Step 1
 
   vector<block> oprf_vals(PTS_NUM * DIM);
 
   volePSI::RsOprfReceiver oprfRecv;
-  coproto::sync_wait(oprfRecv.receive(oprf_keys, oprf_vals, prng, sockets[0]));
+  co_await oprfRecv.receive(oprf_keys, oprf_vals, prng, sockets[0], THREAD_NUM);
 
   spdlog::debug("P2 Step 1 oprf finished");
 
   /// PSV Recv Step 3 and Step 4
   u64 mN = OTHER_PTS_NUM * (2 * DELTA + 1);
-  u64 mSize;
-  coproto::sync_wait(sockets[0].recv(mSize));
-  coproto::sync_wait(sockets[0].flush());
+  u64 mSize = (co_await recv_frame()).get<u64>();
 
   vector<vector<block>> encodings(DIM, vector<block>(mSize));
-
-  for (u64 i = 0; i < DIM; i++) {
-    coproto::sync_wait(sockets[0].recvResize(encodings[i]));
-  }
-  coproto::sync_wait(sockets[0].flush());
-
-  spdlog::debug("P2 Step 3 finish recv");
+  // dim j is decoded while the next one is received
+  std::vector<macoro::eager_task<void>> receiving;
+  receiving.reserve(DIM);
+  receiving.push_back(recv_payload(encodings[0]) | macoro::make_eager());
 
   RBOKVS rb_okvs;
   rb_okvs.init(mN, OKVS_EPSILON, OKVS_LAMBDA, OKVS_SEED);
 
   H2_sums.resize(PTS_NUM, ZeroBlock);
 
-  for (u64 i = 0; i < PTS_NUM; i++) {
-    for (u64 j = 0; j < DIM; j++) {
-      auto tmp = rb_okvs.decode(encodings[j].data(), block(pts[i][j], j));
-      H2_sums[i] = H2_sums[i] ^ tmp ^ oprf_vals[i * DIM + j];
+  vector<block> decode_keys(PTS_NUM);
+  vector<block> decode_vals(PTS_NUM);
+  for (u64 j = 0; j < DIM; j++) {
+    for (u64 i = 0; i < PTS_NUM; i++) {
+      decode_keys[i] = block(pts[i][j], j);
+    }
+    co_await receiving[j];
+    if (j + 1 < DIM) {
+      receiving.push_back(recv_payload(encodings[j + 1]) |
+                          macoro::make_eager());
+    }
+    rb_okvs.decode(encodings[j].data(), decode_keys.data(), PTS_NUM,
+                   decode_vals.data(), THREAD_NUM);
+    for (u64 i = 0; i < PTS_NUM; i++) {
+      H2_sums[i] = H2_sums[i] ^ decode_vals[i] ^ oprf_vals[i * DIM + j];
     }
   }
 
@@ -45,5 +45,5 @@ public:
 
   void offline_hash();
 
-  void online_hash();
+  coproto::task<void> online_hash();
 };